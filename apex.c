@@ -0,0 +1,255 @@
+/*
+ *  apex.c
+ *  Contains libapex, see apex.h. Runs without callbacks or stops on a
+ *  pc or predicate go through the pipeline loop of APEX_cpu_step; the
+ *  others take one cycle at a time to look at the pipeline in between.
+ */
+#include <stdlib.h>
+
+#include "apex.h"
+
+struct APEX_Callbacks {
+  APEX_Commit_Callback on_commit;
+  APEX_Stage_Callback on_stage;
+  void *arg;
+};
+
+/**
+ * Loads a program into a new CPU that prints nothing. Its config may
+ * be changed before the first step, but not debug_messages.
+ * @param filename text program or program image
+ * @return NULL on error
+ */
+APEX_CPU *apex_open(const char *filename) {
+  APEX_CPU *cpu = APEX_cpu_init(filename);
+  if (cpu) {
+    cpu->config.out = NULL;
+  }
+  return cpu;
+}
+
+/**
+ * Copies a CPU, for another run from the state it is in. The copy has no
+ * callbacks, and uses the code memory of cpu, which must outlive it.
+ * Data memory is shared until either CPU stores to it, a page at a time.
+ * @param cpu
+ * @return NULL if out of memory
+ */
+APEX_CPU *apex_clone(const APEX_CPU *cpu) {
+  return APEX_cpu_clone(cpu);
+}
+
+void apex_close(APEX_CPU *cpu) {
+  if (cpu) {
+    free(cpu->callbacks);
+    APEX_cpu_stop(cpu);
+  }
+}
+
+/**
+ * Sets the functions called as the CPU runs, replacing any set before
+ * @param cpu
+ * @param on_commit NULL for none
+ * @param on_stage NULL for none
+ * @param arg passed to both
+ */
+void apex_set_callbacks(APEX_CPU *cpu, APEX_Commit_Callback on_commit,
+                        APEX_Stage_Callback on_stage, void *arg) {
+  if (!on_commit && !on_stage) {
+    free(cpu->callbacks);
+    cpu->callbacks = NULL;
+    return;
+  }
+  if (!cpu->callbacks) {
+    cpu->callbacks = malloc(sizeof(*cpu->callbacks));
+    if (!cpu->callbacks) {
+      return;
+    }
+  }
+  cpu->callbacks->on_commit = on_commit;
+  cpu->callbacks->on_stage = on_stage;
+  cpu->callbacks->arg = arg;
+}
+
+static int is_complete(const APEX_CPU *cpu) {
+  return cpu->ins_completed == cpu->code_memory_size;
+}
+
+/**
+ * Fills in the instruction writeback commits in the next cycle
+ * @param cpu
+ * @param commit
+ * @return 0 if writeback holds no instruction
+ */
+static int next_commit(const APEX_CPU *cpu, APEX_Commit *commit) {
+  const CPU_Stage *stage = &cpu->stage[WB];
+  if (stage->busy || stage->stalled || stage->opcode_id == OP_NOP ||
+      stage->opcode_id == OP_EMPTY || stage->seq <= cpu->last_retired) {
+    return 0;
+  }
+  commit->clock = cpu->clock + 1;
+  commit->pc = stage->pc;
+  commit->opcode_id = stage->opcode_id;
+  commit->rd = REG_NONE;
+  commit->value = 0;
+  commit->mem_address = 0;
+  switch (stage->opcode_id) {
+    case OP_STORE:
+      commit->value = stage->rs1_value;
+      commit->mem_address = stage->mem_address;
+      break;
+
+    case OP_LOAD:
+      commit->mem_address = stage->mem_address;
+      /* fall through */
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_AND:
+    case OP_OR:
+    case OP_EX_OR:
+    case OP_MOVC:
+      commit->rd = stage->rd;
+      commit->value = stage->buffer;
+      break;
+
+    default:
+      break;
+  }
+  return 1;
+}
+
+/**
+ * Runs one cycle, calling the callbacks
+ * @param cpu
+ * @return pc of the instruction committed, 0 if none
+ */
+static int step_cycle(APEX_CPU *cpu) {
+  const struct APEX_Callbacks *callbacks = cpu->callbacks;
+  APEX_Commit commit;
+  int committed = next_commit(cpu, &commit);
+
+  APEX_cpu_cycle(cpu);
+
+  if (callbacks) {
+    if (committed && callbacks->on_commit) {
+      callbacks->on_commit(callbacks->arg, cpu, &commit);
+    }
+    if (callbacks->on_stage) {
+      for (int i = WB; i >= F; --i) {
+        const CPU_Stage *stage = &cpu->stage[i];
+        if (stage->opcode_id != OP_NOP && stage->opcode_id != OP_EMPTY) {
+          callbacks->on_stage(callbacks->arg, cpu, i, stage);
+        }
+      }
+    }
+  }
+  return committed ? commit.pc : 0;
+}
+
+/**
+ * Runs the pipeline for up to cycles cycles, fewer if the program
+ * completes first
+ * @param cpu
+ * @param cycles
+ * @return number of cycles run
+ */
+uint64_t apex_step(APEX_CPU *cpu, uint64_t cycles) {
+  if (!cpu->callbacks) {
+    return APEX_cpu_step(cpu, cycles);
+  }
+  uint64_t run = 0;
+  for (; run < cycles && !is_complete(cpu); ++run) {
+    step_cycle(cpu);
+  }
+  if (is_complete(cpu)) {
+    cpu->finished = 1;
+  }
+  return run;
+}
+
+/**
+ * Runs the pipeline until one of the conditions of until holds or the
+ * program completes. With none set it runs until the program completes,
+ * which some programs never do.
+ * @param cpu
+ * @param until
+ * @return why it stopped; completion wins over a condition met at the
+ * same cycle
+ */
+APEX_Stop apex_run_until(APEX_CPU *cpu, const APEX_Until *until) {
+  if (!cpu->callbacks && !until->pc && !until->predicate) {
+    uint64_t cycles = UINT64_MAX;
+    if (until->cycle) {
+      cycles = cpu->clock < until->cycle ? until->cycle - cpu->clock : 0;
+    }
+    APEX_cpu_step(cpu, cycles);
+    return is_complete(cpu) ? APEX_STOP_FINISHED : APEX_STOP_CYCLE;
+  }
+
+  while (1) {
+    if (is_complete(cpu)) {
+      cpu->finished = 1;
+      return APEX_STOP_FINISHED;
+    }
+    if (until->cycle && cpu->clock >= until->cycle) {
+      return APEX_STOP_CYCLE;
+    }
+    int pc = step_cycle(cpu);
+    if (is_complete(cpu)) {
+      cpu->finished = 1;
+      return APEX_STOP_FINISHED;
+    }
+    if (until->pc && pc == until->pc) {
+      return APEX_STOP_PC;
+    }
+    if (until->predicate && until->predicate(until->arg, cpu)) {
+      return APEX_STOP_PREDICATE;
+    }
+  }
+}
+
+int apex_finished(const APEX_CPU *cpu) {
+  return cpu->finished;
+}
+
+int apex_clock(const APEX_CPU *cpu) {
+  return cpu->clock;
+}
+
+/**
+ * Instructions committed so far
+ * @param cpu
+ * @return
+ */
+uint64_t apex_instructions(const APEX_CPU *cpu) {
+  return cpu->ins_retired;
+}
+
+/**
+ * Architectural registers
+ * @param cpu
+ * @return R0 to R15, read in place as the CPU runs
+ */
+const int *apex_registers(const APEX_CPU *cpu) {
+  return cpu->regs;
+}
+
+/**
+ * Word of data memory
+ * @param cpu
+ * @param address wrapped around the memory size
+ * @return
+ */
+int apex_data_memory(const APEX_CPU *cpu, int address) {
+  return memory_word(&cpu->data_memory, address);
+}
+
+/**
+ * Words of data memory, a power of 2
+ * @param cpu
+ * @return
+ */
+int apex_data_memory_size(const APEX_CPU *cpu) {
+  return cpu->data_memory.size;
+}
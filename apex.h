@@ -0,0 +1,82 @@
+#ifndef _APEX_H_
+#define _APEX_H_
+/**
+ *  apex.h
+ *  Contains the API of libapex, for driving the pipeline from another
+ *  program: open a program, step it or run it until a pc, a cycle or a
+ *  condition, be called back as instructions commit and stages change,
+ *  and read the registers and memory. The library prints nothing.
+ *
+ *  To run one program many times, open it once and clone it for every
+ *  run; clones share its code memory, and the pages of its data memory
+ *  until either stores to them.
+ */
+#include <stdint.h>
+
+#include "cpu.h"
+
+/* Instruction committed, i.e. leaving writeback, see apex_set_callbacks */
+typedef struct APEX_Commit {
+  int clock;          // Cycle it committed in
+  int pc;
+  int opcode_id;      // APEX_Opcode
+  int rd;             // Register written, REG_NONE if none
+  int value;          // Value written to rd, or stored by a STORE
+  int mem_address;    // Word read or written by a LOAD or STORE
+} APEX_Commit;
+
+/* Called for each instruction committed */
+typedef void (*APEX_Commit_Callback)(void *arg, const APEX_CPU *cpu,
+                                     const APEX_Commit *commit);
+
+/* Called after each cycle for each stage holding an instruction, from
+ * writeback back to fetch */
+typedef void (*APEX_Stage_Callback)(void *arg, const APEX_CPU *cpu,
+                                    int stage_id, const CPU_Stage *stage);
+
+/* Called after each cycle, nonzero to stop the run */
+typedef int (*APEX_Predicate)(void *arg, const APEX_CPU *cpu);
+
+/* Where apex_run_until stops. Fields left 0 are not checked; the run
+ * also stops once the program completes. */
+typedef struct APEX_Until {
+  int pc;                   // Once the instruction at this pc commits
+  int cycle;                // Once the clock reaches this cycle
+  APEX_Predicate predicate; // Once it returns nonzero
+  void *arg;                // Passed to predicate
+} APEX_Until;
+
+/* Why apex_run_until stopped */
+typedef enum APEX_Stop {
+  APEX_STOP_FINISHED,
+  APEX_STOP_PC,
+  APEX_STOP_CYCLE,
+  APEX_STOP_PREDICATE
+} APEX_Stop;
+
+APEX_CPU *apex_open(const char *filename);
+
+APEX_CPU *apex_clone(const APEX_CPU *cpu);
+
+void apex_close(APEX_CPU *cpu);
+
+void apex_set_callbacks(APEX_CPU *cpu, APEX_Commit_Callback on_commit,
+                        APEX_Stage_Callback on_stage, void *arg);
+
+uint64_t apex_step(APEX_CPU *cpu, uint64_t cycles);
+
+APEX_Stop apex_run_until(APEX_CPU *cpu, const APEX_Until *until);
+
+int apex_finished(const APEX_CPU *cpu);
+
+int apex_clock(const APEX_CPU *cpu);
+
+uint64_t apex_instructions(const APEX_CPU *cpu);
+
+const int *apex_registers(const APEX_CPU *cpu);
+
+int apex_data_memory(const APEX_CPU *cpu, int address);
+
+int apex_data_memory_size(const APEX_CPU *cpu);
+
+#endif
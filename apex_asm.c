@@ -0,0 +1,34 @@
+/*
+ *  apex_asm.c
+ *  Assembles an APEX text program into a binary program image that
+ *  apex_sim maps directly into code memory
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cpu.h"
+#include "program_image.h"
+
+int main(int argc, char const *argv[]) {
+  if (argc != 3) {
+    fprintf(stderr, "APEX_Help : Usage %s <input_file> <output_image>\n", argv[0]);
+    exit(1);
+  }
+
+  int size = 0;
+  APEX_Instruction *code_memory = create_code_memory(argv[1], &size);
+  if (!code_memory) {
+    fprintf(stderr, "APEX_Error : Unable to read program %s\n", argv[1]);
+    exit(1);
+  }
+
+  if (write_program_image(argv[2], code_memory, size) != 0) {
+    fprintf(stderr, "APEX_Error : Unable to write image %s\n", argv[2]);
+    free(code_memory);
+    exit(1);
+  }
+
+  fprintf(stderr, "APEX_ASM : Wrote %d instructions to %s\n", size, argv[2]);
+  free(code_memory);
+  return 0;
+}
@@ -0,0 +1,240 @@
+/*
+ *  apex_batch.c
+ *  Runs many simulations in one process, spread over a thread pool.
+ *  Each line of the manifest is a job:
+ *     <input_file> [<functionality> [<cycles>]] [--no-forwarding]
+ *  with the defaults of apex_sim ("display" is run without output, as
+ *  simulate). Anything after a '#' is a comment; blank lines are skipped.
+ *  Simulation output is not printed; instead one line per job, in
+ *  manifest order, gives its outcome:
+ *     <job> <input_file> <functionality> <status> <cycles> <instructions>
+ *     <register hash> <memory hash>
+ *  status is "complete", "stopped" (at the cycle or instruction limit)
+ *  or "error". cycles is 0 in the modes without a pipeline. The hashes
+ *  are FNV-1a over R0 to R15 and over the whole data memory.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cpu.h"
+#include "thread_pool.h"
+
+/* Longest manifest line accepted */
+#define MAX_LINE_LENGTH 4096
+
+/* One line of the manifest and its outcome */
+typedef struct Batch_Job {
+    char *filename;
+    char *functionality;
+    char *cycles;
+    int no_forwarding;
+
+    int status;               // -1 error, 0 stopped, 1 complete
+    int clock;
+    uint64_t instructions;
+    uint64_t regs_hash;
+    uint64_t memory_hash;
+} Batch_Job;
+
+static uint64_t fnv1a(const void *data, size_t length) {
+  const unsigned char *bytes = data;
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < length; ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+/**
+ * Runs one job, with all output off
+ * @param arg array of jobs
+ * @param index
+ */
+static void run_job(void *arg, int index) {
+  Batch_Job *job = &((Batch_Job *) arg)[index];
+  APEX_CPU *cpu = APEX_cpu_init(job->filename);
+  if (!cpu) {
+    job->status = -1;
+    return;
+  }
+
+  cpu->config.out = NULL;
+  if (job->no_forwarding) {
+    cpu->config.data_forwarding = 0;
+  }
+
+  if (APEX_cpu_run(cpu, job->functionality, job->cycles) != 0) {
+    job->status = -1;
+  } else {
+    job->status = cpu->finished;
+    job->clock = cpu->clock;
+    job->instructions = cpu->ins_retired;
+    job->regs_hash = fnv1a(cpu->regs, sizeof(int) * 16);
+    job->memory_hash = memory_hash(&cpu->data_memory);
+  }
+  APEX_cpu_stop(cpu);
+}
+
+/**
+ * Fills in a job from a manifest line
+ * @param job
+ * @param line
+ * @return 1 if the line holds a job, 0 if it is blank or a comment,
+ * -1 if it is malformed
+ */
+static int parse_job(Batch_Job *job, char *line) {
+  const char *positional[3] = {NULL, "display", "0"};
+  int num_positional = 0;
+  char *save;
+
+  memset(job, 0, sizeof(*job));
+  for (char *word = strtok_r(line, " \t\r\n", &save); word;
+       word = strtok_r(NULL, " \t\r\n", &save)) {
+    if (word[0] == '#') {
+      break;
+    }
+    if (strcmp(word, "--no-forwarding") == 0) {
+      job->no_forwarding = 1;
+    } else if (strncmp(word, "--", 2) == 0 || num_positional == 3) {
+      return -1;
+    } else {
+      positional[num_positional++] = word;
+    }
+  }
+  if (num_positional == 0) {
+    return job->no_forwarding ? -1 : 0;
+  }
+
+  job->filename = strdup(positional[0]);
+  job->functionality = strdup(positional[1]);
+  job->cycles = strdup(positional[2]);
+  return 1;
+}
+
+/**
+ * Reads all jobs of a manifest
+ * @param filename
+ * @param num_jobs
+ * @return NULL on error
+ */
+static Batch_Job *read_manifest(const char *filename, int *num_jobs) {
+  FILE *fp = fopen(filename, "r");
+  if (!fp) {
+    fprintf(stderr, "APEX_Error : Unable to open manifest %s\n", filename);
+    return NULL;
+  }
+
+  Batch_Job *jobs = NULL;
+  int capacity = 0;
+  int count = 0;
+  int line_number = 0;
+  char line[MAX_LINE_LENGTH];
+  while (fgets(line, sizeof(line), fp)) {
+    line_number++;
+    if (count == capacity) {
+      capacity = capacity ? 2 * capacity : 256;
+      Batch_Job *grown = realloc(jobs, capacity * sizeof(*grown));
+      if (!grown) {
+        fprintf(stderr, "APEX_Error : Out of memory reading %s\n", filename);
+        fclose(fp);
+        free(jobs);
+        return NULL;
+      }
+      jobs = grown;
+    }
+
+    int parsed = parse_job(&jobs[count], line);
+    if (parsed < 0) {
+      fprintf(stderr, "APEX_Error : %s:%d: Bad job\n", filename, line_number);
+      fclose(fp);
+      free(jobs);
+      return NULL;
+    }
+    count += parsed;
+  }
+  fclose(fp);
+
+  *num_jobs = count;
+  return jobs;
+}
+
+static const char *status_name(int status) {
+  return status < 0 ? "error" : status ? "complete" : "stopped";
+}
+
+int main(int argc, char const *argv[]) {
+  const char *manifest = NULL;
+  const char *output = NULL;
+  int threads = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--threads=", 10) == 0) {
+      threads = atoi(argv[i] + 10);
+    } else if (strncmp(argv[i], "--output=", 9) == 0) {
+      output = argv[i] + 9;
+    } else if (!manifest && strncmp(argv[i], "--", 2) != 0) {
+      manifest = argv[i];
+    } else {
+      manifest = NULL;
+      break;
+    }
+  }
+  if (!manifest) {
+    fprintf(stderr, "APEX_Help : Usage %s <manifest> [--threads=N] "
+            "[--output=FILE]\n", argv[0]);
+    exit(1);
+  }
+
+  int num_jobs = 0;
+  Batch_Job *jobs = read_manifest(manifest, &num_jobs);
+  if (!jobs) {
+    exit(1);
+  }
+
+  FILE *out = output ? fopen(output, "w") : stdout;
+  if (!out) {
+    fprintf(stderr, "APEX_Error : Unable to write %s\n", output);
+    exit(1);
+  }
+
+  Thread_Pool *pool = thread_pool_create(threads > 0 ? threads
+                                                     : thread_pool_default_size());
+  if (!pool) {
+    fprintf(stderr, "APEX_Error : Unable to start threads\n");
+    exit(1);
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  thread_pool_run(pool, run_job, jobs, num_jobs);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+  int failed = 0;
+  fprintf(out, "# job input_file functionality status cycles instructions "
+          "regs_hash memory_hash\n");
+  for (int i = 0; i < num_jobs; ++i) {
+    Batch_Job *job = &jobs[i];
+    failed += job->status < 0;
+    fprintf(out, "%d %s %s %s %d %llu %016llx %016llx\n", i, job->filename,
+            job->functionality, status_name(job->status), job->clock,
+            (unsigned long long) job->instructions,
+            (unsigned long long) job->regs_hash,
+            (unsigned long long) job->memory_hash);
+    free(job->filename);
+    free(job->functionality);
+    free(job->cycles);
+  }
+  if (output) {
+    fclose(out);
+  }
+
+  fprintf(stderr, "APEX_BATCH : %d jobs (%d failed) on %d threads in %.3f s, "
+          "%.1f jobs/s\n", num_jobs, failed, thread_pool_size(pool), seconds,
+          seconds > 0 ? num_jobs / seconds : 0.0);
+  thread_pool_destroy(pool);
+  free(jobs);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,181 @@
+/*
+ *  apex_simc.c
+ *  Client of apex_simd: sends the jobs of a manifest (see apex_batch.c,
+ *  "-" for stdin) to the server and prints the results it sends back,
+ *  one line of JSON per job in the order they finish. Input files are
+ *  sent as absolute paths, as the server runs in another directory.
+ *  With --stats it prints the counts of the server instead.
+ */
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Default path of the socket, as in apex_simd.c */
+#define DEFAULT_SOCKET_PATH "/tmp/apex_simd.sock"
+
+/* Longest manifest line accepted */
+#define MAX_LINE_LENGTH 4096
+
+/**
+ * Connects to the server
+ * @param path
+ * @return socket, or -1 on error
+ */
+static int connect_to(const char *path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * Turns a manifest line into a request, the input file made absolute
+ * @param line
+ * @param request
+ * @param size
+ * @return 1 if the line holds a job, 0 if it is blank or a comment, -1
+ * if the request does not fit
+ */
+static int make_request(char *line, char *request, size_t size) {
+  char *save;
+  char *first = strtok_r(line, " \t\r\n", &save);
+  if (!first || first[0] == '#') {
+    return 0;
+  }
+  char absolute[PATH_MAX];
+  const char *filename = realpath(first, absolute) ? absolute : first;
+  int length = snprintf(request, size, "%s", filename);
+  for (char *word = strtok_r(NULL, " \t\r\n", &save); word && word[0] != '#';
+       word = strtok_r(NULL, " \t\r\n", &save)) {
+    length += snprintf(request + length, length < (int) size ? size - length : 0,
+                       " %s", word);
+  }
+  if (length + 1 >= (int) size) {
+    return -1;
+  }
+  request[length++] = '\n';
+  request[length] = '\0';
+  return 1;
+}
+
+/**
+ * Writes a whole buffer to the server
+ * @return 0 on success, -1 on error
+ */
+static int write_all(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t sent = write(fd, data, length);
+    if (sent < 0) {
+      return -1;
+    }
+    data += sent;
+    length -= sent;
+  }
+  return 0;
+}
+
+int main(int argc, char const *argv[]) {
+  const char *path = DEFAULT_SOCKET_PATH;
+  const char *manifest = NULL;
+  int stats = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--socket=", 9) == 0) {
+      path = argv[i] + 9;
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      stats = 1;
+    } else if (!manifest && (strncmp(argv[i], "--", 2) != 0 ||
+                             strcmp(argv[i], "-") == 0)) {
+      manifest = argv[i];
+    } else {
+      manifest = NULL;
+      stats = 0;
+      break;
+    }
+  }
+  if (!manifest && !stats) {
+    fprintf(stderr, "APEX_Help : Usage %s [--socket=PATH] <manifest>|- | "
+            "--stats\n", argv[0]);
+    exit(1);
+  }
+
+  FILE *in = NULL;
+  if (manifest) {
+    in = strcmp(manifest, "-") == 0 ? stdin : fopen(manifest, "r");
+    if (!in) {
+      fprintf(stderr, "APEX_Error : Unable to open manifest %s\n", manifest);
+      exit(1);
+    }
+  }
+
+  int fd = connect_to(path);
+  if (fd < 0) {
+    fprintf(stderr, "APEX_Error : Unable to connect to apex_simd on %s\n", path);
+    exit(1);
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+
+  /** The server streams results back while requests are still sent, so
+   * they are read on a child process to keep the socket from filling */
+  fflush(stdout);
+  pid_t reader = fork();
+  if (reader < 0) {
+    fprintf(stderr, "APEX_Error : Unable to fork\n");
+    exit(1);
+  }
+  if (reader == 0) {
+    FILE *results = fdopen(fd, "r");
+    char line[2 * MAX_LINE_LENGTH];
+    while (results && fgets(line, sizeof(line), results)) {
+      fputs(line, stdout);
+    }
+    fflush(stdout);
+    _exit(0);
+  }
+
+  int failed = 0;
+  if (stats) {
+    failed = write_all(fd, "STATS\n", 6) != 0;
+  } else {
+    char line[MAX_LINE_LENGTH];
+    char request[PATH_MAX + MAX_LINE_LENGTH];
+    while (!failed && fgets(line, sizeof(line), in)) {
+      int made = make_request(line, request, sizeof(request));
+      if (made < 0) {
+        fprintf(stderr, "APEX_Error : Job too long, skipped\n");
+      } else if (made) {
+        failed = write_all(fd, request, strlen(request)) != 0;
+      }
+    }
+  }
+  shutdown(fd, SHUT_WR);
+  close(fd);
+  if (in && in != stdin) {
+    fclose(in);
+  }
+
+  int status;
+  waitpid(reader, &status, 0);
+  if (failed) {
+    fprintf(stderr, "APEX_Error : Connection to apex_simd lost\n");
+  }
+  return failed;
+}
@@ -0,0 +1,983 @@
+/*
+ *  apex_simd.c
+ *  Simulation server: runs simulations for clients connecting to a Unix
+ *  domain socket, so that a run costs neither a process, nor parsing
+ *  its program again, nor printing its output.
+ *
+ *  A client sends one request per line, in the manifest format of
+ *  apex_batch plus some apex_sim options:
+ *     <input_file> [<functionality> [<cycles>]] [--no-forwarding]
+ *     [--mul-latency=N] [--data-memory=N]
+ *  input_file is opened by the server, so it is best given as an
+ *  absolute path. The requests of a connection are numbered from 0 and
+ *  run on a pool of worker threads; each result is sent back as soon as
+ *  it is ready, as one line of JSON:
+ *     {"id": 0, "input_file": "...", "functionality": "simulate",
+ *      "status": "complete", "cycles": 12, "instructions": 6,
+ *      "regs": [...R0 to R15...], "regs_hash": "...",
+ *      "memory_hash": "...", "cached": true, "seconds": 0.000012}
+ *  status is "complete", "stopped" or "error" (with an "error" message),
+ *  and the hashes are those of apex_batch. Only the pipeline modes count
+ *  cycles; the results of the others leave "cycles" out. A line "STATS" gets back the
+ *  counts of the server instead. The server sends the last result
+ *  before it closes a connection its client has shut down for writing.
+ *
+ *  No run goes past --max-cycles cycles, or instructions in the modes
+ *  that count those, whatever its request asks for; cycles of 0 run up
+ *  to that limit. Once a client has gone, its queued jobs are dropped,
+ *  and its running jobs stop at the next slice of RUN_SLICE cycles or
+ *  instructions. Only the display, simulate, functional and translate
+ *  modes run in slices; the others run to their end.
+ *
+ *  Parsed programs are kept by the hash of their contents, so an edited
+ *  file is parsed again and a copied one is not. Runs start from a copy
+ *  of the parsed CPU that shares its code memory.
+ */
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cpu.h"
+#include "thread_pool.h"
+
+/* Default path of the socket */
+#define DEFAULT_SOCKET_PATH "/tmp/apex_simd.sock"
+
+/* Default number of parsed programs kept */
+#define DEFAULT_CACHED_PROGRAMS 64
+
+/* Longest request line accepted */
+#define MAX_LINE_LENGTH 4096
+
+/* Longest result line sent */
+#define MAX_RESULT_LENGTH (2 * MAX_LINE_LENGTH)
+
+/* Default limit of a run, in cycles or instructions */
+#define DEFAULT_MAX_CYCLES 100000000
+
+/* Cycles or instructions run between checks that the client is there */
+#define RUN_SLICE 65536
+
+/* Milliseconds between those checks once the client has sent its last
+ * request */
+#define HANGUP_POLL_MS 100
+
+/* Parsed program. Runs use copies of cpu, which share its code memory,
+ * so it is only freed once no run uses it. */
+typedef struct Cached_Program {
+  uint64_t hash;          // FNV-1a of the file contents
+  size_t length;          // Length of the file
+  APEX_CPU *cpu;          // Never run itself
+  int users;              // Runs using it
+  int cached;             // Set while it is in the cache
+  uint64_t last_used;     // Cache tick of the last run, for eviction
+} Cached_Program;
+
+/* Parsed programs kept, shared by all workers */
+typedef struct Program_Cache {
+  pthread_mutex_t lock;
+  Cached_Program **programs;
+  int size;               // Slots, NULL if free
+  uint64_t tick;
+  uint64_t hits;
+  uint64_t misses;
+} Program_Cache;
+
+/* Client connection. Its thread frees it once the client has sent its
+ * last request and every job of it has sent its result. */
+typedef struct Connection {
+  int fd;
+  pthread_mutex_t lock;   // Held to write a result or change the counts
+  pthread_cond_t idle;
+  int pending;            // Jobs queued or running
+  int closing;            // Set once the client sends no more requests
+  int cancelled;          // Set once the client has gone; jobs stop
+} Connection;
+
+/* Request of a client */
+typedef struct Sim_Job {
+  Connection *connection;
+  int id;
+  char *filename;
+  char *functionality;
+  uint64_t cycles;        // 0 for no limit but --max-cycles
+  int no_forwarding;
+  uint64_t mul_latency;   // 0 for the default
+  uint64_t data_memory;   // 0 for the default
+  struct Sim_Job *next;
+} Sim_Job;
+
+/* Jobs waiting for a worker */
+typedef struct Job_Queue {
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  Sim_Job *head;
+  Sim_Job *tail;
+  uint64_t queued;
+  uint64_t done;
+  uint64_t failed;
+  uint64_t cancelled;
+} Job_Queue;
+
+static Program_Cache cache = {.lock = PTHREAD_MUTEX_INITIALIZER};
+static Job_Queue queue = {.lock = PTHREAD_MUTEX_INITIALIZER,
+                          .ready = PTHREAD_COND_INITIALIZER};
+
+/* Limit of every run, set by --max-cycles */
+static uint64_t max_cycles = DEFAULT_MAX_CYCLES;
+
+/* Path the server listens on, removed on exit */
+static char socket_path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+
+static const char *functionalities[] = {"display", "simulate", "functional",
+                                        "translate", "sample", "interval",
+                                        "lanes", "lockstep"};
+
+/* FNV-1a hash of nothing, to start from */
+#define FNV1A_INIT 14695981039346656037ull
+
+static uint64_t fnv1a_update(uint64_t hash, const void *data, size_t length) {
+  const unsigned char *bytes = data;
+  for (size_t i = 0; i < length; ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+static uint64_t fnv1a(const void *data, size_t length) {
+  return fnv1a_update(FNV1A_INIT, data, length);
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Hashes the contents of a file
+ * @param filename
+ * @param hash
+ * @param length
+ * @return 0 on success, -1 if it cannot be read
+ */
+static int hash_file(const char *filename, uint64_t *hash, size_t *length) {
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    return -1;
+  }
+  char buffer[1 << 16];
+  uint64_t h = FNV1A_INIT;
+  size_t total = 0;
+  size_t got;
+  while ((got = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+    h = fnv1a_update(h, buffer, got);
+    total += got;
+  }
+  int error = ferror(fp);
+  fclose(fp);
+  if (error) {
+    return -1;
+  }
+  *hash = h;
+  *length = total;
+  return 0;
+}
+
+static void free_program(Cached_Program *program) {
+  APEX_cpu_stop(program->cpu);
+  free(program);
+}
+
+/**
+ * Looks a program up in the cache
+ * @return the program with users counted, NULL if it is not there
+ */
+static Cached_Program *find_program(uint64_t hash, size_t length) {
+  for (int i = 0; i < cache.size; ++i) {
+    Cached_Program *program = cache.programs[i];
+    if (program && program->hash == hash && program->length == length) {
+      program->users++;
+      program->last_used = ++cache.tick;
+      return program;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Puts a program in the cache, in a free slot or in place of the one
+ * least recently used that no run uses. If there is none, the program
+ * stays out of the cache and is freed after its run.
+ * @param program
+ */
+static void insert_program(Cached_Program *program) {
+  int slot = -1;
+  for (int i = 0; i < cache.size; ++i) {
+    Cached_Program *other = cache.programs[i];
+    if (!other) {
+      slot = i;
+      break;
+    }
+    if (other->users == 0 &&
+        (slot < 0 || other->last_used < cache.programs[slot]->last_used)) {
+      slot = i;
+    }
+  }
+  if (slot < 0) {
+    return;
+  }
+  if (cache.programs[slot]) {
+    free_program(cache.programs[slot]);
+  }
+  cache.programs[slot] = program;
+  program->cached = 1;
+  program->last_used = ++cache.tick;
+}
+
+/**
+ * Gets the parsed program of a file, parsing it unless the cache has
+ * one with the same contents. Release it with release_program.
+ * @param filename
+ * @param hit set if it came from the cache
+ * @return NULL if the file cannot be loaded
+ */
+static Cached_Program *acquire_program(const char *filename, int *hit) {
+  uint64_t hash;
+  size_t length;
+  if (hash_file(filename, &hash, &length) != 0) {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&cache.lock);
+  Cached_Program *program = find_program(hash, length);
+  if (program) {
+    cache.hits++;
+  }
+  pthread_mutex_unlock(&cache.lock);
+  *hit = program != NULL;
+  if (program) {
+    return program;
+  }
+
+  /** Parsed without the lock, so other workers go on running */
+  program = calloc(1, sizeof(*program));
+  if (!program) {
+    return NULL;
+  }
+  program->cpu = APEX_cpu_init(filename);
+  if (!program->cpu) {
+    free(program);
+    return NULL;
+  }
+  program->cpu->config.out = NULL;
+  program->hash = hash;
+  program->length = length;
+  program->users = 1;
+
+  /** A file changed while it was parsed is run but not kept */
+  uint64_t parsed_hash;
+  size_t parsed_length;
+  int unchanged = hash_file(filename, &parsed_hash, &parsed_length) == 0 &&
+                  parsed_hash == hash && parsed_length == length;
+
+  pthread_mutex_lock(&cache.lock);
+  cache.misses++;
+  if (unchanged) {
+    Cached_Program *other = find_program(hash, length);
+    if (other) {
+      /** Another worker parsed it meanwhile */
+      pthread_mutex_unlock(&cache.lock);
+      free_program(program);
+      return other;
+    }
+    insert_program(program);
+  }
+  pthread_mutex_unlock(&cache.lock);
+  return program;
+}
+
+static void release_program(Cached_Program *program) {
+  pthread_mutex_lock(&cache.lock);
+  int unused = --program->users == 0 && !program->cached;
+  pthread_mutex_unlock(&cache.lock);
+  if (unused) {
+    free_program(program);
+  }
+}
+
+/**
+ * Sends a whole buffer on a connection
+ * @return 0 on success, -1 if the client has gone
+ */
+static int send_all(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    data += sent;
+    length -= sent;
+  }
+  return 0;
+}
+
+/**
+ * Appends a string to a result as a JSON string
+ * @return new length
+ */
+static int append_json_string(char *buffer, int length, int size,
+                              const char *text) {
+  if (length < size) {
+    buffer[length] = '"';
+  }
+  length++;
+  for (const unsigned char *c = (const unsigned char *) text; *c; ++c) {
+    char escaped[8];
+    if (*c == '"' || *c == '\\') {
+      snprintf(escaped, sizeof(escaped), "\\%c", *c);
+    } else if (*c < 0x20) {
+      snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+    } else {
+      escaped[0] = *c;
+      escaped[1] = '\0';
+    }
+    for (const char *e = escaped; *e; ++e) {
+      if (length < size) {
+        buffer[length] = *e;
+      }
+      length++;
+    }
+  }
+  if (length < size) {
+    buffer[length] = '"';
+  }
+  return length + 1;
+}
+
+/**
+ * Appends formatted text to a result
+ * @return new length
+ */
+static int append(char *buffer, int length, int size, const char *format, ...)
+    __attribute__((format(printf, 4, 5)));
+
+static int append(char *buffer, int length, int size, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int added = vsnprintf(buffer + (length < size ? length : size),
+                        length < size ? size - length : 0, format, args);
+  va_end(args);
+  return length + (added > 0 ? added : 0);
+}
+
+/**
+ * Whether a functionality runs the pipeline, and so counts cycles. Like
+ * apex_sim, any name but those of the other modes runs the pipeline.
+ * @param functionality
+ * @return
+ */
+static int runs_pipeline(const char *functionality) {
+  static const char *other_modes[] = {"functional", "sample", "interval",
+                                      "lanes", "translate"};
+  for (size_t i = 0; i < sizeof(other_modes) / sizeof(*other_modes); ++i) {
+    if (strcmp(functionality, other_modes[i]) == 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * Sends the result of a job to its client. A job gone wrong gets an
+ * error message instead of its outcome. A run of a mode other than the
+ * pipeline counts no cycles, so its result has only the instructions
+ * it retired.
+ * @param job
+ * @param cpu the CPU it ran on, NULL on error
+ * @param error
+ * @param hit whether its program came from the cache
+ * @param seconds host time of the run
+ */
+static void send_result(const Sim_Job *job, const APEX_CPU *cpu,
+                        const char *error, int hit, double seconds) {
+  char buffer[MAX_RESULT_LENGTH];
+  int size = sizeof(buffer) - 2;
+  int length = append(buffer, 0, size, "{\"id\": %d, \"input_file\": ", job->id);
+  length = append_json_string(buffer, length, size, job->filename);
+  length = append(buffer, length, size, ", \"functionality\": ");
+  length = append_json_string(buffer, length, size, job->functionality);
+
+  if (!cpu) {
+    length = append(buffer, length, size, ", \"status\": \"error\", \"error\": ");
+    length = append_json_string(buffer, length, size, error);
+  } else {
+    length = append(buffer, length, size, ", \"status\": \"%s\"",
+                    cpu->finished ? "complete" : "stopped");
+    if (runs_pipeline(job->functionality)) {
+      length = append(buffer, length, size, ", \"cycles\": %d", cpu->clock);
+    }
+    length = append(buffer, length, size, ", \"instructions\": %llu, \"regs\": [",
+                    (unsigned long long) cpu->ins_retired);
+    for (int i = 0; i < 16; ++i) {
+      length = append(buffer, length, size, "%s%d", i ? ", " : "", cpu->regs[i]);
+    }
+    length = append(buffer, length, size, "], \"regs_hash\": \"%016llx\", "
+                    "\"memory_hash\": \"%016llx\", \"cached\": %s, "
+                    "\"seconds\": %.6f",
+                    (unsigned long long) fnv1a(cpu->regs, sizeof(int) * 16),
+                    (unsigned long long) memory_hash(&cpu->data_memory),
+                    hit ? "true" : "false", seconds);
+  }
+  if (length > size) {
+    /** Only a very long file name gets here */
+    length = snprintf(buffer, size, "{\"id\": %d, \"status\": \"error\", "
+                      "\"error\": \"result too long\"", job->id);
+  }
+  buffer[length++] = '}';
+  buffer[length++] = '\n';
+
+  Connection *connection = job->connection;
+  pthread_mutex_lock(&connection->lock);
+  if (send_all(connection->fd, buffer, length) != 0) {
+    connection->cancelled = 1;
+  }
+  pthread_mutex_unlock(&connection->lock);
+}
+
+static int is_cancelled(Connection *connection) {
+  pthread_mutex_lock(&connection->lock);
+  int cancelled = connection->cancelled;
+  pthread_mutex_unlock(&connection->lock);
+  return cancelled;
+}
+
+/**
+ * Runs a job up to limit, in slices for the modes that can stop and go
+ * on, so that it stops soon after its client has gone
+ * @param cpu
+ * @param job
+ * @param limit cycles, or instructions in the functional modes
+ * @return 0 on success, 1 if cancelled, -1 on error
+ */
+static int run_sliced(APEX_CPU *cpu, const Sim_Job *job, uint64_t limit) {
+  const char *functionality = job->functionality;
+  int pipeline = strcmp(functionality, "display") == 0 ||
+                 strcmp(functionality, "simulate") == 0;
+  int functional = strcmp(functionality, "functional") == 0 ||
+                   strcmp(functionality, "translate") == 0;
+  char count[32];
+  if (!pipeline && !functional) {
+    snprintf(count, sizeof(count), "%llu", (unsigned long long) limit);
+    return APEX_cpu_run(cpu, functionality, count) != 0 ? -1 : 0;
+  }
+
+  /** The pipeline runs up to a cycle, the functional modes for a number
+   * of instructions more */
+  while (!cpu->finished) {
+    uint64_t done = pipeline ? (uint64_t) cpu->clock : cpu->ins_retired;
+    if (done >= limit) {
+      return 0;
+    }
+    if (is_cancelled(job->connection)) {
+      return 1;
+    }
+    uint64_t slice = limit - done < RUN_SLICE ? limit - done : RUN_SLICE;
+    snprintf(count, sizeof(count), "%llu",
+             (unsigned long long) (pipeline ? done + slice : slice));
+    if (APEX_cpu_run(cpu, functionality, count) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Runs a job and sends back its result, unless its client has gone
+ * @param job
+ * @return 0 on success, 1 if cancelled, -1 on error
+ */
+static int run_job(const Sim_Job *job) {
+  if (is_cancelled(job->connection)) {
+    return 1;
+  }
+
+  int hit = 0;
+  Cached_Program *program = acquire_program(job->filename, &hit);
+  if (!program) {
+    send_result(job, NULL, "unable to load input file", 0, 0);
+    return -1;
+  }
+
+  APEX_CPU *cpu = APEX_cpu_clone(program->cpu);
+  const char *error = NULL;
+  if (!cpu) {
+    error = "out of memory";
+  } else if (job->data_memory &&
+             APEX_cpu_set_data_memory_size(cpu, (int) job->data_memory) != 0) {
+    error = "out of memory";
+  } else {
+    cpu->config.data_forwarding = !job->no_forwarding;
+    if (job->mul_latency) {
+      cpu->config.mul_latency = (int) job->mul_latency;
+    }
+  }
+
+  double seconds = 0;
+  int cancelled = 0;
+  if (!error) {
+    uint64_t limit = job->cycles && job->cycles < max_cycles ? job->cycles
+                                                            : max_cycles;
+    double start = now_seconds();
+    int status = run_sliced(cpu, job, limit);
+    if (status < 0) {
+      error = "run failed";
+    }
+    cancelled = status > 0;
+    seconds = now_seconds() - start;
+  }
+  if (!cancelled) {
+    send_result(job, error ? NULL : cpu, error, hit, seconds);
+  }
+
+  if (cpu) {
+    APEX_cpu_stop(cpu);
+  }
+  release_program(program);
+  return cancelled ? 1 : error ? -1 : 0;
+}
+
+/**
+ * Marks a job of a connection done, waking its thread if it waits for
+ * the last one
+ * @param connection
+ */
+static void finish_job(Connection *connection) {
+  pthread_mutex_lock(&connection->lock);
+  if (--connection->pending == 0 && connection->closing) {
+    pthread_cond_signal(&connection->idle);
+  }
+  pthread_mutex_unlock(&connection->lock);
+}
+
+static void free_job(Sim_Job *job) {
+  free(job->filename);
+  free(job->functionality);
+  free(job);
+}
+
+/**
+ * Worker thread: runs queued jobs for as long as the server runs
+ * @param arg unused
+ * @return
+ */
+static void *worker(void *arg) {
+  (void) arg;
+  while (1) {
+    pthread_mutex_lock(&queue.lock);
+    while (!queue.head) {
+      pthread_cond_wait(&queue.ready, &queue.lock);
+    }
+    Sim_Job *job = queue.head;
+    queue.head = job->next;
+    if (!queue.head) {
+      queue.tail = NULL;
+    }
+    pthread_mutex_unlock(&queue.lock);
+
+    int status = run_job(job);
+
+    pthread_mutex_lock(&queue.lock);
+    if (status > 0) {
+      queue.cancelled++;
+    } else {
+      queue.done++;
+      queue.failed += status < 0;
+    }
+    pthread_mutex_unlock(&queue.lock);
+
+    finish_job(job->connection);
+    free_job(job);
+  }
+  return NULL;
+}
+
+static void enqueue_job(Sim_Job *job) {
+  pthread_mutex_lock(&job->connection->lock);
+  job->connection->pending++;
+  pthread_mutex_unlock(&job->connection->lock);
+
+  pthread_mutex_lock(&queue.lock);
+  if (queue.tail) {
+    queue.tail->next = job;
+  } else {
+    queue.head = job;
+  }
+  queue.tail = job;
+  queue.queued++;
+  pthread_cond_signal(&queue.ready);
+  pthread_mutex_unlock(&queue.lock);
+}
+
+/**
+ * Reads the value of a "--name=N" option
+ * @return 1 if word is that option with a valid value, 0 if it is not
+ * that option, -1 if its value is bad
+ */
+static int parse_count_option(const char *word, const char *name,
+                              uint64_t *value) {
+  size_t len = strlen(name);
+  if (strncmp(word, name, len) != 0) {
+    return 0;
+  }
+  char *end;
+  *value = strtoull(word + len, &end, 10);
+  return end == word + len || *end != '\0' ? -1 : 1;
+}
+
+/**
+ * Fills in a job from a request line
+ * @param job
+ * @param line
+ * @param parsed set to 1 if the line holds a job, 0 if it is blank
+ * @return NULL, or an error message if the line is malformed
+ */
+static const char *parse_job(Sim_Job *job, char *line, int *parsed) {
+  const char *positional[3] = {NULL, "display", "0"};
+  int num_positional = 0;
+  char *save;
+
+  *parsed = 0;
+  for (char *word = strtok_r(line, " \t\r\n", &save); word;
+       word = strtok_r(NULL, " \t\r\n", &save)) {
+    int option;
+    if (strcmp(word, "--no-forwarding") == 0) {
+      job->no_forwarding = 1;
+    } else if ((option = parse_count_option(word, "--mul-latency=",
+                                            &job->mul_latency)) != 0) {
+      if (option < 0 || job->mul_latency < 1 || job->mul_latency > 256) {
+        return "bad --mul-latency";
+      }
+    } else if ((option = parse_count_option(word, "--data-memory=",
+                                            &job->data_memory)) != 0) {
+      if (option < 0 || job->data_memory == 0 || job->data_memory > 0x40000000 ||
+          (job->data_memory & (job->data_memory - 1)) != 0) {
+        return "data memory size must be a power of 2";
+      }
+    } else if (strncmp(word, "--", 2) == 0 || num_positional == 3) {
+      return "bad request";
+    } else {
+      positional[num_positional++] = word;
+    }
+  }
+  if (num_positional == 0) {
+    return NULL;
+  }
+
+  int known = 0;
+  for (size_t i = 0; i < sizeof(functionalities) / sizeof(*functionalities); ++i) {
+    known |= strcmp(positional[1], functionalities[i]) == 0;
+  }
+  if (!known) {
+    return "unknown functionality";
+  }
+  char *end;
+  job->cycles = strtoull(positional[2], &end, 10);
+  if (end == positional[2] || *end != '\0' || positional[2][0] == '-') {
+    return "bad cycles";
+  }
+  job->filename = strdup(positional[0]);
+  job->functionality = strdup(positional[1]);
+  *parsed = job->filename && job->functionality;
+  return *parsed ? NULL : "out of memory";
+}
+
+/**
+ * Sends the counts of the server
+ * @param connection
+ */
+static void send_stats(Connection *connection) {
+  pthread_mutex_lock(&queue.lock);
+  uint64_t queued = queue.queued, done = queue.done, failed = queue.failed;
+  uint64_t cancelled = queue.cancelled;
+  pthread_mutex_unlock(&queue.lock);
+
+  pthread_mutex_lock(&cache.lock);
+  int programs = 0;
+  for (int i = 0; i < cache.size; ++i) {
+    programs += cache.programs[i] != NULL;
+  }
+  uint64_t hits = cache.hits, misses = cache.misses;
+  pthread_mutex_unlock(&cache.lock);
+
+  char buffer[512];
+  int length = snprintf(buffer, sizeof(buffer), "{\"stats\": {\"jobs\": %llu, "
+                        "\"done\": %llu, \"failed\": %llu, \"cancelled\": %llu, "
+                        "\"programs_cached\": %d, \"cache_hits\": %llu, "
+                        "\"cache_misses\": %llu}}\n",
+                        (unsigned long long) queued, (unsigned long long) done,
+                        (unsigned long long) failed,
+                        (unsigned long long) cancelled, programs,
+                        (unsigned long long) hits, (unsigned long long) misses);
+  pthread_mutex_lock(&connection->lock);
+  send_all(connection->fd, buffer, length);
+  pthread_mutex_unlock(&connection->lock);
+}
+
+/**
+ * Sends an error for a request that is not run
+ * @param connection
+ * @param id
+ * @param error
+ */
+static void send_request_error(Connection *connection, int id, const char *error) {
+  char buffer[256];
+  int length = snprintf(buffer, sizeof(buffer), "{\"id\": %d, \"status\": "
+                        "\"error\", \"error\": \"%s\"}\n", id, error);
+  pthread_mutex_lock(&connection->lock);
+  send_all(connection->fd, buffer, length);
+  pthread_mutex_unlock(&connection->lock);
+}
+
+/**
+ * Whether the client of a connection has closed it, rather than only
+ * shut it down for writing
+ * @param fd
+ * @return
+ */
+static int client_gone(int fd) {
+  struct pollfd hangup = {fd, 0, 0};
+  return poll(&hangup, 1, 0) > 0 && (hangup.revents & (POLLHUP | POLLERR));
+}
+
+/**
+ * Connection thread: reads the requests of a client and queues them,
+ * then waits for their results to be sent before closing. Should the
+ * client close the connection first, its jobs are cancelled.
+ * @param arg the Connection
+ * @return
+ */
+static void *serve_connection(void *arg) {
+  Connection *connection = arg;
+  FILE *in = fdopen(dup(connection->fd), "r");
+  char line[MAX_LINE_LENGTH];
+  int id = 0;
+
+  while (in && fgets(line, sizeof(line), in)) {
+    if (strcmp(line, "STATS\n") == 0 || strcmp(line, "STATS") == 0) {
+      send_stats(connection);
+      continue;
+    }
+    if (!strchr(line, '\n') && !feof(in)) {
+      /** Skip the rest of an overlong line */
+      int c;
+      while ((c = fgetc(in)) != EOF && c != '\n') {
+      }
+      send_request_error(connection, id++, "request too long");
+      continue;
+    }
+    Sim_Job *job = calloc(1, sizeof(*job));
+    if (!job) {
+      send_request_error(connection, id++, "out of memory");
+      continue;
+    }
+    int parsed;
+    const char *error = parse_job(job, line, &parsed);
+    if (error || !parsed) {
+      if (error) {
+        send_request_error(connection, id++, error);
+      }
+      free_job(job);
+      continue;
+    }
+    job->connection = connection;
+    job->id = id++;
+    enqueue_job(job);
+  }
+  if (in) {
+    fclose(in);
+  }
+
+  pthread_mutex_lock(&connection->lock);
+  connection->closing = 1;
+  while (connection->pending > 0) {
+    if (client_gone(connection->fd)) {
+      connection->cancelled = 1;
+    }
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += HANGUP_POLL_MS * 1000000L;
+    if (until.tv_nsec >= 1000000000L) {
+      until.tv_sec++;
+      until.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&connection->idle, &connection->lock, &until);
+  }
+  pthread_mutex_unlock(&connection->lock);
+
+  close(connection->fd);
+  pthread_mutex_destroy(&connection->lock);
+  pthread_cond_destroy(&connection->idle);
+  free(connection);
+  return NULL;
+}
+
+static void remove_socket(int signal_number) {
+  (void) signal_number;
+  unlink(socket_path);
+  _exit(0);
+}
+
+/**
+ * Binds the listening socket, replacing a stale one left by a server
+ * that did not exit cleanly
+ * @param path
+ * @return socket, or -1 on error
+ */
+static int listen_on(const char *path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "APEX_Error : Socket path %s is too long\n", path);
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (bind(fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+    if (errno != EADDRINUSE) {
+      close(fd);
+      return -1;
+    }
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    int live = probe >= 0 &&
+               connect(probe, (struct sockaddr *) &address, sizeof(address)) == 0;
+    if (probe >= 0) {
+      close(probe);
+    }
+    if (live) {
+      fprintf(stderr, "APEX_Error : A server is already listening on %s\n", path);
+      close(fd);
+      return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+      close(fd);
+      return -1;
+    }
+  }
+  if (listen(fd, 64) != 0) {
+    close(fd);
+    unlink(path);
+    return -1;
+  }
+  return fd;
+}
+
+int main(int argc, char const *argv[]) {
+  const char *path = DEFAULT_SOCKET_PATH;
+  int threads = 0;
+  int cached = DEFAULT_CACHED_PROGRAMS;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--socket=", 9) == 0) {
+      path = argv[i] + 9;
+    } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+      threads = atoi(argv[i] + 10);
+    } else if (strncmp(argv[i], "--cache=", 8) == 0) {
+      cached = atoi(argv[i] + 8);
+    } else if (strncmp(argv[i], "--max-cycles=", 13) == 0) {
+      char *end;
+      max_cycles = strtoull(argv[i] + 13, &end, 10);
+      if (end == argv[i] + 13 || *end != '\0' || max_cycles == 0 ||
+          max_cycles > INT_MAX) {
+        fprintf(stderr, "APEX_Error : --max-cycles must be 1 to %d\n", INT_MAX);
+        exit(1);
+      }
+    } else {
+      fprintf(stderr, "APEX_Help : Usage %s [--socket=PATH] [--threads=N] "
+              "[--cache=PROGRAMS] [--max-cycles=N]\n", argv[0]);
+      exit(1);
+    }
+  }
+  if (threads <= 0) {
+    threads = thread_pool_default_size();
+  }
+  if (cached < 1) {
+    cached = 1;
+  }
+
+  cache.programs = calloc(cached, sizeof(*cache.programs));
+  cache.size = cached;
+  if (!cache.programs) {
+    fprintf(stderr, "APEX_Error : Out of memory\n");
+    exit(1);
+  }
+
+  int listener = listen_on(path);
+  if (listener < 0) {
+    fprintf(stderr, "APEX_Error : Unable to listen on %s\n", path);
+    exit(1);
+  }
+  snprintf(socket_path, sizeof(socket_path), "%s", path);
+  signal(SIGINT, remove_socket);
+  signal(SIGTERM, remove_socket);
+  signal(SIGPIPE, SIG_IGN);
+
+  for (int i = 0; i < threads; ++i) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, worker, NULL) != 0) {
+      fprintf(stderr, "APEX_Error : Unable to start threads\n");
+      unlink(path);
+      exit(1);
+    }
+    pthread_detach(thread);
+  }
+  fprintf(stderr, "APEX_SIMD : Listening on %s with %d threads\n", path, threads);
+
+  while (1) {
+    int fd = accept(listener, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      fprintf(stderr, "APEX_Error : accept failed: %s\n", strerror(errno));
+      break;
+    }
+    Connection *connection = calloc(1, sizeof(*connection));
+    pthread_t thread;
+    if (!connection) {
+      close(fd);
+      continue;
+    }
+    connection->fd = fd;
+    pthread_mutex_init(&connection->lock, NULL);
+    pthread_cond_init(&connection->idle, NULL);
+    if (pthread_create(&thread, NULL, serve_connection, connection) != 0) {
+      close(fd);
+      free(connection);
+      continue;
+    }
+    pthread_detach(thread);
+  }
+  unlink(path);
+  return 1;
+}
@@ -0,0 +1,239 @@
+/*
+ *  apex_sweep.c
+ *  Runs one program on the pipeline under every combination of the
+ *  given configuration values, spread over a thread pool, and prints a
+ *  CPI table with one line per configuration:
+ *     <forwarding> <mul_latency> <data_memory> <status> <cycles>
+ *     <instructions> <CPI>
+ *  The program is loaded once; every configuration runs on a clone of
+ *  that CPU. status is "complete", "stopped" (at the cycle limit),
+ *  "deadlock" (nothing retired for STALL_CYCLES cycles) or "error".
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cpu.h"
+#include "thread_pool.h"
+
+/* Most values one option takes */
+#define MAX_VALUES 64
+
+/* Cycles without a retired instruction after which a run is given up */
+#define STALL_CYCLES 10000
+
+/* Values of one swept parameter */
+typedef struct Sweep_Values {
+    int values[MAX_VALUES];
+    int count;
+} Sweep_Values;
+
+/* One configuration and its outcome */
+typedef struct Sweep_Point {
+    int data_forwarding;
+    int mul_latency;
+    int data_memory_size;
+
+    int status;               // -2 error, -1 deadlock, 0 stopped, 1 complete
+    int clock;
+    uint64_t instructions;
+} Sweep_Point;
+
+/* Shared by the sweep tasks */
+typedef struct Sweep_Job {
+    const APEX_CPU *cpu;      // Freshly loaded program, cloned by every task
+    Sweep_Point *points;
+    int max_cycles;
+} Sweep_Job;
+
+/**
+ * Runs the pipeline of one configuration as the simulate functionality
+ * would, with output off
+ * @param arg
+ * @param index
+ */
+static void run_point(void *arg, int index) {
+  Sweep_Job *job = arg;
+  Sweep_Point *point = &job->points[index];
+  APEX_CPU *cpu = APEX_cpu_clone(job->cpu);
+  if (!cpu || APEX_cpu_set_data_memory_size(cpu, point->data_memory_size) != 0) {
+    point->status = -2;
+    if (cpu) {
+      APEX_cpu_stop(cpu);
+    }
+    return;
+  }
+  cpu->config.out = NULL;
+  cpu->config.data_forwarding = point->data_forwarding;
+  cpu->config.mul_latency = point->mul_latency;
+
+  uint64_t retired = cpu->ins_retired;
+  int last_retired_clock = cpu->clock;
+  point->status = 1;
+  while (cpu->ins_completed != cpu->code_memory_size) {
+    if (job->max_cycles && cpu->clock == job->max_cycles) {
+      point->status = 0;
+      break;
+    }
+    if (cpu->clock - last_retired_clock >= STALL_CYCLES) {
+      point->status = -1;
+      break;
+    }
+    APEX_cpu_cycle(cpu);
+    if (cpu->ins_retired != retired) {
+      retired = cpu->ins_retired;
+      last_retired_clock = cpu->clock;
+    }
+  }
+  point->clock = cpu->clock;
+  point->instructions = cpu->ins_retired;
+  APEX_cpu_stop(cpu);
+}
+
+/**
+ * Reads a comma separated list of values of an option
+ * @param arg the whole argument
+ * @param name option name up to and including '='
+ * @param min smallest value accepted
+ * @param max largest value accepted
+ * @param values
+ * @return 1 if arg is that option, 0 if not; exits on a bad value
+ */
+static int parse_values(const char *arg, const char *name, int min, int max,
+                        Sweep_Values *values) {
+  size_t len = strlen(name);
+  if (strncmp(arg, name, len) != 0) {
+    return 0;
+  }
+  values->count = 0;
+  const char *p = arg + len;
+  while (1) {
+    char *end;
+    long value = strtol(p, &end, 10);
+    if (end == p || value < min || value > max || values->count == MAX_VALUES ||
+        (*end != ',' && *end != '\0')) {
+      fprintf(stderr, "APEX_Error : Bad value in %s\n", arg);
+      exit(1);
+    }
+    values->values[values->count++] = (int) value;
+    if (*end == '\0') {
+      return 1;
+    }
+    p = end + 1;
+  }
+}
+
+static const char *status_name(int status) {
+  switch (status) {
+    case 1:
+      return "complete";
+    case 0:
+      return "stopped";
+    case -1:
+      return "deadlock";
+    default:
+      return "error";
+  }
+}
+
+int main(int argc, char const *argv[]) {
+  const char *filename = NULL;
+  int max_cycles = 0;
+  int threads = 0;
+  Sweep_Values forwarding = {{1, 0}, 2};
+  Sweep_Values mul_latency = {{1, 2, 3, 4}, 4};
+  Sweep_Values data_memory = {{DATA_MEMORY_SIZE}, 1};
+  int bad_usage = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (parse_values(argv[i], "--forwarding=", 0, 1, &forwarding) ||
+        parse_values(argv[i], "--mul-latency=", 1, 256, &mul_latency) ||
+        parse_values(argv[i], "--data-memory=", 1, 0x40000000, &data_memory)) {
+      continue;
+    }
+    if (strncmp(argv[i], "--threads=", 10) == 0) {
+      threads = atoi(argv[i] + 10);
+    } else if (strncmp(argv[i], "--", 2) == 0) {
+      bad_usage = 1;
+    } else if (!filename) {
+      filename = argv[i];
+    } else if (!max_cycles) {
+      max_cycles = atoi(argv[i]);
+    } else {
+      bad_usage = 1;
+    }
+  }
+  if (!filename || bad_usage) {
+    fprintf(stderr, "APEX_Help : Usage %s <input_file> [<cycles>] "
+            "[--forwarding=1,0] [--mul-latency=1,2,3,4] [--data-memory=4096] "
+            "[--threads=N]\n", argv[0]);
+    exit(1);
+  }
+  for (int i = 0; i < data_memory.count; ++i) {
+    int words = data_memory.values[i];
+    if ((words & (words - 1)) != 0) {
+      fprintf(stderr, "APEX_Error : Data memory size %d is not a power of 2\n",
+              words);
+      exit(1);
+    }
+  }
+
+  APEX_CPU *cpu = APEX_cpu_init(filename);
+  if (!cpu) {
+    fprintf(stderr, "APEX_Error : Unable to initialize CPU\n");
+    exit(1);
+  }
+
+  int num_points = forwarding.count * mul_latency.count * data_memory.count;
+  Sweep_Point *points = calloc(num_points, sizeof(*points));
+  if (!points) {
+    fprintf(stderr, "APEX_Error : Out of memory\n");
+    exit(1);
+  }
+  int n = 0;
+  for (int f = 0; f < forwarding.count; ++f) {
+    for (int m = 0; m < mul_latency.count; ++m) {
+      for (int d = 0; d < data_memory.count; ++d) {
+        points[n].data_forwarding = forwarding.values[f];
+        points[n].mul_latency = mul_latency.values[m];
+        points[n].data_memory_size = data_memory.values[d];
+        n++;
+      }
+    }
+  }
+
+  Thread_Pool *pool = thread_pool_create(threads > 0 ? threads
+                                                     : thread_pool_default_size());
+  if (!pool) {
+    fprintf(stderr, "APEX_Error : Unable to start threads\n");
+    exit(1);
+  }
+
+  Sweep_Job job = {cpu, points, max_cycles};
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  thread_pool_run(pool, run_point, &job, num_points);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+  int failed = 0;
+  printf("# forwarding mul_latency data_memory status cycles instructions CPI\n");
+  for (int i = 0; i < num_points; ++i) {
+    Sweep_Point *point = &points[i];
+    failed += point->status == -2;
+    printf("%d %d %d %s %d %llu %.4f\n", point->data_forwarding,
+           point->mul_latency, point->data_memory_size,
+           status_name(point->status), point->clock,
+           (unsigned long long) point->instructions,
+           point->instructions ? (double) point->clock / point->instructions
+                               : 0.0);
+  }
+
+  fprintf(stderr, "APEX_SWEEP : %d configurations (%d failed) on %d threads "
+          "in %.3f s\n", num_points, failed, thread_pool_size(pool), seconds);
+  thread_pool_destroy(pool);
+  free(points);
+  APEX_cpu_stop(cpu);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+/*
+ *  apex_trace.c
+ *  Renders a trace written by apex_sim --trace=FILE as the text the
+ *  display functionality prints for the same run. With --stalls each
+ *  cycle also gets a line naming the stages stalled and flushing at
+ *  its end. A corrupt record, e.g. with an opcode or register out of
+ *  range, ends the rendering with an error.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+/* Size of the stdio buffers of the trace and the output */
+#define READ_BUFFER_SIZE (1 << 20)
+
+/**
+ * Prints the stages whose bit is set
+ * @param out
+ * @param label
+ * @param bits
+ */
+static void print_stage_bits(FILE *out, const char *label, unsigned int bits) {
+  static const char *names[NUM_STAGES] = {"F", "DRF", "EX", "MEM", "WB"};
+  fprintf(out, "%s:", label);
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    if (bits & (1u << i)) {
+      fprintf(out, " %s", names[i]);
+    }
+  }
+}
+
+/**
+ * Gives up on a trace with a corrupt record, as on a corrupt program
+ * image. The cycles before it have been printed.
+ * @param filename
+ * @param index number of the record, from 1
+ */
+static void bad_record(const char *filename, uint64_t index) {
+  fflush(stdout);
+  fprintf(stderr, "APEX_Error : %s: Bad record %llu in trace\n", filename,
+          (unsigned long long) index);
+  exit(1);
+}
+
+int main(int argc, char const *argv[]) {
+  const char *filename = NULL;
+  int showStalls = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--stalls") == 0) {
+      showStalls = 1;
+    } else if (!filename && strncmp(argv[i], "--", 2) != 0) {
+      filename = argv[i];
+    } else {
+      filename = NULL;
+      break;
+    }
+  }
+  if (!filename) {
+    fprintf(stderr, "APEX_Help : Usage %s <trace file> [--stalls]\n", argv[0]);
+    exit(1);
+  }
+
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    fprintf(stderr, "APEX_Error : Unable to open trace %s\n", filename);
+    exit(1);
+  }
+  setvbuf(fp, NULL, _IOFBF, READ_BUFFER_SIZE);
+  setvbuf(stdout, NULL, _IOFBF, READ_BUFFER_SIZE);
+
+  APEX_Trace_Header header;
+  if (fread(&header, sizeof(header), 1, fp) != 1 ||
+      memcmp(header.magic, APEX_TRACE_MAGIC, sizeof(APEX_TRACE_MAGIC)) != 0 ||
+      header.version != APEX_TRACE_VERSION ||
+      header.byte_order != APEX_TRACE_BYTE_ORDER ||
+      header.record_size != sizeof(APEX_Trace_Record) ||
+      header.end_size != sizeof(APEX_Trace_End)) {
+    fprintf(stderr, "APEX_Error : %s is not a trace of this simulator "
+            "version\n", filename);
+    exit(1);
+  }
+
+  APEX_Trace_Record record;
+  uint64_t records = 0;
+  while (fread(&record, sizeof(record), 1, fp) == 1) {
+    ++records;
+    if (!valid_trace_record(&record)) {
+      bad_record(filename, records);
+    }
+    if (record.kind == TRACE_END) {
+      APEX_Trace_End end;
+      if (fread(&end, sizeof(end), 1, fp) != 1) {
+        break;
+      }
+      if (!valid_trace_end(&end)) {
+        bad_record(filename, records);
+      }
+      print_trace_end(stdout, &end);
+      fclose(fp);
+      return 0;
+    }
+    print_trace_record(stdout, &record);
+    if (showStalls) {
+      print_stage_bits(stdout, "Stalled", record.stalled);
+      print_stage_bits(stdout, "  Flushing", record.flushed);
+      fprintf(stdout, "\n");
+    }
+  }
+  fclose(fp);
+  fflush(stdout);
+  fprintf(stderr, "APEX_Error : %s ends early, the run that wrote it did not "
+          "finish\n", filename);
+  return 1;
+}
@@ -0,0 +1,60 @@
+/*
+ *  parse_bench.c
+ *  Measures how program loading scales with the number of parser
+ *  threads. Usage: apex_parse_bench <input_file> [max_threads] [runs]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cpu.h"
+#include "../thread_pool.h"
+
+int main(int argc, char const *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "APEX_Help : Usage %s <input_file> [max_threads] [runs]\n",
+            argv[0]);
+    exit(1);
+  }
+
+  int max_threads = argc > 2 ? atoi(argv[2]) : thread_pool_default_size();
+  int runs = argc > 3 ? atoi(argv[3]) : 3;
+
+  int reference_size = 0;
+  APEX_Instruction *reference =
+      load_code_memory_threads(argv[1], &reference_size, NULL, 1);
+  if (!reference) {
+    fprintf(stderr, "APEX_Error : Unable to load %s\n", argv[1]);
+    exit(1);
+  }
+
+  double single_thread_seconds = 0;
+  printf("%-8s %-12s %-10s %-8s\n", "threads", "best_ms", "MB/s", "speedup");
+  for (int threads = 1; threads <= max_threads; ++threads) {
+    APEX_Load_Stats best = {0, 0};
+    for (int run = 0; run < runs; ++run) {
+      APEX_Load_Stats stats;
+      int size = 0;
+      APEX_Instruction *code_memory =
+          load_code_memory_threads(argv[1], &size, &stats, threads);
+      if (!code_memory || size != reference_size ||
+          memcmp(code_memory, reference, sizeof(*reference) * size) != 0) {
+        fprintf(stderr, "APEX_Error : %d thread load differs from 1 thread\n",
+                threads);
+        exit(1);
+      }
+      free(code_memory);
+      if (run == 0 || stats.seconds < best.seconds) {
+        best = stats;
+      }
+    }
+    if (threads == 1) {
+      single_thread_seconds = best.seconds;
+    }
+    printf("%-8d %-12.3f %-10.1f %-8.2f\n", threads, best.seconds * 1e3,
+           best.bytes / best.seconds / 1e6, single_thread_seconds / best.seconds);
+  }
+
+  free(reference);
+  return 0;
+}
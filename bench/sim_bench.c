@@ -0,0 +1,321 @@
+/*
+ *  sim_bench.c
+ *  Runs the benchmark suite: generates each workload, runs the pipeline
+ *  on it for a fixed number of cycles and reports the host speed, load
+ *  time and peak memory. Each workload runs in a child process of its
+ *  own, so that its peak memory is its own.
+ *
+ *  With --save=FILE the results are written as a baseline; with
+ *  --baseline=FILE they are compared against one, and any workload that
+ *  got slower or bigger by more than the tolerance is flagged and the
+ *  exit status is 1.
+ *  Usage: apex_sim_bench [--dir=DIR] [--runs=N] [--only=NAME]
+ *         [--save=FILE] [--baseline=FILE] [--tolerance=PERCENT]
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../cpu.h"
+#include "workloads.h"
+
+/* Changes under this many milliseconds of load time are noise */
+#define LOAD_NOISE_MS 2.0
+
+/* Result of one workload */
+typedef struct Bench_Result {
+  char name[32];
+  uint64_t cycles;           // Cycles simulated per run
+  uint64_t instructions;     // Instructions retired per run
+  double seconds;            // Best host time of a run
+  double load_ms;            // Best time to load the program
+  long peak_rss_kib;         // Peak resident memory of the process
+} Bench_Result;
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cycles_per_second(const Bench_Result *result) {
+  return result->seconds > 0 ? result->cycles / result->seconds : 0;
+}
+
+static double mips(const Bench_Result *result) {
+  return result->seconds > 0 ? result->instructions / result->seconds / 1e6 : 0;
+}
+
+/**
+ * Runs a workload runs times in this process
+ * @param workload
+ * @param filename its program
+ * @param runs
+ * @param result
+ * @return 0 on success, -1 on error
+ */
+static int run_workload(const Workload *workload, const char *filename,
+                        int runs, Bench_Result *result) {
+  char cycles[32];
+  snprintf(cycles, sizeof(cycles), "%llu", (unsigned long long) workload->cycles);
+  memset(result, 0, sizeof(*result));
+  snprintf(result->name, sizeof(result->name), "%s", workload->name);
+
+  for (int run = 0; run < runs; ++run) {
+    APEX_CPU *cpu = APEX_cpu_init(filename);
+    if (!cpu) {
+      return -1;
+    }
+    cpu->config.out = NULL;
+
+    double start = now_seconds();
+    APEX_cpu_run(cpu, "simulate", cycles);
+    double seconds = now_seconds() - start;
+    double load_ms = cpu->load_stats.seconds * 1e3;
+
+    if (run == 0 || seconds < result->seconds) {
+      result->seconds = seconds;
+    }
+    if (run == 0 || load_ms < result->load_ms) {
+      result->load_ms = load_ms;
+    }
+    result->cycles = cpu->clock;
+    result->instructions = cpu->ins_retired;
+    APEX_cpu_stop(cpu);
+  }
+
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    result->peak_rss_kib = usage.ru_maxrss;
+  }
+  return 0;
+}
+
+/**
+ * Runs a workload in a child process
+ * @return 0 on success, -1 on error
+ */
+static int run_workload_child(const Workload *workload, const char *filename,
+                              int runs, Bench_Result *result) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return -1;
+  }
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    Bench_Result child;
+    int status = run_workload(workload, filename, runs, &child);
+    if (status == 0 && write(fds[1], &child, sizeof(child)) != sizeof(child)) {
+      status = -1;
+    }
+    _exit(status == 0 ? 0 : 1);
+  }
+
+  close(fds[1]);
+  ssize_t got = read(fds[0], result, sizeof(*result));
+  close(fds[0]);
+  int status;
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+  }
+  return got == sizeof(*result) && WIFEXITED(status) &&
+         WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+/**
+ * Reads a baseline written by --save
+ * @param filename
+ * @param results
+ * @param max
+ * @return number of results read, or -1 if there is no baseline
+ */
+static int read_baseline(const char *filename, Bench_Result *results, int max) {
+  FILE *fp = fopen(filename, "r");
+  if (!fp) {
+    return -1;
+  }
+  char line[256];
+  int count = 0;
+  while (count < max && fgets(line, sizeof(line), fp)) {
+    if (line[0] == '#') {
+      continue;
+    }
+    Bench_Result *result = &results[count];
+    unsigned long long cycles, instructions;
+    if (sscanf(line, "%31s %llu %llu %lf %lf %ld", result->name, &cycles,
+               &instructions, &result->seconds, &result->load_ms,
+               &result->peak_rss_kib) == 6) {
+      result->cycles = cycles;
+      result->instructions = instructions;
+      count++;
+    }
+  }
+  fclose(fp);
+  return count;
+}
+
+/**
+ * Writes the results as a baseline
+ * @return 0 on success, -1 on error
+ */
+static int write_baseline(const char *filename, const Bench_Result *results,
+                          int count) {
+  FILE *fp = fopen(filename, "w");
+  if (!fp) {
+    return -1;
+  }
+  fprintf(fp, "# name cycles instructions seconds load_ms peak_rss_kib\n");
+  for (int i = 0; i < count; ++i) {
+    fprintf(fp, "%s %llu %llu %.6f %.3f %ld\n", results[i].name,
+            (unsigned long long) results[i].cycles,
+            (unsigned long long) results[i].instructions, results[i].seconds,
+            results[i].load_ms, results[i].peak_rss_kib);
+  }
+  return fclose(fp) == 0 ? 0 : -1;
+}
+
+/**
+ * Compares a result with its baseline, printing what got worse
+ * @param result
+ * @param base
+ * @param tolerance allowed change, as a fraction
+ * @return number of regressions
+ */
+static int compare_result(const Bench_Result *result, const Bench_Result *base,
+                          double tolerance) {
+  int regressions = 0;
+  if (result->cycles != base->cycles || result->instructions != base->instructions) {
+    printf("  %s: ran %llu cycles, %llu instructions; baseline ran %llu, %llu\n",
+           result->name, (unsigned long long) result->cycles,
+           (unsigned long long) result->instructions,
+           (unsigned long long) base->cycles,
+           (unsigned long long) base->instructions);
+  }
+  double speed = cycles_per_second(result);
+  double base_speed = cycles_per_second(base);
+  if (speed < base_speed * (1 - tolerance)) {
+    printf("  REGRESSION %s: %.0f cycles/s, baseline %.0f (%+.1f%%)\n",
+           result->name, speed, base_speed, 100 * (speed / base_speed - 1));
+    regressions++;
+  }
+  if (result->load_ms > base->load_ms * (1 + tolerance) &&
+      result->load_ms - base->load_ms > LOAD_NOISE_MS) {
+    printf("  REGRESSION %s: load %.3f ms, baseline %.3f ms\n", result->name,
+           result->load_ms, base->load_ms);
+    regressions++;
+  }
+  if (result->peak_rss_kib > base->peak_rss_kib * (1 + tolerance)) {
+    printf("  REGRESSION %s: peak RSS %ld KiB, baseline %ld KiB\n",
+           result->name, result->peak_rss_kib, base->peak_rss_kib);
+    regressions++;
+  }
+  return regressions;
+}
+
+int main(int argc, char const *argv[]) {
+  const char *dir = "bench/work";
+  const char *only = NULL;
+  const char *save = NULL;
+  const char *baseline = NULL;
+  int runs = 5;
+  double tolerance = 0.10;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--dir=", 6) == 0) {
+      dir = argv[i] + 6;
+    } else if (strncmp(argv[i], "--runs=", 7) == 0) {
+      runs = atoi(argv[i] + 7);
+    } else if (strncmp(argv[i], "--only=", 7) == 0) {
+      only = argv[i] + 7;
+    } else if (strncmp(argv[i], "--save=", 7) == 0) {
+      save = argv[i] + 7;
+    } else if (strncmp(argv[i], "--baseline=", 11) == 0) {
+      baseline = argv[i] + 11;
+    } else if (strncmp(argv[i], "--tolerance=", 12) == 0) {
+      tolerance = atof(argv[i] + 12) / 100;
+    } else {
+      fprintf(stderr, "APEX_Help : Usage %s [--dir=DIR] [--runs=N] [--only=NAME] "
+              "[--save=FILE] [--baseline=FILE] [--tolerance=PERCENT]\n", argv[0]);
+      exit(1);
+    }
+  }
+  if (runs < 1 || (only && !find_workload(only))) {
+    fprintf(stderr, "APEX_Error : Bad --runs or unknown workload in --only\n");
+    exit(1);
+  }
+  if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+    fprintf(stderr, "APEX_Error : Unable to create %s\n", dir);
+    exit(1);
+  }
+
+  Bench_Result results[num_workloads];
+  int count = 0;
+  printf("%-14s %10s %12s %10s %10s %8s %10s %12s\n", "workload", "cycles",
+         "instructions", "best_ms", "Mcycles/s", "MIPS", "load_ms",
+         "peak_rss_kib");
+  for (int i = 0; i < num_workloads; ++i) {
+    const Workload *workload = &workloads[i];
+    if (only && strcmp(only, workload->name) != 0) {
+      continue;
+    }
+    char filename[4096];
+    snprintf(filename, sizeof(filename), "%s/%s.asm", dir, workload->name);
+    Bench_Result *result = &results[count];
+    if (generate_workload(workload, filename) != 0 ||
+        run_workload_child(workload, filename, runs, result) != 0) {
+      fprintf(stderr, "APEX_Error : Unable to run workload %s\n", workload->name);
+      exit(1);
+    }
+    printf("%-14s %10llu %12llu %10.3f %10.3f %8.2f %10.3f %12ld\n",
+           result->name, (unsigned long long) result->cycles,
+           (unsigned long long) result->instructions, result->seconds * 1e3,
+           cycles_per_second(result) / 1e6, mips(result), result->load_ms,
+           result->peak_rss_kib);
+    count++;
+  }
+
+  if (save && write_baseline(save, results, count) != 0) {
+    fprintf(stderr, "APEX_Error : Unable to write baseline %s\n", save);
+    exit(1);
+  }
+
+  if (!baseline) {
+    return 0;
+  }
+  Bench_Result base[64];
+  int base_count = read_baseline(baseline, base, 64);
+  if (base_count < 0) {
+    printf("No baseline %s to compare with, \"make bench_baseline\" writes "
+           "one\n", baseline);
+    return 0;
+  }
+  int regressions = 0;
+  printf("Compared with %s, tolerance %.0f%%:\n", baseline, tolerance * 100);
+  for (int i = 0; i < count; ++i) {
+    const Bench_Result *match = NULL;
+    for (int j = 0; j < base_count; ++j) {
+      if (strcmp(base[j].name, results[i].name) == 0) {
+        match = &base[j];
+      }
+    }
+    if (!match) {
+      printf("  %s: not in the baseline\n", results[i].name);
+      continue;
+    }
+    regressions += compare_result(&results[i], match, tolerance);
+  }
+  printf("%d regression%s\n", regressions, regressions == 1 ? "" : "s");
+  return regressions ? 1 : 0;
+}
@@ -0,0 +1,93 @@
+/*
+ *  translate_bench.c
+ *  Compares the plain functional interpreter with the translated
+ *  (block cache, direct threaded) one on the same program.
+ *  Usage: apex_translate_bench <input_file> [max_instructions] [runs]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../block_cache.h"
+#include "../cpu.h"
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Runs the program once from a fresh CPU in the given mode
+ * @return seconds taken, or -1 on error
+ */
+static double run_once(const char *filename, int translated, uint64_t limit,
+                       uint64_t *executed, int *regs, Block_Cache_Stats *stats) {
+  APEX_CPU *cpu = APEX_cpu_init(filename);
+  if (!cpu) {
+    return -1;
+  }
+
+  Block_Cache *cache = translated ? block_cache_create() : NULL;
+  double start = now_seconds();
+  if (translated) {
+    APEX_cpu_run_translated(cpu, cache, limit, executed);
+  } else {
+    APEX_cpu_run_functional(cpu, limit, executed);
+  }
+  double seconds = now_seconds() - start;
+
+  memcpy(regs, cpu->regs, sizeof(cpu->regs));
+  if (cache) {
+    *stats = block_cache_stats(cache);
+    block_cache_destroy(cache);
+  }
+  APEX_cpu_stop(cpu);
+  return seconds;
+}
+
+int main(int argc, char const *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr,
+            "APEX_Help : Usage %s <input_file> [max_instructions] [runs]\n",
+            argv[0]);
+    exit(1);
+  }
+
+  uint64_t limit = argc > 2 ? strtoull(argv[2], NULL, 10) : 0;
+  int runs = argc > 3 ? atoi(argv[3]) : 3;
+  const char *modes[2] = {"interpreted", "translated"};
+  double best[2] = {0, 0};
+  uint64_t executed[2] = {0, 0};
+  int regs[2][32];
+  Block_Cache_Stats stats = {0, 0, 0, 0};
+
+  for (int mode = 0; mode < 2; ++mode) {
+    for (int run = 0; run < runs; ++run) {
+      executed[mode] = 0;
+      double seconds = run_once(argv[1], mode, limit, &executed[mode],
+                                regs[mode], &stats);
+      if (seconds < 0) {
+        fprintf(stderr, "APEX_Error : Unable to initialize CPU\n");
+        exit(1);
+      }
+      if (run == 0 || seconds < best[mode]) {
+        best[mode] = seconds;
+      }
+    }
+    printf("%-12s %12llu instructions %10.3f ms %10.1f MIPS\n", modes[mode],
+           (unsigned long long) executed[mode], best[mode] * 1e3,
+           executed[mode] / best[mode] / 1e6);
+  }
+
+  printf("block cache  %d blocks, %llu hits, %llu misses\n", stats.blocks,
+         (unsigned long long) stats.hits, (unsigned long long) stats.misses);
+  printf("speedup      %.2fx\n", best[0] / best[1]);
+
+  if (executed[0] != executed[1] || memcmp(regs[0], regs[1], sizeof(regs[0])) != 0) {
+    fprintf(stderr, "APEX_Error : translated run differs from interpreted run\n");
+    exit(1);
+  }
+  return 0;
+}
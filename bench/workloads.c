@@ -0,0 +1,181 @@
+/*
+ *  workloads.c
+ *  Contains the generated programs of the benchmark suite. Each one
+ *  stresses one part of the pipeline and loops far longer than it is
+ *  run for, so that every measurement runs its full cycle count.
+ */
+#include <string.h>
+
+#include "workloads.h"
+
+/* Loop count of the looping workloads, never reached in a measurement */
+#define LOOP_COUNT 1000000000
+
+/* Blocks of the jump dispatch workload */
+#define DISPATCH_BLOCKS 64
+
+/* Instructions per dispatch block, the JUMP included */
+#define DISPATCH_BLOCK_SIZE 3
+
+/**
+ * BZ and BNZ both taken every iteration, the BZ skipping one instruction
+ * @param out
+ * @param lines unused
+ * @return
+ */
+static int write_branch_loop(FILE *out, int lines) {
+  (void) lines;
+  fprintf(out, "MOVC,R1,#%d\n", LOOP_COUNT);
+  fprintf(out, "MOVC,R2,#1\n");
+  fprintf(out, "MOVC,R3,#0\n");
+  fprintf(out, "SUB,R1,R1,R2\n");   // 4012, loop
+  fprintf(out, "SUB,R4,R3,R3\n");   // Zero
+  fprintf(out, "BZ,#8\n");
+  fprintf(out, "ADD,R3,R3,R2\n");   // Skipped
+  fprintf(out, "ADD,R5,R1,R0\n");   // Not zero
+  fprintf(out, "BNZ,#-20\n");
+  fprintf(out, "HALT,\n");
+  return 0;
+}
+
+/**
+ * Chain of MULs each waiting on the one before
+ * @param out
+ * @param lines unused
+ * @return
+ */
+static int write_mul_chain(FILE *out, int lines) {
+  (void) lines;
+  fprintf(out, "MOVC,R1,#%d\n", LOOP_COUNT);
+  fprintf(out, "MOVC,R2,#1\n");
+  fprintf(out, "MOVC,R3,#3\n");
+  fprintf(out, "MOVC,R4,#1\n");
+  fprintf(out, "MUL,R4,R4,R3\n");   // 4016, loop
+  fprintf(out, "MUL,R5,R4,R3\n");
+  fprintf(out, "MUL,R6,R5,R4\n");
+  fprintf(out, "MUL,R7,R6,R5\n");
+  fprintf(out, "ADD,R4,R7,R2\n");
+  fprintf(out, "SUB,R1,R1,R2\n");
+  fprintf(out, "BNZ,#-24\n");
+  fprintf(out, "HALT,\n");
+  return 0;
+}
+
+/**
+ * LOADs and STOREs walking through the whole data memory, which
+ * addresses wrap around
+ * @param out
+ * @param lines unused
+ * @return
+ */
+static int write_load_store(FILE *out, int lines) {
+  (void) lines;
+  fprintf(out, "MOVC,R1,#%d\n", LOOP_COUNT);
+  fprintf(out, "MOVC,R2,#1\n");
+  fprintf(out, "MOVC,R3,#0\n");
+  fprintf(out, "LOAD,R4,R3,#0\n");  // 4012, loop
+  fprintf(out, "ADD,R4,R4,R2\n");
+  fprintf(out, "STORE,R4,R3,#1\n");
+  fprintf(out, "LOAD,R5,R3,#2\n");
+  fprintf(out, "STORE,R5,R3,#3\n");
+  fprintf(out, "ADD,R3,R3,R2\n");
+  fprintf(out, "SUB,R1,R1,R2\n");
+  fprintf(out, "BNZ,#-28\n");
+  fprintf(out, "HALT,\n");
+  return 0;
+}
+
+/**
+ * Short blocks ending in a JUMP to another block, visited in a scattered
+ * order that cycles through all of them
+ * @param out
+ * @param lines unused
+ * @return
+ */
+static int write_jump_dispatch(FILE *out, int lines) {
+  (void) lines;
+  /** Block i jumps to block (i * 37 + 11) % 64, one cycle through all */
+  int first = 4000 + 4 * 2;
+  fprintf(out, "MOVC,R2,#1\n");
+  fprintf(out, "JUMP,R0,#%d\n", first);
+  for (int i = 0; i < DISPATCH_BLOCKS; ++i) {
+    int next = (i * 37 + 11) % DISPATCH_BLOCKS;
+    fprintf(out, "ADD,R%d,R%d,R2\n", 3 + i % 8, 3 + i % 8);
+    fprintf(out, "SUB,R11,R%d,R2\n", 3 + (i + 1) % 8);
+    fprintf(out, "JUMP,R0,#%d\n", first + 4 * DISPATCH_BLOCK_SIZE * next);
+  }
+  fprintf(out, "HALT,\n");
+  return 0;
+}
+
+/**
+ * Straight line code of the given size, for load time above all
+ * @param out
+ * @param lines
+ * @return
+ */
+static int write_large_program(FILE *out, int lines) {
+  static const char *ops[] = {"ADD", "SUB", "AND", "OR", "EX-OR", "MUL"};
+  for (int i = 0; i < lines - 1; ++i) {
+    int rd = 1 + i % 15;
+    int rs1 = 1 + (i + 5) % 15;
+    int rs2 = 1 + (i + 11) % 15;
+    switch (i % 8) {
+      case 0:
+        fprintf(out, "MOVC,R%d,#%d\n", rd, i % 4096);
+        break;
+      case 3:
+        fprintf(out, "LOAD,R%d,R%d,#%d\n", rd, rs1, i % 64);
+        break;
+      case 6:
+        fprintf(out, "STORE,R%d,R%d,#%d\n", rd, rs1, i % 64);
+        break;
+      default:
+        fprintf(out, "%s,R%d,R%d,R%d\n", ops[i % 6], rd, rs1, rs2);
+        break;
+    }
+  }
+  fprintf(out, "HALT,\n");
+  return 0;
+}
+
+const Workload workloads[] = {
+  {"branch_loop", "tight loop of taken BZ and BNZ", write_branch_loop, 0,
+   5000000},
+  {"mul_chain", "dependent MULs", write_mul_chain, 0, 5000000},
+  {"load_store", "LOAD/STORE streaming over data memory", write_load_store, 0,
+   5000000},
+  {"jump_dispatch", "JUMPs between 64 scattered blocks", write_jump_dispatch, 0,
+   5000000},
+  {"large_program", "2M lines of straight line code", write_large_program,
+   2000000, 2000000},
+};
+
+const int num_workloads = sizeof(workloads) / sizeof(workloads[0]);
+
+const Workload *find_workload(const char *name) {
+  for (int i = 0; i < num_workloads; ++i) {
+    if (strcmp(workloads[i].name, name) == 0) {
+      return &workloads[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Writes a workload program to a file
+ * @param workload
+ * @param filename
+ * @return 0 on success, -1 on error
+ */
+int generate_workload(const Workload *workload, const char *filename) {
+  FILE *fp = fopen(filename, "w");
+  if (!fp) {
+    return -1;
+  }
+  int result = workload->write(fp, workload->lines);
+  if (fclose(fp) != 0) {
+    result = -1;
+  }
+  return result;
+}
@@ -0,0 +1,27 @@
+#ifndef _APEX_BENCH_WORKLOADS_H_
+#define _APEX_BENCH_WORKLOADS_H_
+/**
+ *  workloads.h
+ *  Contains the generated programs of the benchmark suite
+ */
+#include <stdint.h>
+#include <stdio.h>
+
+/* Benchmark program and how long to run it */
+typedef struct Workload {
+  const char *name;
+  const char *description;
+  int (*write)(FILE *out, int lines);  // Writes the program, 0 on success
+  int lines;                           // Size for generators that take one, else 0
+  uint64_t cycles;                     // Pipeline cycles run per measurement
+} Workload;
+
+extern const Workload workloads[];
+
+extern const int num_workloads;
+
+const Workload *find_workload(const char *name);
+
+int generate_workload(const Workload *workload, const char *filename);
+
+#endif
@@ -0,0 +1,370 @@
+/*
+ *  block_cache.c
+ *  Contains the translated functional mode. Each basic block (a run of
+ *  instructions ending at BZ, BNZ, JUMP or HALT) is translated once
+ *  into an array of handler addresses with operands baked in and then
+ *  executed with direct threading (GNU C labels as values), so
+ *  instructions are not re-decoded every time a loop comes around.
+ *  Semantics are those of APEX_cpu_run_functional.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "block_cache.h"
+
+/* Longest block translated; longer straight-line code is split */
+#define MAX_BLOCK_LENGTH 256
+
+/* Initial number of hash table slots, a power of 2 */
+#define INITIAL_CAPACITY 256
+
+struct Block_Cache {
+  Translated_Block **slots;  // Open addressing table keyed by start_pc
+  int capacity;
+  int blocks;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t invalidations;
+};
+
+static unsigned int hash_pc(int pc) {
+  return ((unsigned int) pc >> 2) * 2654435761u;
+}
+
+/**
+ * Creates an empty cache
+ * @return
+ */
+Block_Cache *block_cache_create(void) {
+  Block_Cache *cache = calloc(1, sizeof(*cache));
+  if (!cache) {
+    return NULL;
+  }
+  cache->slots = calloc(INITIAL_CAPACITY, sizeof(*cache->slots));
+  if (!cache->slots) {
+    free(cache);
+    return NULL;
+  }
+  cache->capacity = INITIAL_CAPACITY;
+  return cache;
+}
+
+/**
+ * Frees the cache and every block in it
+ * @param cache
+ */
+void block_cache_destroy(Block_Cache *cache) {
+  if (!cache) {
+    return;
+  }
+  for (int i = 0; i < cache->capacity; ++i) {
+    free(cache->slots[i]);
+  }
+  free(cache->slots);
+  free(cache);
+}
+
+/**
+ * Puts a block into the first free slot of its probe sequence
+ * @param slots
+ * @param capacity
+ * @param block
+ */
+static void insert_block(Translated_Block **slots, int capacity,
+                         Translated_Block *block) {
+  unsigned int mask = capacity - 1;
+  unsigned int i = hash_pc(block->start_pc) & mask;
+  while (slots[i]) {
+    i = (i + 1) & mask;
+  }
+  slots[i] = block;
+}
+
+/**
+ * Rebuilds the table at a new capacity, dropping blocks that overlap
+ * [start_pc, end_pc) if end_pc > start_pc
+ * @return 0 on success, -1 if out of memory
+ */
+static int rebuild(Block_Cache *cache, int capacity, int start_pc, int end_pc) {
+  Translated_Block **slots = calloc(capacity, sizeof(*slots));
+  if (!slots) {
+    return -1;
+  }
+
+  cache->blocks = 0;
+  for (int i = 0; i < cache->capacity; ++i) {
+    Translated_Block *block = cache->slots[i];
+    if (!block) {
+      continue;
+    }
+    if (block->start_pc < end_pc && start_pc < block->end_pc) {
+      free(block);
+      cache->invalidations++;
+      continue;
+    }
+    insert_block(slots, capacity, block);
+    cache->blocks++;
+  }
+
+  free(cache->slots);
+  cache->slots = slots;
+  cache->capacity = capacity;
+  return 0;
+}
+
+/**
+ * Drops every block containing an instruction in [start_pc, end_pc).
+ * To be called whenever that part of code memory changes.
+ * @param cache
+ * @param start_pc
+ * @param end_pc
+ */
+void block_cache_invalidate(Block_Cache *cache, int start_pc, int end_pc) {
+  if (end_pc > start_pc) {
+    rebuild(cache, cache->capacity, start_pc, end_pc);
+  }
+}
+
+/**
+ * Drops every block, e.g. after loading a new program
+ * @param cache
+ */
+void block_cache_invalidate_all(Block_Cache *cache) {
+  for (int i = 0; i < cache->capacity; ++i) {
+    if (cache->slots[i]) {
+      free(cache->slots[i]);
+      cache->slots[i] = NULL;
+      cache->invalidations++;
+    }
+  }
+  cache->blocks = 0;
+}
+
+Block_Cache_Stats block_cache_stats(const Block_Cache *cache) {
+  Block_Cache_Stats stats = {cache->hits, cache->misses, cache->invalidations,
+                             cache->blocks};
+  return stats;
+}
+
+/**
+ * Finds the block starting at pc, counting a hit or a miss
+ * @param cache
+ * @param pc
+ * @return
+ */
+static const Translated_Block *lookup_block(Block_Cache *cache, int pc) {
+  unsigned int mask = cache->capacity - 1;
+  unsigned int i = hash_pc(pc) & mask;
+  while (cache->slots[i]) {
+    if (cache->slots[i]->start_pc == pc) {
+      cache->hits++;
+      return cache->slots[i];
+    }
+    i = (i + 1) & mask;
+  }
+  cache->misses++;
+  return NULL;
+}
+
+static int is_block_end(int opcode_id) {
+  return opcode_id == OP_BZ || opcode_id == OP_BNZ ||
+         opcode_id == OP_JUMP || opcode_id == OP_HALT;
+}
+
+/**
+ * Translates the block starting at pc and adds it to the cache. The
+ * block stops after its first BZ, BNZ, JUMP or HALT, before an invalid
+ * instruction or the end of code memory, or at MAX_BLOCK_LENGTH. A
+ * block that does not end in a branch gets a trailing end_handler op.
+ * @param out_of_memory set if NULL is returned for want of memory
+ * @return NULL if pc is outside code memory or on an invalid instruction,
+ * or if out of memory
+ */
+static const Translated_Block *translate_block(APEX_CPU *cpu, Block_Cache *cache,
+                                               int pc, const void *const *handlers,
+                                               const void *end_handler,
+                                               int *out_of_memory) {
+  *out_of_memory = 0;
+  int first = get_code_index(pc);
+  if (first < 0 || first >= cpu->code_memory_size ||
+      cpu->code_memory[first].opcode_id >= OP_INVALID) {
+    return NULL;
+  }
+
+  int length = 0;
+  while (length < MAX_BLOCK_LENGTH && first + length < cpu->code_memory_size) {
+    int opcode_id = cpu->code_memory[first + length].opcode_id;
+    if (opcode_id >= OP_INVALID) {
+      break;
+    }
+    length++;
+    if (is_block_end(opcode_id)) {
+      break;
+    }
+  }
+
+  Translated_Block *block =
+      malloc(sizeof(*block) + sizeof(Block_Op) * (length + 1));
+  if (!block) {
+    *out_of_memory = 1;
+    return NULL;
+  }
+  block->start_pc = pc;
+  block->end_pc = pc + 4 * length;
+  block->length = length;
+
+  for (int i = 0; i < length; ++i) {
+    const APEX_Instruction *ins = &cpu->code_memory[first + i];
+    Block_Op *op = &block->ops[i];
+    op->handler = handlers[ins->opcode_id];
+    op->imm = ins->imm;
+    op->rd = ins->rd;
+    op->rs1 = ins->rs1;
+    op->rs2 = ins->rs2;
+    if (ins->opcode_id == OP_BZ || ins->opcode_id == OP_BNZ) {
+      op->imm = pc + 4 * i + ins->imm;
+    }
+  }
+  memset(&block->ops[length], 0, sizeof(Block_Op));
+  block->ops[length].handler = end_handler;
+
+  if (2 * (cache->blocks + 1) > cache->capacity &&
+      rebuild(cache, cache->capacity * 2, 0, 0) != 0) {
+    free(block);
+    *out_of_memory = 1;
+    return NULL;
+  }
+  insert_block(cache->slots, cache->capacity, block);
+  cache->blocks++;
+  return block;
+}
+
+/**
+ * Translated counterpart of APEX_cpu_run_functional, with the same
+ * arguments, semantics and result. A block that would overrun
+ * max_instructions is finished off by the plain interpreter, so the
+ * limit is exact; so is the rest of the run if a block cannot be
+ * translated for want of memory.
+ * @param cpu
+ * @param cache
+ * @param max_instructions
+ * @param executed
+ * @return 1 if the program finished, 0 if it stopped at the limit
+ */
+int APEX_cpu_run_translated(APEX_CPU *cpu, Block_Cache *cache,
+                            uint64_t max_instructions, uint64_t *executed) {
+  static const void *const handlers[NUM_OPCODES] = {
+      [OP_EMPTY] = &&op_next,
+      [OP_ADD] = &&op_add,
+      [OP_SUB] = &&op_sub,
+      [OP_MUL] = &&op_mul,
+      [OP_AND] = &&op_and,
+      [OP_OR] = &&op_or,
+      [OP_EX_OR] = &&op_ex_or,
+      [OP_MOVC] = &&op_movc,
+      [OP_LOAD] = &&op_load,
+      [OP_STORE] = &&op_store,
+      [OP_BZ] = &&op_bz,
+      [OP_BNZ] = &&op_bnz,
+      [OP_JUMP] = &&op_jump,
+      [OP_HALT] = &&op_halt,
+      [OP_NOP] = &&op_next,
+  };
+
+  int *regs = cpu->regs;
+  APEX_Memory *mem = &cpu->data_memory;
+  int pc = cpu->pc;
+  int zFlag = cpu->zFlag;
+  uint64_t count = 0;
+  int finished = 0;
+  const Translated_Block *block;
+  const Block_Op *op;
+  int out_of_memory;
+
+/* Direct threading: jump straight to the next op's handler */
+#define NEXT() do { op++; goto *op->handler; } while (0)
+
+next_block:
+  if (max_instructions && count >= max_instructions) {
+    goto done;
+  }
+  block = lookup_block(cache, pc);
+  if (!block) {
+    block = translate_block(cpu, cache, pc, handlers, &&op_end, &out_of_memory);
+    if (!block && !out_of_memory) {
+      finished = 1;
+      goto done;
+    }
+  }
+  /** Without memory for the block, the plain interpreter runs the rest */
+  if (!block || (max_instructions && count + block->length > max_instructions)) {
+    cpu->pc = pc;
+    cpu->zFlag = zFlag;
+    finished = APEX_cpu_run_functional(cpu, max_instructions ? max_instructions - count
+                                                             : 0, &count);
+    pc = cpu->pc;
+    zFlag = cpu->zFlag;
+    goto done;
+  }
+  count += block->length;
+  op = block->ops;
+  goto *op->handler;
+
+op_next:
+  NEXT();
+op_add:
+  zFlag = regs[op->rd] = regs[op->rs1] + regs[op->rs2];
+  NEXT();
+op_sub:
+  zFlag = regs[op->rd] = regs[op->rs1] - regs[op->rs2];
+  NEXT();
+op_mul:
+  zFlag = regs[op->rd] = regs[op->rs1] * regs[op->rs2];
+  NEXT();
+op_and:
+  regs[op->rd] = regs[op->rs1] & regs[op->rs2];
+  NEXT();
+op_or:
+  regs[op->rd] = regs[op->rs1] | regs[op->rs2];
+  NEXT();
+op_ex_or:
+  regs[op->rd] = regs[op->rs1] ^ regs[op->rs2];
+  NEXT();
+op_movc:
+  regs[op->rd] = op->imm;
+  NEXT();
+op_load:
+  regs[op->rd] = memory_load(mem, regs[op->rs1] + op->imm);
+  NEXT();
+op_store:
+  memory_store(mem, regs[op->rs2] + op->imm, regs[op->rs1]);
+  NEXT();
+op_bz:
+  pc = zFlag == 0 ? op->imm : block->end_pc;
+  goto next_block;
+op_bnz:
+  pc = zFlag != 0 ? op->imm : block->end_pc;
+  goto next_block;
+op_jump:
+  pc = regs[op->rs1] + op->imm;
+  goto next_block;
+op_end:
+  pc = block->end_pc;
+  goto next_block;
+op_halt:
+  /** pc is left on the HALT, as in the plain interpreter */
+  cpu->haltFlag = 1;
+  pc = block->end_pc - 4;
+  finished = 1;
+  goto done;
+
+#undef NEXT
+
+done:
+  cpu->pc = pc;
+  cpu->zFlag = zFlag;
+  if (executed) {
+    *executed += count;
+  }
+  return finished;
+}
@@ -0,0 +1,52 @@
+#ifndef _APEX_BLOCK_CACHE_H_
+#define _APEX_BLOCK_CACHE_H_
+/**
+ *  block_cache.h
+ *  Contains the basic-block translation cache used by the translated
+ *  functional mode
+ */
+#include <stdint.h>
+
+#include "cpu.h"
+
+/* One pre-decoded instruction of a translated block */
+typedef struct Block_Op {
+    const void *handler;  // Address of the interpreter code for this opcode
+    int32_t imm;          // Literal, or the resolved target pc of BZ/BNZ
+    uint8_t rd;
+    uint8_t rs1;
+    uint8_t rs2;
+} Block_Op;
+
+/* Straight-line run of instructions ending at BZ, BNZ, JUMP or HALT */
+typedef struct Translated_Block {
+    int start_pc;         // pc of the first instruction
+    int end_pc;           // pc following the last instruction
+    int length;           // Number of ops
+    Block_Op ops[];
+} Translated_Block;
+
+/* Cache statistics */
+typedef struct Block_Cache_Stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations;
+    int blocks;           // Blocks currently cached
+} Block_Cache_Stats;
+
+typedef struct Block_Cache Block_Cache;
+
+Block_Cache *block_cache_create(void);
+
+void block_cache_destroy(Block_Cache *cache);
+
+void block_cache_invalidate(Block_Cache *cache, int start_pc, int end_pc);
+
+void block_cache_invalidate_all(Block_Cache *cache);
+
+Block_Cache_Stats block_cache_stats(const Block_Cache *cache);
+
+int APEX_cpu_run_translated(APEX_CPU *cpu, Block_Cache *cache,
+                            uint64_t max_instructions, uint64_t *executed);
+
+#endif
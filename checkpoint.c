@@ -0,0 +1,306 @@
+/*
+ *  checkpoint.c
+ *  Contains functions to save an APEX_CPU to a checkpoint file and to
+ *  restore it. A checkpoint holds the clock, pc, register file, all
+ *  stage latches, data memory and flags, so a restored CPU carries on
+ *  exactly as the saved one would have. Like program images, checkpoints
+ *  are specific to the host and simulator version, and are only accepted
+ *  for the program they were taken from. Data memory is restored at the
+ *  size it was saved with; only its pages ever stored to are saved, so a
+ *  checkpoint is as small as the memory the program has touched.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+
+/**
+ * Fills in a header for a checkpoint of a CPU running code_memory
+ * @param header
+ * @param code_memory
+ * @param size
+ * @param data_memory_size
+ */
+static void init_header(APEX_Checkpoint_Header *header,
+                        const APEX_Instruction *code_memory, int size,
+                        uint64_t data_memory_size) {
+  memset(header, 0, sizeof(*header));
+  strcpy(header->magic, APEX_CHECKPOINT_MAGIC);
+  header->version = APEX_CHECKPOINT_VERSION;
+  header->byte_order = APEX_CHECKPOINT_BYTE_ORDER;
+  header->header_size = sizeof(APEX_Checkpoint_Header);
+  header->state_size = sizeof(APEX_Checkpoint_State);
+  header->program_hash = hash_code_memory(code_memory, size);
+  header->code_memory_size = size;
+  header->data_memory_size = data_memory_size;
+}
+
+/**
+ * Words in each page record of a checkpoint with the given data memory
+ * @param data_memory_size
+ * @return
+ */
+static int page_record_words(uint64_t data_memory_size) {
+  return data_memory_size < MEMORY_PAGE_WORDS ? (int) data_memory_size
+                                              : MEMORY_PAGE_WORDS;
+}
+
+/**
+ * Size of a checkpoint file with the given data memory and page records
+ * @param data_memory_size
+ * @param num_pages
+ * @return
+ */
+static uint64_t checkpoint_size(uint64_t data_memory_size, uint64_t num_pages) {
+  return sizeof(APEX_Checkpoint) +
+         num_pages * (sizeof(APEX_Checkpoint_Page) +
+                      sizeof(int) * page_record_words(data_memory_size));
+}
+
+/**
+ * Reads length bytes, in as many reads as it takes
+ * @param fd
+ * @param buffer
+ * @param length
+ * @return 0 on success, -1 on error or if the file ends first
+ */
+static int read_fully(int fd, void *buffer, size_t length) {
+  char *bytes = buffer;
+  while (length > 0) {
+    ssize_t got = read(fd, bytes, length);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      return -1;
+    }
+    bytes += got;
+    length -= got;
+  }
+  return 0;
+}
+
+/**
+ * Tells whether a register slot is one a latch can hold: an architectural
+ * register, REG_FLUSHED or REG_NONE
+ * @param reg
+ * @return
+ */
+static int valid_reg(uint8_t reg) {
+  return reg < NUM_ARCH_REGS || reg == REG_FLUSHED || reg == REG_NONE;
+}
+
+/**
+ * Checks a restored stage latch, as program images check instructions,
+ * since its opcode and registers index tables
+ * @param stage
+ * @return 1 if it is valid
+ */
+static int valid_stage(const CPU_Stage *stage) {
+  return stage->opcode_id < NUM_OPCODES && valid_reg(stage->rd) &&
+         valid_reg(stage->rs1) && valid_reg(stage->rs2) &&
+         valid_reg(stage->rdPrev);
+}
+
+/**
+ * Checks the restored state: every latch, a word aligned, non-negative
+ * pc, and scoreboard bits of register slots latches can hold only
+ * @param state
+ * @return 1 if it is valid
+ */
+static int valid_state(const APEX_Checkpoint_State *state) {
+  const uint32_t slots = (REG_BIT(NUM_ARCH_REGS) - 1) | REG_BIT(REG_FLUSHED) |
+                         REG_BIT(REG_NONE);
+  if (state->clock < 0 || state->pc < 0 || state->pc % 4 != 0 ||
+      (state->pending_regs & ~slots) || (state->written_regs & ~slots)) {
+    return 0;
+  }
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    if (!valid_stage(&state->stage[i])) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * FNV-1a hash of decoded code memory, identifying a program
+ * @param code_memory
+ * @param size
+ * @return
+ */
+uint64_t hash_code_memory(const APEX_Instruction *code_memory, int size) {
+  const unsigned char *bytes = (const unsigned char *) code_memory;
+  size_t length = sizeof(*code_memory) * size;
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < length; ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+/**
+ * Writes the state of cpu to a checkpoint. The file is written under a
+ * temporary name and renamed, so an interrupted save never leaves a
+ * truncated checkpoint in place of a good one.
+ * @param cpu
+ * @param filename
+ * @return 0 on success, -1 on failure
+ */
+int APEX_cpu_save_checkpoint(const APEX_CPU *cpu, const char *filename) {
+  /** calloc'd so that padding bytes are written as zeros */
+  APEX_Checkpoint *checkpoint = calloc(1, sizeof(*checkpoint));
+  size_t name_length = strlen(filename);
+  char *tmp_name = malloc(name_length + sizeof(".tmp"));
+  if (!checkpoint || !tmp_name) {
+    free(checkpoint);
+    free(tmp_name);
+    return -1;
+  }
+
+  const APEX_Memory *memory = &cpu->data_memory;
+  init_header(&checkpoint->header, cpu->code_memory, cpu->code_memory_size,
+              memory->size);
+  for (int i = 0; i < memory->num_pages; ++i) {
+    checkpoint->header.num_pages += memory->pages[i] != NULL;
+  }
+  APEX_Checkpoint_State *state = &checkpoint->state;
+  state->clock = cpu->clock;
+  state->pc = cpu->pc;
+  memcpy(state->regs, cpu->regs, sizeof(state->regs));
+  state->pending_regs = cpu->pending_regs;
+  state->written_regs = cpu->written_regs;
+  memcpy(state->stage, cpu->stage, sizeof(state->stage));
+  state->ins_completed = cpu->ins_completed;
+  state->zFlag = cpu->zFlag;
+  state->haltFlag = cpu->haltFlag;
+  state->ins_retired = cpu->ins_retired;
+  state->ins_fetched = cpu->ins_fetched;
+  state->last_retired = cpu->last_retired;
+  state->counters = cpu->counters;
+
+  memcpy(tmp_name, filename, name_length);
+  strcpy(tmp_name + name_length, ".tmp");
+
+  int ok = 0;
+  FILE *fp = fopen(tmp_name, "wb");
+  if (fp) {
+    ok = fwrite(checkpoint, sizeof(*checkpoint), 1, fp) == 1;
+    int words = page_record_words(memory->size);
+    for (int i = 0; ok && i < memory->num_pages; ++i) {
+      if (memory->pages[i]) {
+        APEX_Checkpoint_Page record = {(uint64_t) i};
+        ok = fwrite(&record, sizeof(record), 1, fp) == 1 &&
+             fwrite(memory_page_words(memory, i), sizeof(int), words, fp) ==
+                 (size_t) words;
+      }
+    }
+    if (fclose(fp) != 0) {
+      ok = 0;
+    }
+    if (ok && rename(tmp_name, filename) != 0) {
+      ok = 0;
+    }
+    if (!ok) {
+      remove(tmp_name);
+    }
+  }
+
+  free(tmp_name);
+  free(checkpoint);
+  return ok ? 0 : -1;
+}
+
+/**
+ * Restores the state of cpu from a checkpoint taken of the same program,
+ * resizing data memory to that of the checkpoint if need be
+ * @param cpu
+ * @param filename
+ * @return 0 on success, -1 if the file is unreadable, invalid, e.g. with
+ * a latch out of range, or was taken of another program, leaving cpu
+ * unchanged
+ */
+int APEX_cpu_restore_checkpoint(APEX_CPU *cpu, const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct stat st;
+  APEX_Checkpoint checkpoint;
+  if (fstat(fd, &st) != 0 ||
+      read_fully(fd, &checkpoint, sizeof(checkpoint)) != 0) {
+    memset(&checkpoint, 0, sizeof(checkpoint));
+  }
+
+  /** The file must be exactly as long as its header says */
+  uint64_t words = checkpoint.header.data_memory_size;
+  uint64_t num_pages = checkpoint.header.num_pages;
+  int valid_size = words > 0 && words <= MEMORY_MAX_WORDS &&
+                   (words & (words - 1)) == 0 &&
+                   num_pages <= (words + MEMORY_PAGE_WORDS - 1) / MEMORY_PAGE_WORDS &&
+                   checkpoint_size(words, num_pages) == (uint64_t) st.st_size;
+
+  APEX_Checkpoint_Header expected;
+  init_header(&expected, cpu->code_memory, cpu->code_memory_size, words);
+  expected.num_pages = num_pages;
+  int valid = valid_size &&
+              memcmp(&checkpoint.header, &expected, sizeof(expected)) == 0 &&
+              valid_state(&checkpoint.state);
+
+  /** Pages are stored to as they are read; any left all zeros are not
+   * allocated */
+  APEX_Memory data_memory = {NULL};
+  int page_words = page_record_words(words);
+  int *words_read = valid ? malloc(sizeof(int) * page_words) : NULL;
+  if (valid && (!words_read || memory_init(&data_memory, (int) words) != 0)) {
+    free(words_read);
+    close(fd);
+    return -1;
+  }
+  uint64_t next_index = 0;
+  for (uint64_t i = 0; valid && i < num_pages; ++i) {
+    APEX_Checkpoint_Page record;
+    valid = read_fully(fd, &record, sizeof(record)) == 0 &&
+            read_fully(fd, words_read, sizeof(int) * page_words) == 0 &&
+            record.index >= next_index &&
+            record.index < (uint64_t) data_memory.num_pages;
+    if (valid) {
+      memory_write(&data_memory, (int) (record.index << MEMORY_PAGE_BITS),
+                   page_words, words_read);
+      next_index = record.index + 1;
+    }
+  }
+  free(words_read);
+  close(fd);
+
+  if (!valid) {
+    fprintf(stderr, "APEX_Error : %s is not a valid version %d checkpoint "
+            "of this program\n", filename, APEX_CHECKPOINT_VERSION);
+    memory_free(&data_memory);
+    return -1;
+  }
+  memory_free(&cpu->data_memory);
+  cpu->data_memory = data_memory;
+
+  const APEX_Checkpoint_State *state = &checkpoint.state;
+  cpu->clock = state->clock;
+  cpu->pc = state->pc;
+  memcpy(cpu->regs, state->regs, sizeof(state->regs));
+  cpu->pending_regs = state->pending_regs;
+  cpu->written_regs = state->written_regs;
+  memcpy(cpu->stage, state->stage, sizeof(state->stage));
+  cpu->ins_completed = state->ins_completed;
+  cpu->zFlag = state->zFlag;
+  cpu->haltFlag = state->haltFlag;
+  cpu->ins_retired = state->ins_retired;
+  cpu->ins_fetched = state->ins_fetched;
+  cpu->last_retired = state->last_retired;
+  cpu->counters = state->counters;
+  return 0;
+}
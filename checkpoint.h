@@ -0,0 +1,67 @@
+#ifndef _APEX_CHECKPOINT_H_
+#define _APEX_CHECKPOINT_H_
+/**
+ *  checkpoint.h
+ *  Contains the binary checkpoint format, a snapshot of the full
+ *  simulated state of an APEX_CPU that a run can be resumed from
+ */
+#include <stdint.h>
+
+#include "cpu.h"
+
+#define APEX_CHECKPOINT_MAGIC "APEXCKP"
+#define APEX_CHECKPOINT_VERSION 6
+#define APEX_CHECKPOINT_BYTE_ORDER 0x01020304u
+
+/* Header at the start of a checkpoint */
+typedef struct APEX_Checkpoint_Header {
+    char magic[8];               // APEX_CHECKPOINT_MAGIC, NUL padded
+    uint32_t version;            // APEX_CHECKPOINT_VERSION
+    uint32_t byte_order;         // APEX_CHECKPOINT_BYTE_ORDER as written by the host
+    uint32_t header_size;        // sizeof(APEX_Checkpoint_Header)
+    uint32_t state_size;         // sizeof(APEX_Checkpoint_State)
+    uint64_t program_hash;       // Hash of the code memory the state belongs to
+    uint64_t code_memory_size;   // Number of instructions of that program
+    uint64_t data_memory_size;   // Words of data memory
+    uint64_t num_pages;          // Page records following the state
+} APEX_Checkpoint_Header;
+
+/* Simulated state of an APEX_CPU, everything but the program itself */
+typedef struct APEX_Checkpoint_State {
+    int clock;
+    int pc;
+    int regs[32];
+    uint32_t pending_regs;
+    uint32_t written_regs;
+    CPU_Stage stage[NUM_STAGES];
+    int ins_completed;
+    int zFlag;
+    int haltFlag;
+    uint64_t ins_retired;
+    uint64_t ins_fetched;
+    uint64_t last_retired;
+    APEX_Counters counters;
+} APEX_Checkpoint_State;
+
+/* Start of a checkpoint file. It goes on with num_pages page records,
+ * one for every page of data memory ever stored to, in increasing order
+ * of index; the pages left out are all zeros. */
+typedef struct APEX_Checkpoint {
+    APEX_Checkpoint_Header header;
+    APEX_Checkpoint_State state;
+} APEX_Checkpoint;
+
+/* Page record of a checkpoint */
+typedef struct APEX_Checkpoint_Page {
+    uint64_t index;              // Page number, address / MEMORY_PAGE_WORDS
+    int words[];                 // MEMORY_PAGE_WORDS words, or the whole
+                                 // data memory if it is smaller
+} APEX_Checkpoint_Page;
+
+uint64_t hash_code_memory(const APEX_Instruction *code_memory, int size);
+
+int APEX_cpu_save_checkpoint(const APEX_CPU *cpu, const char *filename);
+
+int APEX_cpu_restore_checkpoint(APEX_CPU *cpu, const char *filename);
+
+#endif
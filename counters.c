@@ -0,0 +1,88 @@
+/*
+ *  counters.c
+ *  Contains the JSON output of the performance counters
+ */
+#include <string.h>
+
+#include "counters.h"
+
+/**
+ * Name of a stall cause in the counters' and the profiler's output
+ * @param cause an APEX_Stall_Cause
+ * @return
+ */
+const char *get_stall_cause_name(int cause) {
+  static const char *names[NUM_STALL_CAUSES] = {
+    "load_use", "mul", "backpressure", "branch_flag", "dependency"
+  };
+  return cause >= 0 && cause < NUM_STALL_CAUSES ? names[cause] : "unknown";
+}
+
+/**
+ * Prints the counters of a run as one JSON object
+ * @param out
+ * @param cpu
+ */
+void print_counters_json(FILE *out, const APEX_CPU *cpu) {
+  const APEX_Counters *counters = &cpu->counters;
+  uint64_t cycles = cpu->clock;
+  uint64_t instructions = cpu->ins_retired;
+
+  fprintf(out, "{\n");
+  fprintf(out, "  \"config\": {\"data_forwarding\": %d, \"mul_latency\": %d, "
+          "\"data_memory\": %d},\n", cpu->config.data_forwarding,
+          cpu->config.mul_latency, cpu->data_memory.size);
+  fprintf(out, "  \"finished\": %s,\n", cpu->finished ? "true" : "false");
+  fprintf(out, "  \"cycles\": %llu,\n", (unsigned long long) cycles);
+  fprintf(out, "  \"instructions\": %llu,\n", (unsigned long long) instructions);
+  if (cycles && instructions) {
+    fprintf(out, "  \"cpi\": %.6f,\n", (double) cycles / instructions);
+  } else {
+    fprintf(out, "  \"cpi\": null,\n");
+  }
+
+  fprintf(out, "  \"retired\": {");
+  const char *separator = "";
+  for (int op = OP_EMPTY + 1; op < OP_NOP; ++op) {
+    fprintf(out, "%s\"%s\": %llu", separator, get_opcode_name(op),
+            (unsigned long long) counters->retired[op]);
+    separator = ", ";
+  }
+  fprintf(out, "},\n");
+
+  fprintf(out, "  \"stall_cycles\": {");
+  separator = "";
+  for (int cause = 0; cause < NUM_STALL_CAUSES; ++cause) {
+    fprintf(out, "%s\"%s\": %llu", separator, get_stall_cause_name(cause),
+            (unsigned long long) counters->stall_cycles[cause]);
+    separator = ", ";
+  }
+  fprintf(out, "},\n");
+  fprintf(out, "  \"branches_taken\": %llu,\n",
+          (unsigned long long) counters->branches_taken);
+  fprintf(out, "  \"jumps\": %llu,\n", (unsigned long long) counters->jumps);
+  fprintf(out, "  \"flushed\": {\"branch\": %llu, \"jump\": %llu}\n",
+          (unsigned long long) counters->flushed_branch,
+          (unsigned long long) counters->flushed_jump);
+  fprintf(out, "}\n");
+}
+
+/**
+ * Writes the counters of a run as JSON to a file, or to stdout if
+ * filename is "-"
+ * @param cpu
+ * @param filename
+ * @return 0 on success, -1 on error
+ */
+int APEX_cpu_write_counters(const APEX_CPU *cpu, const char *filename) {
+  if (strcmp(filename, "-") == 0) {
+    print_counters_json(stdout, cpu);
+    return 0;
+  }
+  FILE *fp = fopen(filename, "w");
+  if (!fp) {
+    return -1;
+  }
+  print_counters_json(fp, cpu);
+  return fclose(fp) == 0 ? 0 : -1;
+}
@@ -0,0 +1,17 @@
+#ifndef _APEX_COUNTERS_H_
+#define _APEX_COUNTERS_H_
+/**
+ *  counters.h
+ *  Contains the output of the performance counters, see APEX_Counters
+ */
+#include <stdio.h>
+
+#include "cpu.h"
+
+const char *get_stall_cause_name(int cause);
+
+void print_counters_json(FILE *out, const APEX_CPU *cpu);
+
+int APEX_cpu_write_counters(const APEX_CPU *cpu, const char *filename);
+
+#endif
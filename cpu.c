@@ -6,13 +6,21 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "block_cache.h"
+#include "checkpoint.h"
 #include "cpu.h"
-
-/* Set this flag to 1 to enable debug messages */
-int ENABLE_DEBUG_MESSAGES = 0;
-
-/* Set this flag to 1 to enable debug messages*/
-#define DATA_FORWARDING_ENABLED 1
+#include "flight_recorder.h"
+#include "instrument.h"
+#include "interval.h"
+#include "lanes.h"
+#include "lockstep.h"
+#include "profile.h"
+#include "program_image.h"
+#include "sample.h"
+#include "trace.h"
+
+/* Stage bodies are inlined into one cycle function per configuration */
+#define ALWAYS_INLINE __attribute__((always_inline))
 
 /*
  * This function creates and initializes APEX cpu.
@@ -25,40 +33,60 @@ APEX_CPU *APEX_cpu_init(const char *filename) {
     return NULL;
   }
 
-  APEX_CPU *cpu = malloc(sizeof(*cpu));
+  APEX_CPU *cpu = calloc(1, sizeof(*cpu));
   if (!cpu) {
     return NULL;
   }
 
+  /* Defaults, changed through cpu->config before APEX_cpu_run */
+  cpu->config.debug_messages = 0;
+  cpu->config.data_forwarding = 1;
+  cpu->config.out = stdout;
+  cpu->config.mul_latency = 2;
+
+  if (memory_init(&cpu->data_memory, DATA_MEMORY_SIZE) != 0) {
+    free(cpu);
+    return NULL;
+  }
+
   /* Initialize PC, Registers and all pipeline stages */
   cpu->pc = 4000;
   memset(cpu->regs, 0, sizeof(int) * 32);
-  memset(cpu->regs_valid, 1, sizeof(int) * 32);
+  cpu->pending_regs = 0;
+  cpu->written_regs = 0;
   memset(cpu->stage, 0, sizeof(CPU_Stage) * NUM_STAGES);
-  memset(cpu->data_memory, 0, sizeof(int) * 4000);
 
-  /* Parse input file and create code memory */
-  cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
+  /* Map a pre-assembled image as is, otherwise parse the text file */
+  if (is_program_image(filename)) {
+    cpu->code_memory = map_program_image(filename, &cpu->code_memory_size,
+                                         &cpu->code_mapping,
+                                         &cpu->code_mapping_size,
+                                         &cpu->load_stats);
+  } else {
+    cpu->code_memory = load_code_memory(filename, &cpu->code_memory_size,
+                                        &cpu->load_stats);
+  }
 
   if (!cpu->code_memory) {
+    memory_free(&cpu->data_memory);
     free(cpu);
     return NULL;
   }
 
-  if (ENABLE_DEBUG_MESSAGES) {
+  if (cpu->config.debug_messages) {
     fprintf(stderr,
             "APEX_CPU : Initialized APEX CPU, loaded %d instructions\n",
             cpu->code_memory_size);
     fprintf(stderr, "APEX_CPU : Printing Code Memory\n");
-    printf("%-9s %-9s %-9s %-9s %-9s\n", "opcode", "rd", "rs1", "rs2", "imm");
+    fprintf(cpu->config.out, "%-9s %-9s %-9s %-9s %-9s\n", "opcode", "rd", "rs1", "rs2", "imm");
 
     for (int i = 0; i < cpu->code_memory_size; ++i) {
-      printf("%-9s %-9d %-9d %-9d %-9d\n",
-             cpu->code_memory[i].opcode,
-             cpu->code_memory[i].rd,
-             cpu->code_memory[i].rs1,
-             cpu->code_memory[i].rs2,
-             cpu->code_memory[i].imm);
+      fprintf(cpu->config.out, "%-9s %-9d %-9d %-9d %-9d\n",
+              get_opcode_name(cpu->code_memory[i].opcode_id),
+              cpu->code_memory[i].rd,
+              cpu->code_memory[i].rs1,
+              cpu->code_memory[i].rs2,
+              cpu->code_memory[i].imm);
     }
   }
 
@@ -67,9 +95,35 @@ APEX_CPU *APEX_cpu_init(const char *filename) {
     cpu->stage[i].busy = 1;
   }
 
+  cpu->sample_config.period = 100000;
+  cpu->sample_config.window = 1000;
+  cpu->sample_config.warmup = 100;
+
+  cpu->interval_config.interval = 1000000;
+  cpu->interval_config.warmup = 1000;
+
   return cpu;
 }
 
+/**
+ * Empties the pipeline so that it starts afresh from the architectural
+ * state (regs, data_memory, pc and zFlag), as after APEX_cpu_init. Used to
+ * hand over to the pipeline a state built by the functional mode.
+ * @param cpu
+ */
+void APEX_cpu_reset_pipeline(APEX_CPU *cpu) {
+  cpu->pending_regs = 0;
+  cpu->written_regs = 0;
+  memset(cpu->stage, 0, sizeof(CPU_Stage) * NUM_STAGES);
+  for (int i = 1; i < NUM_STAGES; ++i) {
+    cpu->stage[i].busy = 1;
+    /** A BZ or BNZ fetched first takes the flag from the bubble ahead */
+    cpu->stage[i].buffer = cpu->zFlag;
+  }
+  cpu->ins_completed = get_code_index(cpu->pc);
+  cpu->haltFlag = 0;
+}
+
 /*
  * This function de-allocates APEX cpu.
  *
@@ -77,10 +131,63 @@ APEX_CPU *APEX_cpu_init(const char *filename) {
  * 				implementation
  */
 void APEX_cpu_stop(APEX_CPU *cpu) {
-  free(cpu->code_memory);
+  block_cache_destroy(cpu->block_cache);
+  if (cpu->shares_code_memory) {
+    /** Belongs to the CPU this one was cloned from */
+  } else if (cpu->code_mapping) {
+    unmap_program_image(cpu->code_mapping, cpu->code_mapping_size);
+  } else {
+    free(cpu->code_memory);
+  }
+  memory_free(&cpu->data_memory);
   free(cpu);
 }
 
+/**
+ * Copies a CPU, e.g. to run its pipeline on the side. The copy has its
+ * own data memory, sharing the pages of cpu until either writes them,
+ * and uses the code memory of cpu, which must outlive it. It starts with
+ * no block cache, checkpoint file, trace, flight recorder or profile.
+ * Release it with APEX_cpu_stop.
+ * @param cpu
+ * @return
+ */
+APEX_CPU *APEX_cpu_clone(const APEX_CPU *cpu) {
+  APEX_CPU *copy = malloc(sizeof(*copy));
+  if (!copy) {
+    return NULL;
+  }
+  memcpy(copy, cpu, sizeof(*copy));
+  if (memory_share(&copy->data_memory, &cpu->data_memory) != 0) {
+    free(copy);
+    return NULL;
+  }
+  copy->shares_code_memory = 1;
+  copy->block_cache = NULL;
+  copy->checkpoint_file = NULL;
+  copy->trace = NULL;
+  copy->flight_recorder = NULL;
+  copy->profile = NULL;
+  copy->callbacks = NULL;
+  return copy;
+}
+
+/**
+ * Replaces data memory with a zeroed one of the given number of words
+ * @param cpu
+ * @param words a power of 2, at most MEMORY_MAX_WORDS
+ * @return 0 on success, -1 on a bad size or out of memory
+ */
+int APEX_cpu_set_data_memory_size(APEX_CPU *cpu, int words) {
+  APEX_Memory data_memory;
+  if (memory_init(&data_memory, words) != 0) {
+    return -1;
+  }
+  memory_free(&cpu->data_memory);
+  cpu->data_memory = data_memory;
+  return 0;
+}
+
 /* Converts the PC(4000 series) into
  * array index for code memory
  *
@@ -91,51 +198,70 @@ int get_code_index(int pc) {
   return (pc - 4000) / 4;
 }
 
+/* Fetches past either end of code memory see an empty slot */
+static const APEX_Instruction empty_instruction;
+
+/**
+ * Returns the instruction at given pc, or an empty one outside code memory
+ * @param cpu
+ * @param pc
+ * @return
+ */
+static const APEX_Instruction *get_code_instruction(const APEX_CPU *cpu, int pc) {
+  int index = get_code_index(pc);
+  if (index < 0 || index >= cpu->code_memory_size) {
+    return &empty_instruction;
+  }
+  return &cpu->code_memory[index];
+}
+
 /**
  *
+ * @param out
  * @param stage
  */
-static void print_instruction(CPU_Stage *stage) {
-  if (strcmp(stage->opcode, "STORE") == 0) {
-    printf("%s,R%d,R%d,#%d ", stage->opcode, stage->rs1, stage->rs2, stage->imm);
-  }
+static void print_instruction(FILE *out, CPU_Stage *stage) {
+  switch (stage->opcode_id) {
+    case OP_STORE:
+      fprintf(out, "%s,R%d,R%d,#%d ", get_opcode_name(stage->opcode_id), stage->rs1, stage->rs2, stage->imm);
+      break;
 
-  if (strcmp(stage->opcode, "LOAD") == 0) {
-    printf("%s,R%d,R%d,#%d ", stage->opcode, stage->rd, stage->rs1, stage->imm);
-  }
+    case OP_LOAD:
+      fprintf(out, "%s,R%d,R%d,#%d ", get_opcode_name(stage->opcode_id), stage->rd, stage->rs1, stage->imm);
+      break;
 
-  if (strcmp(stage->opcode, "MOVC") == 0) {
-    printf("%s,R%d,#%d ", stage->opcode, stage->rd, stage->imm);
-  }
+    case OP_MOVC:
+      fprintf(out, "%s,R%d,#%d ", get_opcode_name(stage->opcode_id), stage->rd, stage->imm);
+      break;
 
-  if (strcmp(stage->opcode, "JUMP") == 0) {
-    printf("%s,R%d,#%d ", stage->opcode, stage->rs1, stage->imm);
-  }
+    case OP_JUMP:
+      fprintf(out, "%s,R%d,#%d ", get_opcode_name(stage->opcode_id), stage->rs1, stage->imm);
+      break;
 
-  if (strcmp(stage->opcode, "HALT") == 0) {
-    printf("%s", stage->opcode);
-  }
+    case OP_HALT:
+      fprintf(out, "%s", get_opcode_name(stage->opcode_id));
+      break;
 
-  if (
-      strcmp(stage->opcode, "BZ") == 0 ||
-      strcmp(stage->opcode, "BNZ") == 0
-      ) {
-    printf("%s,#%d ", stage->opcode, stage->imm);
-  }
+    case OP_BZ:
+    case OP_BNZ:
+      fprintf(out, "%s,#%d ", get_opcode_name(stage->opcode_id), stage->imm);
+      break;
 
-  if (strcmp(stage->opcode, "NOP") == 0) {
-    printf("%s ", stage->opcode);
-  }
+    case OP_NOP:
+      fprintf(out, "%s ", get_opcode_name(stage->opcode_id));
+      break;
 
-  if (
-      strcmp(stage->opcode, "ADD") == 0 ||
-      strcmp(stage->opcode, "SUB") == 0 ||
-      strcmp(stage->opcode, "MUL") == 0 ||
-      strcmp(stage->opcode, "AND") == 0 ||
-      strcmp(stage->opcode, "EX-OR") == 0 ||
-      strcmp(stage->opcode, "OR") == 0
-      ) {
-    printf("%s,R%d,R%d,R%d ", stage->opcode, stage->rd, stage->rs1, stage->rs2);
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_AND:
+    case OP_EX_OR:
+    case OP_OR:
+      fprintf(out, "%s,R%d,R%d,R%d ", get_opcode_name(stage->opcode_id), stage->rd, stage->rs1, stage->rs2);
+      break;
+
+    default:
+      break;
   }
 
 }
@@ -146,10 +272,169 @@ static void print_instruction(CPU_Stage *stage) {
  * Note : You are not supposed to edit this function
  *
  */
-static void print_stage_content(char *name, CPU_Stage *stage) {
-  printf("%-15s: pc(%d) ", name, stage->pc);
-  print_instruction(stage);
-  printf("\n");
+static void print_stage_content(FILE *out, char *name, CPU_Stage *stage) {
+  fprintf(out, "%-15s: pc(%d) ", name, stage->pc);
+  print_instruction(out, stage);
+  fprintf(out, "\n");
+}
+
+/* Names display prints the stages under */
+static char *stage_names[NUM_STAGES] = {"Fetch", "Decode/RF", "Execute",
+                                        "Memory", "Writeback"};
+
+/**
+ * Prints a stage latch as display does
+ * @param out
+ * @param stage_id F, DRF, EX, MEM or WB
+ * @param stage
+ */
+void print_stage(FILE *out, int stage_id, CPU_Stage *stage) {
+  print_stage_content(out, stage_names[stage_id], stage);
+}
+
+/**
+ * Prints an instruction of code memory as display does
+ * @param out
+ * @param cpu
+ * @param index code memory index
+ */
+void print_code_instruction(FILE *out, const APEX_CPU *cpu, int index) {
+  const APEX_Instruction *ins = &cpu->code_memory[index];
+  CPU_Stage stage;
+  memset(&stage, 0, sizeof(stage));
+  stage.pc = 4000 + 4 * index;
+  stage.opcode_id = ins->opcode_id;
+  stage.rd = ins->rd;
+  stage.rs1 = ins->rs1;
+  stage.rs2 = ins->rs2;
+  stage.imm = ins->imm;
+  print_instruction(out, &stage);
+}
+
+/* Bits of the debug argument of the stage and cycle functions */
+#define DEBUG_PRINT 1   // Print every stage, for display
+#define DEBUG_TRACE 2   // Record every stage display would print in cpu->trace_record
+
+/**
+ * Shows a stage in the ways debug asks for
+ * @param cpu
+ * @param debug
+ * @param stage_id
+ * @param stage
+ */
+static inline ALWAYS_INLINE void show_stage(APEX_CPU *cpu, const int debug,
+                                            int stage_id, CPU_Stage *stage) {
+  if (debug & DEBUG_PRINT) {
+    print_stage_content(cpu->config.out, stage_names[stage_id], stage);
+  }
+  if (debug & DEBUG_TRACE) {
+    APEX_Trace_Record *record = cpu->trace_record;
+    APEX_Trace_Stage *traced = &record->stage[stage_id];
+    record->shown |= 1u << stage_id;
+    traced->pc = stage->pc;
+    traced->imm = stage->imm;
+    traced->opcode_id = stage->opcode_id;
+    traced->rd = stage->rd;
+    traced->rs1 = stage->rs1;
+    traced->rs2 = stage->rs2;
+  }
+}
+
+/**
+ * Marks a register as to be written by an instruction past decode
+ * @param cpu
+ * @param reg
+ */
+static inline ALWAYS_INLINE void set_reg_pending(APEX_CPU *cpu, int reg) {
+  cpu->pending_regs |= REG_BIT(reg);
+}
+
+/**
+ * Marks a register as written back, or freed by a flush
+ * @param cpu
+ * @param reg
+ */
+static inline ALWAYS_INLINE void set_reg_written(APEX_CPU *cpu, int reg) {
+  cpu->pending_regs &= ~REG_BIT(reg);
+  cpu->written_regs |= REG_BIT(reg);
+}
+
+/**
+ * Tells whether a register has been written back, or freed by a flush,
+ * and is not pending again since
+ * @param cpu
+ * @param reg
+ * @return
+ */
+static inline ALWAYS_INLINE int is_reg_written(const APEX_CPU *cpu, int reg) {
+  return (cpu->written_regs & ~cpu->pending_regs & REG_BIT(reg)) != 0;
+}
+
+/* Producer bits: the latches a result can be forwarded from */
+#define FROM_EX (1u << 0)
+#define FROM_MEM (1u << 1)
+#define FROM_WB (1u << 2)
+
+/**
+ * Looks up the producers of a register slot: the FROM_ bits of the EX,
+ * MEM and WB latches holding an instruction that writes it. This is the
+ * row of a per-register producer table, computed when decode needs it;
+ * keeping a table up to date as the latches move measured slower, as
+ * every cycle pays for it and only forwarding cycles use it.
+ * @param cpu
+ * @param reg
+ * @return
+ */
+static inline ALWAYS_INLINE unsigned int find_producers(const APEX_CPU *cpu,
+                                                        int reg) {
+  return (cpu->stage[EX].rd == reg) * FROM_EX |
+         (cpu->stage[MEM].rd == reg) * FROM_MEM |
+         (cpu->stage[WB].rd == reg) * FROM_WB;
+}
+
+/**
+ * Picks the latch to forward from out of a set of FROM_ bits: the
+ * youngest producer, i.e. EX before MEM before WB
+ * @param from
+ * @return the FROM_ bit, 0 if from is empty
+ */
+static inline ALWAYS_INLINE unsigned int nearest_producer(unsigned int from) {
+  return from & -from;
+}
+
+/**
+ * Forwards a source operand from the instruction in EX. A LOAD there
+ * has no value yet, so decode stalls and takes the loaded word in the
+ * next cycle, once the LOAD is in MEM.
+ * @param cpu
+ * @param stage decode latch
+ * @param value source operand to fill in
+ * @param valueFilled set to whether it was
+ * @return 1 if decode has just stalled for a LOAD
+ */
+static inline ALWAYS_INLINE int forward_from_ex(APEX_CPU *cpu, CPU_Stage *stage,
+                                                int *value, int *valueFilled) {
+  if (stage->stallDueToLoadFlag) {
+    if (cpu->stage[MEM].opcode_id == OP_LOAD) {
+      *value = memory_load(&cpu->data_memory, cpu->stage[MEM].mem_address);
+      stage->stalled = 0;
+      stage->stallDueToLoadFlag = 0;
+      *valueFilled = 1;
+    } else {
+      stage->stalled = 1;
+    }
+    return 0;
+  }
+
+  *value = cpu->stage[EX].buffer;
+  if (cpu->stage[EX].opcode_id == OP_LOAD) {
+    stage->stalled = 1;
+    stage->stallDueToLoadFlag = 1;
+    *valueFilled = 0;
+    return 1;
+  }
+  *valueFilled = 1;
+  return 0;
 }
 
 /**
@@ -161,15 +446,15 @@ void flushStageWithEmpty(APEX_CPU *cpu, enum myEnum stageName) {
   CPU_Stage *stage = &cpu->stage[stageName];
 
   /*free reg_valid*/
-  cpu->regs_valid[stage->rd] = 1;
+  set_reg_written(cpu, stage->rd);
 
   /*reset all stage related data*/
-  strcpy(stage->opcode, "");
-  stage->rd = 999;
-  stage->rs1 = 999;
-  stage->rs2 = 999;
+  stage->opcode_id = OP_EMPTY;
+  stage->rd = REG_FLUSHED;
+  stage->rs1 = REG_FLUSHED;
+  stage->rs2 = REG_FLUSHED;
   stage->imm = 999;
-  stage->rdPrev = 999;
+  stage->rdPrev = REG_FLUSHED;
 }
 
 /**
@@ -183,16 +468,16 @@ void flushStageWithNOP(APEX_CPU *cpu, enum myEnum stageName, int dontChangeValid
 
   /*free reg_valid*/
   if (!dontChangeValid) {
-    cpu->regs_valid[stage->rd] = 1;
+    set_reg_written(cpu, stage->rd);
   }
 
   /*reset all stage related data*/
-  strcpy(stage->opcode, "NOP");
-  stage->rd = 999;
-  stage->rs1 = 999;
-  stage->rs2 = 999;
+  stage->opcode_id = OP_NOP;
+  stage->rd = REG_FLUSHED;
+  stage->rs1 = REG_FLUSHED;
+  stage->rs2 = REG_FLUSHED;
   stage->imm = 999;
-  stage->rdPrev = 999;
+  stage->rdPrev = REG_FLUSHED;
 
   if(fromJump){
     stage->stallDueToNextStage = 0;
@@ -216,22 +501,91 @@ void bzBnzBranchHandling(APEX_CPU *cpu, enum myEnum stageName) {
   cpu->pc += (stage->imm - 8) - 4;
   cpu->ins_completed += stage->imm / 4 - 1;
   stage->flushInNextStage = 1;
+  cpu->counters.branches_taken++;
+}
+
+/**
+ * Counts the stages of a range holding an instruction, not a bubble
+ * @param cpu
+ * @param first
+ * @param last
+ * @return
+ */
+static int count_instructions(const APEX_CPU *cpu, enum myEnum first,
+                              enum myEnum last) {
+  int count = 0;
+  for (int i = (int) first; i <= (int) last; ++i) {
+    count += cpu->stage[i].opcode_id != OP_NOP &&
+             cpu->stage[i].opcode_id != OP_EMPTY;
+  }
+  return count;
+}
+
+/**
+ * Tells why a stalled decode stage is stalled
+ * @param decode
+ * @return
+ */
+static inline ALWAYS_INLINE APEX_Stall_Cause decode_stall_cause(const CPU_Stage *decode) {
+  if (decode->stallDueToNextStage) {
+    return STALL_BACKPRESSURE;
+  }
+  if (decode->stallDueToLoadFlag) {
+    return STALL_LOAD_USE;
+  }
+  if (decode->opcode_id == OP_BZ || decode->opcode_id == OP_BNZ) {
+    return STALL_BRANCH_FLAG;
+  }
+  return STALL_DEPENDENCY;
+}
+
+/**
+ * Tells why a stalled stage is stalled
+ * @param cpu
+ * @param stage_id F, DRF or EX
+ * @return
+ */
+static inline ALWAYS_INLINE APEX_Stall_Cause stall_cause(const APEX_CPU *cpu,
+                                                        int stage_id) {
+  switch (stage_id) {
+    case F:
+      return STALL_BACKPRESSURE;
+    case DRF:
+      return decode_stall_cause(&cpu->stage[DRF]);
+    default:
+      return STALL_MUL;
+  }
+}
+
+/**
+ * Adds the stalls the pipeline ends a cycle with to their counters
+ * @param cpu
+ */
+static inline ALWAYS_INLINE void count_stalls(APEX_CPU *cpu) {
+  const CPU_Stage *decode = &cpu->stage[DRF];
+  uint64_t *stall_cycles = cpu->counters.stall_cycles;
+  stall_cycles[STALL_BACKPRESSURE] += cpu->stage[F].stalled;
+  stall_cycles[STALL_MUL] += cpu->stage[EX].stalled;
+  if (decode->stalled) {
+    stall_cycles[decode_stall_cause(decode)]++;
+  }
 }
 
 /**
  * Fetch Stage of APEX Pipeline
  * @param cpu
+ * @param debug
  * @return
  */
-int fetch(APEX_CPU *cpu) {
+static inline ALWAYS_INLINE int fetch_stage(APEX_CPU *cpu, const int debug) {
   CPU_Stage *stage = &cpu->stage[F];
 
   if (!cpu->stage[DRF].stalled && stage->stalled && stage->stallDueToNextStage) {
     stage->stallDueToNextStage = 0;
     stage->stalled = 0;
     cpu->stage[DRF] = cpu->stage[F];
-    if (ENABLE_DEBUG_MESSAGES) {
-      print_stage_content("Fetch", stage);
+    if (debug) {
+      show_stage(cpu, debug, F, stage);
     }
     return 0;
   }
@@ -241,35 +595,20 @@ int fetch(APEX_CPU *cpu) {
     stage->pc = cpu->pc;
 
     /* Index into code memory using this pc and copy all instruction fields into fetch latch*/
-    APEX_Instruction *current_ins = &cpu->code_memory[get_code_index(cpu->pc)];
+    const APEX_Instruction *current_ins = get_code_instruction(cpu, cpu->pc);
 
     /** Accept only valid instructions*/
-    if(
-        !(strcmp(current_ins->opcode, "") == 0 ||
-          strcmp(current_ins->opcode, "ADD") == 0 ||
-          strcmp(current_ins->opcode, "SUB") == 0 ||
-          strcmp(current_ins->opcode, "MUL") == 0 ||
-          strcmp(current_ins->opcode, "AND") == 0 ||
-          strcmp(current_ins->opcode, "OR") == 0 ||
-          strcmp(current_ins->opcode, "EX-OR") == 0 ||
-          strcmp(current_ins->opcode, "MOVC") == 0 ||
-          strcmp(current_ins->opcode, "STORE") == 0 ||
-          strcmp(current_ins->opcode, "LOAD") == 0 ||
-          strcmp(current_ins->opcode, "BZ") == 0 ||
-          strcmp(current_ins->opcode, "BNZ") == 0 ||
-          strcmp(current_ins->opcode, "JUMP") == 0 ||
-          strcmp(current_ins->opcode, "HALT") == 0)
-        ){
+    if (current_ins->opcode_id >= OP_INVALID) {
       return 0;
     }
 
-
-    strcpy(stage->opcode, current_ins->opcode);
+    stage->opcode_id = current_ins->opcode_id;
     stage->rd = current_ins->rd;
     stage->rs1 = current_ins->rs1;
     stage->rs2 = current_ins->rs2;
     stage->imm = current_ins->imm;
-    stage->rdPrev = 999;// dummy garbage value
+    stage->rdPrev = REG_FLUSHED;// dummy garbage value
+    stage->seq = ++cpu->ins_fetched;
 
     /* Update PC for next instruction */
     cpu->pc += 4;
@@ -288,13 +627,13 @@ int fetch(APEX_CPU *cpu) {
       stage->stallDueToNextStage = 1;
     }
 
-    /*if (ENABLE_DEBUG_MESSAGES) {
-      print_stage_content("Fetch", stage);
+    /*if (debug) {
+      print_stage_content(cpu->config.out, "Fetch", stage);
     }*/
   }
 
-  if (ENABLE_DEBUG_MESSAGES) {
-    print_stage_content("Fetch", stage);
+  if (debug) {
+    show_stage(cpu, debug, F, stage);
   }
   return 0;
 }
@@ -302,22 +641,28 @@ int fetch(APEX_CPU *cpu) {
 /**
  * Decode Stage of APEX Pipeline
  * @param cpu
+ * @param forwarding
+ * @param debug
  * @return
  */
-int decode(APEX_CPU *cpu) {
+static inline ALWAYS_INLINE int decode_stage(APEX_CPU *cpu, const int forwarding, const int debug) {
   CPU_Stage *stage = &cpu->stage[DRF];
 
+  /** JUMP & LOAD instruction has only one src reg */
+  int oneSrcReg = stage->opcode_id == OP_JUMP || stage->opcode_id == OP_LOAD;
+
   /** If source regs are valid and available then remove stall of this stage */
-  if(strcmp(stage->opcode, "JUMP") != 0 && strcmp(stage->opcode, "LOAD") != 0){
-    if ((stage->rs1 >= 0 && stage->rs1 < 1000 && cpu->regs_valid[stage->rs1] != 999) &&
-        (stage->rs2 >= 0 && stage->rs2 < 1000 && cpu->regs_valid[stage->rs2] != 999)) {
+  uint32_t sources = REG_BIT(stage->rs1) | REG_BIT(stage->rs2);
+  if (!oneSrcReg) {
+    if (stage->rs1 != REG_NONE && stage->rs2 != REG_NONE &&
+        !(cpu->pending_regs & sources)) {
       stage->stalled = 0;
     }
   }
 
   /** JUMP & LOAD instruction has only one src reg, so checked separately*/
-  if ((strcmp(stage->opcode, "JUMP") == 0 || strcmp(stage->opcode, "LOAD") == 0) &&
-      stage->rs1 >= 0 && stage->rs1 < 1000 && cpu->regs_valid[stage->rs1] != 999) {
+  if (oneSrcReg &&
+      stage->rs1 != REG_NONE && !(cpu->pending_regs & REG_BIT(stage->rs1))) {
     stage->stalled = 0;
   }
 
@@ -329,17 +674,17 @@ int decode(APEX_CPU *cpu) {
 
   /**Check stall status due to BZ instruction*/
   int justRemovedBZStall = 0;
-  if (stage->stalled && strcmp(stage->opcode, "BZ") == 0 && cpu->regs_valid[stage->rdPrev] == 1) {
+  if (stage->stalled && stage->opcode_id == OP_BZ && is_reg_written(cpu, stage->rdPrev)) {
     stage->stalled = 0;
-    stage->rdPrev = 999; //reset rdPrev data;
+    stage->rdPrev = REG_FLUSHED; //reset rdPrev data;
     justRemovedBZStall = 1;
   }
 
   /**Check stall status due to BNZ instruction*/
   int justRemovedBNZStall = 0;
-  if (stage->stalled && strcmp(stage->opcode, "BNZ") == 0 && cpu->regs_valid[stage->rdPrev] == 1) {
+  if (stage->stalled && stage->opcode_id == OP_BNZ && is_reg_written(cpu, stage->rdPrev)) {
     stage->stalled = 0;
-    stage->rdPrev = 999; //reset rdPrev data;
+    stage->rdPrev = REG_FLUSHED; //reset rdPrev data;
     justRemovedBNZStall = 1;
   }
 
@@ -353,9 +698,8 @@ int decode(APEX_CPU *cpu) {
   if (!stage->busy && !stage->stalled) {
 
     /** check for normal flow dependency */
-    if (strcmp(stage->opcode, "") != 0 &&
-        (cpu->regs_valid[stage->rs1] == 999 || cpu->regs_valid[stage->rs2] == 999)) {
-      if (!DATA_FORWARDING_ENABLED) {
+    if (stage->opcode_id != OP_EMPTY && (cpu->pending_regs & sources)) {
+      if (!forwarding) {
         /**If data forwarding is not enabled then stall the stage and go for orthodox way*/
         stage->stalled = 1;
       } else {
@@ -365,75 +709,82 @@ int decode(APEX_CPU *cpu) {
     }
 
     /** set dependency flag */
-    if (strcmp(stage->opcode, "") != 0 &&
-        !stage->stalled && stage->rd >= 0 && stage->rd < 1000) {
-      cpu->regs_valid[stage->rd] = 999;
-    }
-
-    /* No Register file read needed for MOVC */
-    if (strcmp(stage->opcode, "MOVC") == 0) {
-      /*No Operation here*/
-    }
-
-    /* No Register file read needed for JUMP */
-    if (strcmp(stage->opcode, "JUMP") == 0) {
-      stage->rs1_value = cpu->regs[stage->rs1];
-    }
-
-    /* No Register file read needed for HALT */
-    if (strcmp(stage->opcode, "HALT") == 0) {
-      //no action here. handling done in next stage.
+    if (stage->opcode_id != OP_EMPTY &&
+        !stage->stalled && stage->rd != REG_NONE) {
+      set_reg_pending(cpu, stage->rd);
     }
 
-    /* Read data from register file for store */
-    if (strcmp(stage->opcode, "STORE") == 0) {
-      stage->rs1_value = cpu->regs[stage->rs1];
-      stage->rs2_value = cpu->regs[stage->rs2];
-    }
-
-    /* Read data from register file for store */
-    if (strcmp(stage->opcode, "LOAD") == 0) {
-      stage->rs1_value = cpu->regs[stage->rs1];
-    }
-
-    /* Read data from register file for
-     * ADD, SUB, MUL, AND, OR ,EX-OR*/
-    if (
-        strcmp(stage->opcode, "ADD") == 0 ||
-        strcmp(stage->opcode, "SUB") == 0 ||
-        strcmp(stage->opcode, "MUL") == 0 ||
-        strcmp(stage->opcode, "AND") == 0 ||
-        strcmp(stage->opcode, "EX-OR") == 0 ||
-        strcmp(stage->opcode, "OR") == 0
-        ) {
-      stage->rs1_value = cpu->regs[stage->rs1];
-      stage->rs2_value = cpu->regs[stage->rs2];
-    }
-
-    /* BZ */
-    if (strcmp(stage->opcode, "BZ") == 0 && !DATA_FORWARDING_ENABLED) {
-      if (justRemovedBZStall == 1) {
-        stage->handleBZInNextStage = 1;
-        stage->zFlag = cpu->zFlag;
-      } else {
-        stage->stalled = 1;
-        stage->rdPrev = cpu->stage[EX].rd;
-        stage->handleBZInNextStage = 0;
-        stage->zFlag = 999;
-      }
-    }
+    switch (stage->opcode_id) {
+      /* No Register file read needed for MOVC */
+      case OP_MOVC:
+        /*No Operation here*/
+        break;
+
+      /* Read data from register file for JUMP */
+      case OP_JUMP:
+        stage->rs1_value = cpu->regs[stage->rs1];
+        break;
+
+      /* No Register file read needed for HALT */
+      case OP_HALT:
+        //no action here. handling done in next stage.
+        break;
+
+      /* Read data from register file for store */
+      case OP_STORE:
+        stage->rs1_value = cpu->regs[stage->rs1];
+        stage->rs2_value = cpu->regs[stage->rs2];
+        break;
+
+      /* Read data from register file for load */
+      case OP_LOAD:
+        stage->rs1_value = cpu->regs[stage->rs1];
+        break;
+
+      /* Read data from register file for
+       * ADD, SUB, MUL, AND, OR ,EX-OR*/
+      case OP_ADD:
+      case OP_SUB:
+      case OP_MUL:
+      case OP_AND:
+      case OP_EX_OR:
+      case OP_OR:
+        stage->rs1_value = cpu->regs[stage->rs1];
+        stage->rs2_value = cpu->regs[stage->rs2];
+        break;
+
+      /* BZ */
+      case OP_BZ:
+        if (!forwarding) {
+          if (justRemovedBZStall == 1) {
+            stage->handleBZInNextStage = 1;
+            stage->zFlag = cpu->zFlag;
+          } else {
+            stage->stalled = 1;
+            stage->rdPrev = cpu->stage[EX].rd;
+            stage->handleBZInNextStage = 0;
+            stage->zFlag = 999;
+          }
+        }
+        break;
+
+      /* BNZ */
+      case OP_BNZ:
+        if (!forwarding) {
+          if (justRemovedBNZStall == 1) {
+            stage->handleBNZInNextStage = 1;
+            stage->zFlag = cpu->zFlag;
+          } else {
+            stage->stalled = 1;
+            stage->rdPrev = cpu->stage[EX].rd;
+            stage->handleBNZInNextStage = 0;
+            stage->zFlag = 999;
+          }
+        }
+        break;
 
-    /* BNZ */
-    if (strcmp(stage->opcode, "BNZ") == 0 && !DATA_FORWARDING_ENABLED) {
-      if (justRemovedBNZStall == 1) {
-        stage->handleBNZInNextStage = 1;
-        stage->zFlag = cpu->zFlag;
-      } else {
-        stage->stalled = 1;
-        stage->rdPrev = cpu->stage[EX].rd;
-        stage->handleBNZInNextStage = 0;
-        stage->zFlag = 999;
-      }
+      default:
+        break;
     }
 
     if (getDataForwardedSrcValues) {
@@ -441,96 +792,45 @@ int decode(APEX_CPU *cpu) {
       int justStalledForBonusLoad = 0;
 
       /**Main Logic*/
-      if (cpu->regs_valid[stage->rs1] == 999) {
-
-        if(strcmp(stage->opcode, "STORE") == 0 && stage->rs1 != stage->rs2){
-          if (cpu->stage[MEM].rd == stage->rs1) {
-            stage->rs1_value = cpu->stage[MEM].buffer;
-          }
-
-          //If dependency is due to instruction from stage EX then take its buffer value
-          else if (cpu->stage[WB].rd == stage->rs1) {
-            stage->rs1_value = cpu->stage[WB].buffer;
-          }
-          valueFilled = 1;
-          goto endOfIf;
-        }
-
-        /**If dependency is due to instruction from stage EX then take its buffer value*/
-        if (cpu->stage[EX].rd == stage->rs1) {
-          if(stage->stallDueToLoadFlag){
-            if(strcmp(cpu->stage[MEM].opcode, "LOAD") == 0){
-              stage->rs1_value = cpu->data_memory[cpu->stage[MEM].mem_address];
-              stage->stalled = 0;
-              stage->stallDueToLoadFlag = 0;
-              valueFilled = 1;
-            } else{
-              stage->stalled=1;
-            }
-
-          }else{
-            stage->rs1_value = cpu->stage[EX].buffer;
-            if(strcmp(cpu->stage[EX].opcode, "LOAD") == 0){
-              stage->stalled = 1;
-              stage->stallDueToLoadFlag = 1;
-              justStalledForBonusLoad = 1;
-              valueFilled = 0;
-            }else{
-              valueFilled = 1;
-            }
-          }
-        }
+      if (cpu->pending_regs & REG_BIT(stage->rs1)) {
+        unsigned int from = find_producers(cpu, stage->rs1);
 
-          /**If dependency is due to instruction from stage EX then take its buffer value*/
-        else if (cpu->stage[MEM].rd == stage->rs1) {
-          stage->rs1_value = cpu->stage[MEM].buffer;
+        /** STORE of a register other than its address register only takes
+         * it from MEM or WB, and goes ahead either way */
+        if (stage->opcode_id == OP_STORE && stage->rs1 != stage->rs2) {
+          from &= ~FROM_EX;
           valueFilled = 1;
         }
 
-          /**If dependency is due to instruction from stage EX then take its buffer value*/
-        else if (cpu->stage[WB].rd == stage->rs1) {
-          stage->rs1_value = cpu->stage[WB].buffer;
-          valueFilled = 1;
+        switch (nearest_producer(from)) {
+          case FROM_EX:
+            justStalledForBonusLoad =
+                forward_from_ex(cpu, stage, &stage->rs1_value, &valueFilled);
+            break;
+          case FROM_MEM:
+            stage->rs1_value = cpu->stage[MEM].buffer;
+            valueFilled = 1;
+            break;
+          case FROM_WB:
+            stage->rs1_value = cpu->stage[WB].buffer;
+            valueFilled = 1;
+            break;
         }
-
-        endOfIf:;
       }
 
-      if (cpu->regs_valid[stage->rs2] == 999 && !justStalledForBonusLoad) {
-
-        /**If dependency is due to instruction from stage EX then take its buffer value*/
-        if (cpu->stage[EX].rd == stage->rs2) {
-          if(stage->stallDueToLoadFlag){
-            if(strcmp(cpu->stage[MEM].opcode, "LOAD") == 0){
-              stage->rs2_value = cpu->data_memory[cpu->stage[MEM].mem_address];
-              stage->stalled = 0;
-              stage->stallDueToLoadFlag = 0;
-              valueFilled = 1;
-            } else{
-              stage->stalled=1;
-            }
-          } else{
-            stage->rs2_value = cpu->stage[EX].buffer;
-            if(strcmp(cpu->stage[EX].opcode, "LOAD") == 0){
-              stage->stalled = 1;
-              stage->stallDueToLoadFlag = 1;
-              valueFilled = 0;
-            }else{
-              valueFilled = 1;
-            }
-          }
-        }
-
-          /**If dependency is due to instruction from stage EX then take its buffer value*/
-        else if (cpu->stage[MEM].rd == stage->rs2) {
-          valueFilled = 1;
-          stage->rs2_value = cpu->stage[MEM].buffer;
-        }
-
-          /**If dependency is due to instruction from stage EX then take its buffer value*/
-        else if (cpu->stage[WB].rd == stage->rs2) {
-          stage->rs2_value = cpu->stage[WB].buffer;
-          valueFilled = 1;
+      if ((cpu->pending_regs & REG_BIT(stage->rs2)) && !justStalledForBonusLoad) {
+        switch (nearest_producer(find_producers(cpu, stage->rs2))) {
+          case FROM_EX:
+            forward_from_ex(cpu, stage, &stage->rs2_value, &valueFilled);
+            break;
+          case FROM_MEM:
+            stage->rs2_value = cpu->stage[MEM].buffer;
+            valueFilled = 1;
+            break;
+          case FROM_WB:
+            stage->rs2_value = cpu->stage[WB].buffer;
+            valueFilled = 1;
+            break;
         }
       }
 
@@ -549,13 +849,13 @@ int decode(APEX_CPU *cpu) {
       stage->stallDueToNextStage = 1;
     }
 
-    /*if (ENABLE_DEBUG_MESSAGES) {
-      print_stage_content("Decode/RF", stage);
+    /*if (debug) {
+      print_stage_content(cpu->config.out, "Decode/RF", stage);
     }*/
   }
 
-  if (ENABLE_DEBUG_MESSAGES) {
-    print_stage_content("Decode/RF", stage);
+  if (debug) {
+    show_stage(cpu, debug, DRF, stage);
   }
   return 0;
 }
@@ -563,128 +863,134 @@ int decode(APEX_CPU *cpu) {
 /**
  * Execute Stage of APEX Pipeline
  * @param cpu
+ * @param forwarding
+ * @param debug
  * @return
  */
-int execute(APEX_CPU *cpu) {
+static inline ALWAYS_INLINE int execute_stage(APEX_CPU *cpu, const int forwarding, const int debug) {
   CPU_Stage *stage = &cpu->stage[EX];
 
 
-  /*Check stall status due to MUL instruction*/
+  /*Check stall status due to MUL instruction, held for mul_latency cycles*/
   int justRemovedMULStall = 0;
-  if (stage->stalled && strcmp(stage->opcode, "MUL") == 0) {
+  if (stage->stalled && stage->opcode_id == OP_MUL &&
+      ++stage->mulCycles >= cpu->config.mul_latency - 1) {
     stage->stalled = 0;
     justRemovedMULStall = 1;
   }
 
   if (!stage->busy && !stage->stalled) {
 
-    /* Store */
-    if (strcmp(stage->opcode, "STORE") == 0) {
-      //calculate (src2 + literal)
-      stage->mem_address = stage->rs2_value + stage->imm;
-
-      if (cpu->stage[MEM].rd == stage->rs1) {
-        stage->rs1_value = cpu->stage[MEM].buffer;
-      }
-
-      //If dependency is due to instruction from stage EX then take its buffer value
-      else if (cpu->stage[WB].rd == stage->rs1) {
-        stage->rs1_value = cpu->stage[WB].buffer;
-      }
-    }
-
-    /* LOAD */
-    if (strcmp(stage->opcode, "LOAD") == 0) {
-      //calculate (src2 + literal)
-      stage->mem_address = stage->rs1_value + stage->imm;
-    }
-
-    /* MOVC */
-    if (strcmp(stage->opcode, "MOVC") == 0) {
-      stage->buffer = stage->imm;
-    }
-
-    /* ADD */
-    if (strcmp(stage->opcode, "ADD") == 0) {
-      stage->buffer = stage->rs1_value + stage->rs2_value;
-    }
-
-    /* SUB */
-    if (strcmp(stage->opcode, "SUB") == 0) {
-      stage->buffer = stage->rs1_value - stage->rs2_value;
-    }
-
-    /* MUL */
-    if (strcmp(stage->opcode, "MUL") == 0) {
-      stage->buffer = stage->rs1_value * stage->rs2_value;
-
-      if (!justRemovedMULStall) {
-        stage->stalled = 1;
-      }
-    }
-
-    /* AND */
-    if (strcmp(stage->opcode, "AND") == 0) {
-      stage->buffer = stage->rs1_value & stage->rs2_value;
-    }
-
-    /* OR */
-    if (strcmp(stage->opcode, "OR") == 0) {
-      stage->buffer = stage->rs1_value | stage->rs2_value;
-    }
+    switch (stage->opcode_id) {
+      /* Store */
+      case OP_STORE:
+        //calculate (src2 + literal)
+        stage->mem_address = stage->rs2_value + stage->imm;
 
-    /* EX-OR */
-    if (strcmp(stage->opcode, "EX-OR") == 0) {
-      stage->buffer = stage->rs1_value ^ stage->rs2_value;
-    }
-
-    /* BZ */
-    if (strcmp(stage->opcode, "BZ") == 0) {
-      if (DATA_FORWARDING_ENABLED) {
-        if (cpu->stage[MEM].buffer == 0) {
-          bzBnzBranchHandling(cpu, EX);
-        }
-      } else {
-        if (stage->handleBZInNextStage && stage->zFlag == 0) {
-          stage->handleBZInNextStage = 0;
-          stage->zFlag = 999;
-          bzBnzBranchHandling(cpu, EX);
+        if (cpu->stage[MEM].rd == stage->rs1) {
+          stage->rs1_value = cpu->stage[MEM].buffer;
         }
-      }
-    }
 
-    /* BNZ */
-    if (strcmp(stage->opcode, "BNZ") == 0) {
-      if (DATA_FORWARDING_ENABLED) {
-        if (cpu->stage[MEM].buffer != 0) {
-          bzBnzBranchHandling(cpu, EX);
+        //If dependency is due to instruction from stage EX then take its buffer value
+        else if (cpu->stage[WB].rd == stage->rs1) {
+          stage->rs1_value = cpu->stage[WB].buffer;
         }
-      } else {
-        if (stage->handleBNZInNextStage && stage->zFlag != 0) {
-          stage->handleBNZInNextStage = 0;
-          stage->zFlag = 999;
-          bzBnzBranchHandling(cpu, EX);
+        break;
+
+      /* LOAD */
+      case OP_LOAD:
+        //calculate (src2 + literal)
+        stage->mem_address = stage->rs1_value + stage->imm;
+        break;
+
+      /* MOVC */
+      case OP_MOVC:
+        stage->buffer = stage->imm;
+        break;
+
+      /* ADD */
+      case OP_ADD:
+        stage->buffer = stage->rs1_value + stage->rs2_value;
+        break;
+
+      /* SUB */
+      case OP_SUB:
+        stage->buffer = stage->rs1_value - stage->rs2_value;
+        break;
+
+      /* MUL */
+      case OP_MUL:
+        stage->buffer = stage->rs1_value * stage->rs2_value;
+
+        if (!justRemovedMULStall && cpu->config.mul_latency > 1) {
+          stage->stalled = 1;
+          stage->mulCycles = 0;
         }
-      }
-    }
-
-    /* JUMP */
-    if (strcmp(stage->opcode, "JUMP") == 0) {
-      stage->handleJumpInNextStage = 1;
-    }
+        break;
+
+      /* AND */
+      case OP_AND:
+        stage->buffer = stage->rs1_value & stage->rs2_value;
+        break;
+
+      /* OR */
+      case OP_OR:
+        stage->buffer = stage->rs1_value | stage->rs2_value;
+        break;
+
+      /* EX-OR */
+      case OP_EX_OR:
+        stage->buffer = stage->rs1_value ^ stage->rs2_value;
+        break;
+
+      /* BZ */
+      case OP_BZ:
+        if (forwarding) {
+          if (cpu->stage[MEM].buffer == 0) {
+            bzBnzBranchHandling(cpu, EX);
+          }
+        } else {
+          if (stage->handleBZInNextStage && stage->zFlag == 0) {
+            stage->handleBZInNextStage = 0;
+            stage->zFlag = 999;
+            bzBnzBranchHandling(cpu, EX);
+          }
+        }
+        break;
 
-    /* HALT */
-    if (strcmp(stage->opcode, "HALT") == 0) {
-      flushStageWithEmpty(cpu, F);
-      flushStageWithEmpty(cpu, DRF);
-      cpu->ins_completed = cpu->code_memory_size - 2;
-      cpu->haltFlag = 1;
+      /* BNZ */
+      case OP_BNZ:
+        if (forwarding) {
+          if (cpu->stage[MEM].buffer != 0) {
+            bzBnzBranchHandling(cpu, EX);
+          }
+        } else {
+          if (stage->handleBNZInNextStage && stage->zFlag != 0) {
+            stage->handleBNZInNextStage = 0;
+            stage->zFlag = 999;
+            bzBnzBranchHandling(cpu, EX);
+          }
+        }
+        break;
+
+      /* JUMP */
+      case OP_JUMP:
+        stage->handleJumpInNextStage = 1;
+        break;
+
+      /* HALT */
+      case OP_HALT:
+        flushStageWithEmpty(cpu, F);
+        flushStageWithEmpty(cpu, DRF);
+        cpu->ins_completed = cpu->code_memory_size - 2;
+        cpu->haltFlag = 1;
+        break;
+
+      default:
+        break;
     }
 
-    int isMeBranchInstr = 0;
-    if (strcmp(stage->opcode, "BNZ") == 0 || strcmp(stage->opcode, "BZ") == 0) {
-      isMeBranchInstr = 1;
-    }
+    int isMeBranchInstr = stage->opcode_id == OP_BNZ || stage->opcode_id == OP_BZ;
 
     if (!stage->stalled && !isMeBranchInstr && cpu->stage[DRF].stalled && !cpu->stage[DRF].stallDueToNextStage) {
       flushStageWithNOP(cpu, EX, 1, 0);
@@ -695,13 +1001,13 @@ int execute(APEX_CPU *cpu) {
       cpu->stage[MEM] = cpu->stage[EX];
     }
 
-    /*if (ENABLE_DEBUG_MESSAGES) {
-      print_stage_content("Execute", stage);
+    /*if (debug) {
+      print_stage_content(cpu->config.out, "Execute", stage);
     }*/
   }
 
-  if (ENABLE_DEBUG_MESSAGES) {
-    print_stage_content("Execute", stage);
+  if (debug) {
+    show_stage(cpu, debug, EX, stage);
   }
 
   return 0;
@@ -710,52 +1016,34 @@ int execute(APEX_CPU *cpu) {
 /**
  * Memory Stage of APEX Pipeline
  * @param cpu
+ * @param debug
  * @return
  */
-int memory(APEX_CPU *cpu) {
+static inline ALWAYS_INLINE int memory_stage(APEX_CPU *cpu, const int debug) {
   CPU_Stage *stage = &cpu->stage[MEM];
 
   if (!stage->busy && !stage->stalled) {
 
-    /* Store */
-    if (strcmp(stage->opcode, "STORE") == 0) {
-      cpu->data_memory[stage->mem_address] = stage->rs1_value;
-    }
-
-    /* Load */
-    if (strcmp(stage->opcode, "LOAD") == 0) {
-      stage->buffer = cpu->data_memory[stage->mem_address];
-    }
-
-    /* MOVC */
-    if (strcmp(stage->opcode, "MOVC") == 0) {
-      /** No memory operation in this stage*/
-    }
-
-    /* BZ, BNZ, JUMP*/
-    if (
-        strcmp(stage->opcode, "BZ") == 0 ||
-        strcmp(stage->opcode, "JUMP") == 0 ||
-        strcmp(stage->opcode, "HALT") == 0 ||
-        strcmp(stage->opcode, "BNZ") == 0
-        ) {
-      /** No memory operation in this stage*/
-    }
-
-    /* ADD, SUB, MUL, AND, EX-OR, OR*/
-    if (
-        strcmp(stage->opcode, "ADD") == 0 ||
-        strcmp(stage->opcode, "SUB") == 0 ||
-        strcmp(stage->opcode, "MUL") == 0 ||
-        strcmp(stage->opcode, "AND") == 0 ||
-        strcmp(stage->opcode, "EX-OR") == 0 ||
-        strcmp(stage->opcode, "OR") == 0
-        ) {
-      /** No memory operation in this stage*/
+    switch (stage->opcode_id) {
+      /* Store */
+      case OP_STORE:
+        memory_store(&cpu->data_memory, stage->mem_address, stage->rs1_value);
+        break;
+
+      /* Load */
+      case OP_LOAD:
+        stage->buffer = memory_load(&cpu->data_memory, stage->mem_address);
+        break;
+
+      /* MOVC, BZ, BNZ, JUMP, HALT, ADD, SUB, MUL, AND, EX-OR, OR */
+      default:
+        /** No memory operation in this stage*/
+        break;
     }
 
     /*Flush DRF and F stage data to NOP due to branch instruction*/
     if (stage->flushInNextStage) {
+      cpu->counters.flushed_branch += count_instructions(cpu, DRF, EX);
       int dontChangeValid = 0;
       flushStageWithNOP(cpu, DRF, dontChangeValid, 0);
       flushStageWithNOP(cpu, EX, dontChangeValid, 0);
@@ -766,6 +1054,8 @@ int memory(APEX_CPU *cpu) {
     if (stage->handleJumpInNextStage) {
       cpu->pc = stage->rs1_value + stage->imm;
       cpu->ins_completed = get_code_index(cpu->pc) - 1;
+      cpu->counters.jumps++;
+      cpu->counters.flushed_jump += count_instructions(cpu, DRF, EX);
 
       int dontChangeValid = 0;
       flushStageWithNOP(cpu, DRF, dontChangeValid, 1);
@@ -781,8 +1071,8 @@ int memory(APEX_CPU *cpu) {
     /* Copy data from decode latch to execute latch*/
     cpu->stage[WB] = cpu->stage[MEM];
 
-    if (ENABLE_DEBUG_MESSAGES) {
-      print_stage_content("Memory", stage);
+    if (debug) {
+      show_stage(cpu, debug, MEM, stage);
     }
   }
   return 0;
@@ -791,54 +1081,414 @@ int memory(APEX_CPU *cpu) {
 /**
  * Writeback Stage of APEX Pipeline
  * @param cpu
+ * @param debug
  * @return
  */
-int writeback(APEX_CPU *cpu) {
+static inline ALWAYS_INLINE int writeback_stage(APEX_CPU *cpu, const int debug) {
   CPU_Stage *stage = &cpu->stage[WB];
   if (!stage->busy && !stage->stalled) {
 
     /* Update register file */
-    if (
-        strcmp(stage->opcode, "MOVC") == 0 ||
-        strcmp(stage->opcode, "ADD") == 0 ||
-        strcmp(stage->opcode, "SUB") == 0 ||
-        strcmp(stage->opcode, "MUL") == 0 ||
-        strcmp(stage->opcode, "AND") == 0 ||
-        strcmp(stage->opcode, "EX-OR") == 0 ||
-        strcmp(stage->opcode, "OR") == 0 ||
-        strcmp(stage->opcode, "LOAD") == 0
-        ) {
-      cpu->regs[stage->rd] = stage->buffer;
+    switch (stage->opcode_id) {
+      case OP_MOVC:
+      case OP_ADD:
+      case OP_SUB:
+      case OP_MUL:
+      case OP_AND:
+      case OP_EX_OR:
+      case OP_OR:
+      case OP_LOAD:
+        cpu->regs[stage->rd] = stage->buffer;
+        break;
+
+      default:
+        break;
     }
 
     /* Set Z flag for arithmetic instructions*/
-    if (
-        strcmp(stage->opcode, "ADD") == 0 ||
-        strcmp(stage->opcode, "SUB") == 0 ||
-        strcmp(stage->opcode, "MUL") == 0
-        ) {
-      /** If valid instruction, then set result in zFlag*/
-      cpu->zFlag = stage->buffer;
-    } else {
-      /** otherwise set garbage result in zFlag*/
-      cpu->zFlag = 999;
+    switch (stage->opcode_id) {
+      case OP_ADD:
+      case OP_SUB:
+      case OP_MUL:
+        /** If valid instruction, then set result in zFlag*/
+        cpu->zFlag = stage->buffer;
+        break;
+
+      default:
+        /** otherwise set garbage result in zFlag*/
+        cpu->zFlag = 999;
+        break;
     }
 
     if(!(stage->rd == cpu->stage[DRF].rd || stage->rd == cpu->stage[EX].rd)){
-      cpu->regs_valid[stage->rd] = 1;
+      set_reg_written(cpu, stage->rd);
     }
 
-    if (strcmp(stage->opcode, "NOP") != 0) {
+    if (stage->opcode_id != OP_NOP) {
       cpu->ins_completed++;
     }
+    /** EX can hand the same instruction down again while it waits, so an
+     * instruction retires only the first time it gets here */
+    if (stage->opcode_id != OP_NOP && stage->opcode_id != OP_EMPTY &&
+        stage->seq > cpu->last_retired) {
+      cpu->last_retired = stage->seq;
+      cpu->ins_retired++;
+      cpu->counters.retired[stage->opcode_id]++;
+    }
 
-    if (ENABLE_DEBUG_MESSAGES) {
-      print_stage_content("Writeback", stage);
+    if (debug) {
+      show_stage(cpu, debug, WB, stage);
     }
   }
   return 0;
 }
 
+int fetch(APEX_CPU *cpu) {
+  return fetch_stage(cpu, cpu->config.debug_messages);
+}
+
+int decode(APEX_CPU *cpu) {
+  return decode_stage(cpu, cpu->config.data_forwarding,
+                      cpu->config.debug_messages);
+}
+
+int execute(APEX_CPU *cpu) {
+  return execute_stage(cpu, cpu->config.data_forwarding,
+                       cpu->config.debug_messages);
+}
+
+int memory(APEX_CPU *cpu) {
+  return memory_stage(cpu, cpu->config.debug_messages);
+}
+
+int writeback(APEX_CPU *cpu) {
+  return writeback_stage(cpu, cpu->config.debug_messages);
+}
+
+/**
+ * One clock cycle with forwarding and debug fixed, so that the compiler
+ * drops the branches on them from the stage bodies
+ * @param cpu
+ * @param forwarding
+ * @param debug DEBUG_PRINT and DEBUG_TRACE bits
+ */
+static inline ALWAYS_INLINE void cycle(APEX_CPU *cpu, const int forwarding,
+                                       const int debug) {
+  if (debug & DEBUG_PRINT) {
+    fprintf(cpu->config.out, "--------------------------------\n");
+    fprintf(cpu->config.out, "Clock Cycle #: %d\n", cpu->clock+1);// only display count of Clock cycle is increased.
+    fprintf(cpu->config.out, "--------------------------------\n");
+  }
+  if (debug & DEBUG_TRACE) {
+    APEX_Trace_Record *record = trace_writer_next(cpu->trace);
+    record->clock = cpu->clock + 1;
+    record->kind = TRACE_CYCLE;
+    record->shown = 0;
+    cpu->trace_record = record;
+  }
+
+  INSTRUMENT_START(start);
+  writeback_stage(cpu, debug);
+  INSTRUMENT_LAP(INSTR_WRITEBACK, start);
+  memory_stage(cpu, debug);
+  INSTRUMENT_LAP(INSTR_MEMORY, start);
+  execute_stage(cpu, forwarding, debug);
+  INSTRUMENT_LAP(INSTR_EXECUTE, start);
+  decode_stage(cpu, forwarding, debug);
+  INSTRUMENT_LAP(INSTR_DECODE, start);
+  fetch_stage(cpu, debug);
+  INSTRUMENT_LAP(INSTR_FETCH, start);
+  cpu->clock++;
+  count_stalls(cpu);
+
+  if (debug & DEBUG_TRACE) {
+    APEX_Trace_Record *record = cpu->trace_record;
+    record->stalled = 0;
+    record->flushed = 0;
+    for (int i = 0; i < NUM_STAGES; ++i) {
+      record->stalled |= cpu->stage[i].stalled << i;
+      record->flushed |= cpu->stage[i].flushInNextStage << i;
+    }
+    trace_writer_commit(cpu->trace);
+  }
+}
+
+#define CYCLE_FUNCTION(name, forwarding, debug) \
+  static void name(APEX_CPU *cpu) {             \
+    cycle(cpu, forwarding, debug);              \
+  }
+
+CYCLE_FUNCTION(cycle_forwarding, 1, 0)
+CYCLE_FUNCTION(cycle_forwarding_debug, 1, DEBUG_PRINT)
+CYCLE_FUNCTION(cycle_forwarding_trace, 1, DEBUG_TRACE)
+CYCLE_FUNCTION(cycle_forwarding_debug_trace, 1, DEBUG_PRINT | DEBUG_TRACE)
+CYCLE_FUNCTION(cycle_stalling, 0, 0)
+CYCLE_FUNCTION(cycle_stalling_debug, 0, DEBUG_PRINT)
+CYCLE_FUNCTION(cycle_stalling_trace, 0, DEBUG_TRACE)
+CYCLE_FUNCTION(cycle_stalling_debug_trace, 0, DEBUG_PRINT | DEBUG_TRACE)
+
+typedef void (*Cycle_Function)(APEX_CPU *cpu);
+
+/* Indexed by data_forwarding and by the debug bits */
+static const Cycle_Function cycle_functions[2][4] = {
+  {cycle_stalling, cycle_stalling_debug, cycle_stalling_trace,
+   cycle_stalling_debug_trace},
+  {cycle_forwarding, cycle_forwarding_debug, cycle_forwarding_trace,
+   cycle_forwarding_debug_trace},
+};
+
+/**
+ * Picks the cycle function for the current configuration. Loops pick it
+ * once, so the configuration must not change while they run.
+ * @param cpu
+ * @return
+ */
+static Cycle_Function select_cycle(const APEX_CPU *cpu) {
+  int debug = (cpu->config.debug_messages ? DEBUG_PRINT : 0) |
+              (cpu->trace ? DEBUG_TRACE : 0);
+  return cycle_functions[cpu->config.data_forwarding != 0][debug];
+}
+
+/**
+ * Prints a register file and the first words of a data memory as
+ * display does once the run stops
+ * @param out
+ * @param regs R0 to R15
+ * @param pending_regs scoreboard bits of registers still to be written
+ * @param data_memory
+ * @param data_memory_words words to print
+ */
+void print_state(FILE *out, const int *regs, uint32_t pending_regs,
+                 const int *data_memory, int data_memory_words) {
+  fprintf(out, "=========STATE OF ARCHITECTURAL REGISTER FILE============\n");
+  for (int i = 0; i < 16; i++) {
+    char *validStr = "Valid";
+    if ((pending_regs & REG_BIT(i)) && i != 0) { //check i!=0
+      validStr = "Invalid";
+    }
+    fprintf(out, " |\tREG[%d]\t|\tValue = %-5d\t|\tStatus = %-8s\t|\n", i, regs[i], validStr);
+  }
+
+  fprintf(out, "\n=========STATE OF DATA MEMORY============\n");
+  for (int i = 0; i < data_memory_words; i++) {
+    fprintf(out, "\t|\tMRM[%d]\t|\tValue = %d\t|\n", i, data_memory[i]);
+  }
+}
+
+/**
+ * Prints the register file and the first 100 words of data memory
+ * @param cpu
+ */
+static void print_architectural_state(APEX_CPU *cpu) {
+  if (!cpu->config.out) {
+    return;
+  }
+  int words = cpu->data_memory.size < 100 ? cpu->data_memory.size : 100;
+  int data_memory[100];
+  memory_read(&cpu->data_memory, 0, words, data_memory);
+  print_state(cpu->config.out, cpu->regs, cpu->pending_regs, data_memory, words);
+}
+
+/**
+ * Advances the pipeline by one clock cycle
+ * @param cpu
+ */
+void APEX_cpu_cycle(APEX_CPU *cpu) {
+  select_cycle(cpu)(cpu);
+}
+
+/**
+ * Runs the pipeline for up to cycles cycles, stopping early once the
+ * program completes as APEX_cpu_run does, but printing nothing. Sets
+ * finished if the program has completed.
+ * @param cpu
+ * @param cycles
+ * @return number of cycles run
+ */
+uint64_t APEX_cpu_step(APEX_CPU *cpu, uint64_t cycles) {
+  Cycle_Function cycle_function = select_cycle(cpu);
+  uint64_t run = 0;
+  for (; run < cycles && cpu->ins_completed != cpu->code_memory_size; ++run) {
+    cycle_function(cpu);
+  }
+  if (cpu->ins_completed == cpu->code_memory_size) {
+    cpu->finished = 1;
+  }
+  return run;
+}
+
+/**
+ * Runs the pipeline until it has retired warmup + count more instructions,
+ * or until HALT retires and the run completes as in APEX_cpu_run. Used to time a stretch of a program that the
+ * functional mode has run from the same state; should the pipeline take
+ * another path and not get that far, it is given up on after
+ * MAX_TIMED_CPI cycles per instruction.
+ * @param cpu
+ * @param warmup instructions run first and not timed
+ * @param count
+ * @param cycles set to the cycles taken by the instructions past warmup
+ * @return number of instructions retired past warmup
+ */
+uint64_t APEX_cpu_run_timed(APEX_CPU *cpu, uint64_t warmup, uint64_t count,
+                            uint64_t *cycles) {
+  uint64_t start = cpu->ins_retired;
+  uint64_t target = warmup + count;
+  uint64_t max_cycles = MAX_TIMED_CPI * target + NUM_STAGES;
+  int start_clock = cpu->clock;
+
+  /** Timing starts as the last warmup instruction retires */
+  int timed_clock = start_clock;
+  int timing = warmup == 0;
+  Cycle_Function cycle_function = select_cycle(cpu);
+
+  while (cpu->ins_retired - start < target &&
+         (uint64_t) (cpu->clock - start_clock) < max_cycles) {
+    cycle_function(cpu);
+    if (!timing && cpu->ins_retired - start >= warmup) {
+      timed_clock = cpu->clock;
+      timing = 1;
+    }
+
+    CPU_Stage *wb = &cpu->stage[WB];
+    if (!wb->busy && !wb->stalled && wb->opcode_id == OP_HALT) {
+      break;
+    }
+  }
+
+  /** After HALT, count the cycles APEX_cpu_run takes to complete */
+  while (cpu->haltFlag && cpu->ins_completed != cpu->code_memory_size &&
+         (uint64_t) (cpu->clock - start_clock) < max_cycles) {
+    cycle_function(cpu);
+  }
+
+  if (cpu->ins_retired - start <= warmup) {
+    *cycles = 0;
+    return 0;
+  }
+  *cycles = cpu->clock - timed_clock;
+  return cpu->ins_retired - start - warmup;
+}
+
+/**
+ * Code memory index of the instruction in a stage
+ * @param cpu
+ * @param stage
+ * @return -1 for a bubble
+ */
+static inline int stage_code_index(const APEX_CPU *cpu, const CPU_Stage *stage) {
+  if (stage->opcode_id == OP_NOP || stage->opcode_id == OP_EMPTY) {
+    return -1;
+  }
+  unsigned int index = (unsigned int) (stage->pc - 4000) / 4;
+  return index < (unsigned int) cpu->code_memory_size ? (int) index : -1;
+}
+
+/**
+ * Counts for the profile the instruction writeback retires in the cycle
+ * about to run. It has been the oldest instruction in flight since the
+ * last one retired, so those cycles are its.
+ * @param cpu
+ */
+static inline ALWAYS_INLINE void profile_retire(APEX_CPU *cpu) {
+  const CPU_Stage *stage = &cpu->stage[WB];
+  if (!stage->busy && !stage->stalled) {
+    int index = stage_code_index(cpu, stage);
+    if (index >= 0) {
+      APEX_Profile *profile = cpu->profile;
+      APEX_Profile_Entry *entry = &profile->entries[index];
+      entry->retired++;
+      entry->cycles += cpu->clock + 1 - profile->last_retire_clock;
+      profile->last_retire_clock = cpu->clock + 1;
+    }
+  }
+}
+
+/**
+ * Oldest instruction in flight
+ * @param cpu
+ * @return its stage, or -1 if there is none
+ */
+static int oldest_stage(const APEX_CPU *cpu) {
+  for (int i = WB; i >= F; --i) {
+    if (stage_code_index(cpu, &cpu->stage[i]) >= 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Counts for the profile the stalls a cycle ended with, see
+ * profile_stalls
+ * @param cpu
+ */
+static void profile_stalled(APEX_CPU *cpu) {
+  APEX_Profile *profile = cpu->profile;
+  for (int i = F; i <= EX; ++i) {
+    int index = stage_code_index(cpu, &cpu->stage[i]);
+    if (cpu->stage[i].stalled && index >= 0) {
+      profile->entries[index].stalls[stall_cause(cpu, i)]++;
+    }
+  }
+
+  int oldest = oldest_stage(cpu);
+  if (oldest >= 0 && cpu->stage[oldest].stalled) {
+    int index = stage_code_index(cpu, &cpu->stage[oldest]);
+    profile->entries[index].oldest_stalls[stall_cause(cpu, oldest)]++;
+  }
+}
+
+/**
+ * Counts for the profile the stalls the cycle just run ended with. Most
+ * cycles end with none, and cost one test.
+ * @param cpu
+ */
+static inline ALWAYS_INLINE void profile_stalls(APEX_CPU *cpu) {
+  if (cpu->stage[F].stalled | cpu->stage[DRF].stalled | cpu->stage[EX].stalled) {
+    profile_stalled(cpu);
+  }
+}
+
+/**
+ * Gives the cycles since the last retirement to the instruction the run
+ * stopped waiting for, if any
+ * @param cpu
+ */
+static void profile_finish(APEX_CPU *cpu) {
+  APEX_Profile *profile = cpu->profile;
+  uint64_t cycles = cpu->clock - profile->last_retire_clock;
+  int oldest = oldest_stage(cpu);
+  if (oldest >= 0) {
+    profile->entries[stage_code_index(cpu, &cpu->stage[oldest])].cycles += cycles;
+  } else {
+    profile->idle_cycles += cycles;
+  }
+  profile->last_retire_clock = cpu->clock;
+}
+
+/**
+ * Tells whether the instruction at a pc is retired by the next cycle
+ * @param cpu
+ * @param pc
+ * @return
+ */
+static int retires_next(const APEX_CPU *cpu, int pc) {
+  const CPU_Stage *stage = &cpu->stage[WB];
+  return !stage->busy && !stage->stalled && stage->pc == pc &&
+         stage->opcode_id != OP_NOP && stage->opcode_id != OP_EMPTY;
+}
+
+/**
+ * Marks the run as complete and says so
+ * @param cpu
+ */
+static void finish_run(APEX_CPU *cpu) {
+  cpu->finished = 1;
+  if (cpu->config.out) {
+    fprintf(cpu->config.out, "(apex) >> Simulation Complete\n");
+  }
+}
+
 /**
  * APEX CPU simulation loop
  * @param cpu
@@ -846,51 +1496,187 @@ int writeback(APEX_CPU *cpu) {
  */
 int APEX_cpu_run(APEX_CPU *cpu, const char* functionality, const char* cycleCount) {
 
-  if(strcmp(functionality, "display") == 0){
-    ENABLE_DEBUG_MESSAGES = 1;
+  if(strcmp(functionality, "display") == 0 && cpu->config.out){
+    cpu->config.debug_messages = 1;
   }
 
   int desiredCycleCount = atoi(cycleCount);
 
+  /* Functional modes: cycle count is read as an instruction limit */
+  uint64_t maxInstructions = desiredCycleCount > 0 ? desiredCycleCount : 0;
+  if (strcmp(functionality, "functional") == 0) {
+    if (APEX_cpu_run_functional(cpu, maxInstructions, &cpu->ins_retired)) {
+      finish_run(cpu);
+    }
+    print_architectural_state(cpu);
+    return 0;
+  }
+
+  if (strcmp(functionality, "sample") == 0) {
+    APEX_Sample_Result result;
+    if (APEX_cpu_run_sampled(cpu, &cpu->sample_config, maxInstructions,
+                             &result) < 0) {
+      fprintf(stderr, "APEX_Error : Unable to run sampled simulation, the "
+              "period must be at least warmup + window and window above 0\n");
+      return -1;
+    }
+    cpu->ins_retired += result.instructions;
+    if (cpu->config.out) {
+      print_sample_result(cpu->config.out, &cpu->sample_config, &result);
+    }
+    if (result.finished) {
+      finish_run(cpu);
+    }
+    print_architectural_state(cpu);
+    return 0;
+  }
+
+  if (strcmp(functionality, "interval") == 0) {
+    APEX_Interval_Result result;
+    if (APEX_cpu_run_intervals(cpu, &cpu->interval_config, maxInstructions,
+                               &result) < 0) {
+      fprintf(stderr, "APEX_Error : Unable to run interval simulation\n");
+      return -1;
+    }
+    cpu->ins_retired += result.instructions;
+    if (cpu->config.out) {
+      print_interval_result(cpu->config.out, &cpu->interval_config, &result);
+    }
+    if (result.finished) {
+      finish_run(cpu);
+    }
+    print_architectural_state(cpu);
+    return 0;
+  }
+
+  if (strcmp(functionality, "lanes") == 0) {
+    APEX_Lanes_Result result;
+    if (APEX_cpu_run_lanes(cpu, &cpu->lanes_config, maxInstructions,
+                              &result) < 0) {
+      fprintf(stderr, "APEX_Error : Unable to run lanes simulation\n");
+      return -1;
+    }
+    cpu->ins_retired += result.lane[0].instructions;
+    if (cpu->config.out) {
+      print_lanes_result(cpu->config.out, &result);
+    }
+    if (result.finished_lanes == result.lanes) {
+      finish_run(cpu);
+    }
+    free(result.lane);
+    print_architectural_state(cpu);
+    return 0;
+  }
+
+  if (strcmp(functionality, "lockstep") == 0) {
+    APEX_Lockstep_Result result;
+    if (APEX_cpu_run_lockstep(cpu, &cpu->lanes_config, desiredCycleCount,
+                              &result) < 0) {
+      fprintf(stderr, "APEX_Error : Unable to run lockstep simulation\n");
+      return -1;
+    }
+    if (cpu->config.out) {
+      print_lockstep_result(cpu->config.out, &result);
+    }
+    if (result.finished_lanes == result.lanes) {
+      finish_run(cpu);
+    }
+    free(result.lane);
+    print_architectural_state(cpu);
+    return 0;
+  }
+
+  if (strcmp(functionality, "translate") == 0) {
+    if (!cpu->block_cache) {
+      cpu->block_cache = block_cache_create();
+      if (!cpu->block_cache) {
+        fprintf(stderr, "APEX_Error : Unable to allocate block cache\n");
+        return -1;
+      }
+    }
+    if (APEX_cpu_run_translated(cpu, cpu->block_cache, maxInstructions,
+                                &cpu->ins_retired)) {
+      finish_run(cpu);
+    }
+    print_architectural_state(cpu);
+    return 0;
+  }
+
+  /* The flight recorder keeps a copy of the CPU at snapshotClock and
+   * ends the run once the instruction at triggerPc retires */
+  int snapshotClock = -1;
+  int triggerPc = 0;
+  if (cpu->flight_recorder) {
+    snapshotClock = flight_recorder_start(cpu->flight_recorder, cpu);
+    triggerPc = flight_recorder_trigger_pc(cpu->flight_recorder);
+    if (snapshotClock < 0) {
+      fprintf(stderr, "APEX_Error : Unable to allocate flight recorder\n");
+      return -1;
+    }
+  }
+
+  if (cpu->profile) {
+    cpu->profile->last_retire_clock = cpu->clock;
+  }
+
+  Cycle_Function cycle_function = select_cycle(cpu);
+  int complete = 0;
+#ifdef APEX_INSTRUMENT
+  int startClock = cpu->clock;
+#endif
+  INSTRUMENT_START(runStart);
   while (1) {
 
     /* All the instructions committed, so exit */
     if (cpu->ins_completed == cpu->code_memory_size) {
-      printf("(apex) >> Simulation Complete\n");
+      complete = 1;
       break;
     }
 
-    if (ENABLE_DEBUG_MESSAGES) {
-      printf("--------------------------------\n");
-      printf("Clock Cycle #: %d\n", cpu->clock+1);// only display count of Clock cycle is increased.
-      printf("--------------------------------\n");
+    if (cpu->clock == snapshotClock) {
+      snapshotClock = flight_recorder_snapshot(cpu->flight_recorder, cpu);
     }
+    int triggered = triggerPc && retires_next(cpu, triggerPc);
 
-    writeback(cpu);
-    memory(cpu);
-    execute(cpu);
-    decode(cpu);
-    fetch(cpu);
-    cpu->clock++;
+    if (cpu->profile) {
+      profile_retire(cpu);
+      cycle_function(cpu);
+      profile_stalls(cpu);
+    } else {
+      cycle_function(cpu);
+    }
+
+    if (cpu->checkpoint_file && cpu->checkpoint_interval &&
+        cpu->clock % cpu->checkpoint_interval == 0 &&
+        APEX_cpu_save_checkpoint(cpu, cpu->checkpoint_file) != 0) {
+      fprintf(stderr, "APEX_Error : Unable to save checkpoint %s\n",
+              cpu->checkpoint_file);
+    }
 
     if(desiredCycleCount == cpu->clock){
       break;
     }
-  }
 
-  printf("=========STATE OF ARCHITECTURAL REGISTER FILE============\n");
-  for (int i = 0; i < 16; i++) {
-    char *validStr = "Valid";
-    if (cpu->regs_valid[i] == 999 && i != 0) { //check i!=0
-      validStr = "Invalid";
+    if (triggered) {
+      break;
     }
-    printf(" |\tREG[%d]\t|\tValue = %-5d\t|\tStatus = %-8s\t|\n", i, cpu->regs[i], validStr);
   }
 
-  printf("\n=========STATE OF DATA MEMORY============\n");
-  for (int i = 0; i < 100; i++) {
-    printf("\t|\tMRM[%d]\t|\tValue = %d\t|\n", i, cpu->data_memory[i]);
+  INSTRUMENT_LAP_CALLS(INSTR_RUN, runStart, cpu->clock - startClock);
+  INSTRUMENT_FLUSH();
+
+  if (cpu->profile) {
+    profile_finish(cpu);
   }
 
+  /** display has printed these cycles already */
+  if (cpu->flight_recorder && cpu->config.out && !cpu->config.debug_messages &&
+      flight_recorder_dump(cpu->flight_recorder, cpu, cpu->config.out) != 0) {
+    fprintf(stderr, "APEX_Error : Unable to replay the flight recorder\n");
+  }
+  if (complete) {
+    finish_run(cpu);
+  }
+  print_architectural_state(cpu);
   return 0;
-}
\ No newline at end of file
+}
@@ -4,6 +4,11 @@
  *  cpu.h
  *  Contains various CPU and Pipeline Data structures
  */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "memory.h"
 
 enum myEnum{
     F,
@@ -14,39 +19,144 @@ enum myEnum{
     NUM_STAGES
 };
 
-/* Format of an APEX instruction  */
+/* Operation codes, decoded once by the file parser */
+typedef enum APEX_Opcode {
+    OP_EMPTY,      // Empty slot, e.g. fetch past end of code memory
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_AND,
+    OP_OR,
+    OP_EX_OR,
+    OP_MOVC,
+    OP_LOAD,
+    OP_STORE,
+    OP_BZ,
+    OP_BNZ,
+    OP_JUMP,
+    OP_HALT,
+    OP_NOP,        // Bubble inserted by a flush, never parsed from input
+    OP_INVALID,    // Unrecognised opcode text, rejected by fetch
+    NUM_OPCODES
+} APEX_Opcode;
+
+/* Architectural registers, R0 to R15 */
+#define NUM_ARCH_REGS 16
+
+/* Register slots used in place of a real register index */
+#define REG_FLUSHED 30  // Operand of a flushed or empty stage
+#define REG_NONE 31     // Operand the instruction does not have
+
+/* Scoreboard bit of a register slot, see APEX_CPU.pending_regs */
+#define REG_BIT(reg) (1u << ((reg) & 31))
+
+/* Format of an APEX instruction, packed into 8 bytes of code memory.
+ * Opcode text is not stored, see get_opcode_name() */
 typedef struct APEX_Instruction {
-    char opcode[128];  // Operation Code
-    int rd;        // Destination Register Address
-    int rs1;        // Source-1 Register Address
-    int rs2;        // Source-2 Register Address
-    int imm;        // Literal Value
+    uint8_t opcode_id;  // Decoded Operation Code
+    uint8_t rd;        // Destination Register Address
+    uint8_t rs1;        // Source-1 Register Address
+    uint8_t rs2;        // Source-2 Register Address
+    int32_t imm;        // Literal Value
 } APEX_Instruction;
 
-/* Model of CPU stage latch */
+/* Model of CPU stage latch, packed to fit well inside one cache line */
 typedef struct CPU_Stage {
     int pc;        // Program Counter
-    char opcode[128];  // Operation Code
-    int rs1;        // Source-1 Register Address
-    int rs2;        // Source-2 Register Address
-    int rd;        // Destination Register Address
     int imm;        // Literal Value
     int rs1_value;  // Source-1 Register Value
     int rs2_value;  // Source-2 Register Value
     int buffer;    // Latch to hold some value
     int mem_address;  // Computed Memory Address
-    int busy;        // Flag to indicate, stage is performing some action
-    int stalled;    // Flag to indicate, stage is stalled
-    int rdPrev;     // Destination Register Address of prev instruction.
-    int stallDueToNextStage;     // stall flag for next stage.
-    int flushInNextStage;     // stall flag for DRF stage.
-    int handleJumpInNextStage;     // handle Jump flag.
-    int handleBZInNextStage;     // handle BZ flag.
-    int handleBNZInNextStage;     // handle BNZ flag.
     int zFlag;      // Flag for branching.
-    int stallDueToLoadFlag;      // Flag for branching.
+    uint64_t seq;   // Number of the instruction in fetch order, 0 for none
+    uint8_t opcode_id;  // Decoded Operation Code
+    uint8_t rs1;        // Source-1 Register Address
+    uint8_t rs2;        // Source-2 Register Address
+    uint8_t rd;         // Destination Register Address
+    uint8_t rdPrev;     // Destination Register Address of prev instruction.
+    unsigned int busy : 1;        // Flag to indicate, stage is performing some action
+    unsigned int stalled : 1;    // Flag to indicate, stage is stalled
+    unsigned int stallDueToNextStage : 1;     // stall flag for next stage.
+    unsigned int flushInNextStage : 1;     // stall flag for DRF stage.
+    unsigned int handleJumpInNextStage : 1;     // handle Jump flag.
+    unsigned int handleBZInNextStage : 1;     // handle BZ flag.
+    unsigned int handleBNZInNextStage : 1;     // handle BNZ flag.
+    unsigned int stallDueToLoadFlag : 1;      // Flag for branching.
+    unsigned int mulCycles : 8;   // Extra EX cycles a MUL has spent so far
 } CPU_Stage;
 
+/* Statistics of loading a program into code memory */
+typedef struct APEX_Load_Stats {
+    size_t bytes;      // Size of the program file
+    double seconds;    // Time taken to read and parse it
+} APEX_Load_Stats;
+
+/* Per-instance settings of the simulator */
+typedef struct APEX_Config {
+    int debug_messages;    // Print every stage each cycle, set by display
+    int data_forwarding;   // Forward results to waiting instructions
+    FILE *out;             // Where the simulation output is written, NULL for none
+    int mul_latency;       // Cycles a MUL holds the EX stage, 1 to 256
+} APEX_Config;
+
+/* Default number of words of data memory */
+#define DATA_MEMORY_SIZE 4096
+
+/* Cycles per instruction after which timed pipeline runs give up, e.g.
+ * on a program that deadlocks without forwarding */
+#define MAX_TIMED_CPI 64
+
+/* Parameters of the sampled mode, in instructions: every period starts
+ * with warmup + window instructions on the pipeline, of which the last
+ * window are timed, and the rest of the period runs in the functional mode */
+typedef struct APEX_Sample_Config {
+    uint64_t period;
+    uint64_t window;
+    uint64_t warmup;
+} APEX_Sample_Config;
+
+/* Parameters of the interval mode: intervals of interval instructions
+ * are timed on threads threads (0 for one per CPU), each after warmup
+ * instructions; check_serial also times a plain pipeline run */
+typedef struct APEX_Interval_Config {
+    uint64_t interval;
+    uint64_t warmup;
+    int threads;
+    int check_serial;
+} APEX_Interval_Config;
+
+/* Parameters of the lanes mode: lanes instances of the program run
+ * side by side (0 for one per image of lane_data), each on the image of
+ * lane_data it is given, or on the CPU's data memory if that is NULL */
+typedef struct APEX_Lanes_Config {
+    int lanes;
+    const char *lane_data;
+} APEX_Lanes_Config;
+
+/* Causes of a stalled stage. Only fetch, decode and EX stall: fetch
+ * only behind decode, EX only for a MUL. */
+typedef enum APEX_Stall_Cause {
+    STALL_LOAD_USE,       // Decode waiting for a LOAD's word (stallDueToLoadFlag)
+    STALL_MUL,            // EX held by a MUL
+    STALL_BACKPRESSURE,   // Fetch or decode held by the stage ahead (stallDueToNextStage)
+    STALL_BRANCH_FLAG,    // BZ or BNZ in decode waiting for the Z flag
+    STALL_DEPENDENCY,     // Decode waiting for a source register
+    NUM_STALL_CAUSES
+} APEX_Stall_Cause;
+
+/* Performance counters of the pipeline modes. A stall counter gets one
+ * for every stage that ends a cycle stalled for that cause, so a cycle
+ * in which decode and fetch both wait counts twice. */
+typedef struct APEX_Counters {
+    uint64_t retired[NUM_OPCODES];   // Instructions through writeback, by opcode
+    uint64_t stall_cycles[NUM_STALL_CAUSES];
+    uint64_t branches_taken;         // BZ and BNZ
+    uint64_t jumps;
+    uint64_t flushed_branch;         // Instructions squashed by taken BZ and BNZ
+    uint64_t flushed_jump;           // Instructions squashed by JUMP
+} APEX_Counters;
+
 /* Model of APEX CPU */
 typedef struct APEX_CPU {
     /* Clock cycles elasped */
@@ -55,9 +165,14 @@ typedef struct APEX_CPU {
     /* Current program counter */
     int pc;
 
-    /* Integer register file */
+    /* Integer register file, REG_FLUSHED and REG_NONE slots included */
     int regs[32];
-    int regs_valid[32];
+
+    /* Scoreboard, one bit per register slot: pending_regs marks registers
+     * an instruction past decode is still to write, written_regs those
+     * written back or freed by a flush since the pipeline started */
+    uint32_t pending_regs;
+    uint32_t written_regs;
 
     /* Array of 5 CPU_stage */
     CPU_Stage stage[5];
@@ -65,12 +180,57 @@ typedef struct APEX_CPU {
     /* Code Memory where instructions are stored */
     APEX_Instruction *code_memory;
     int code_memory_size;
+    APEX_Load_Stats load_stats;
+
+    /* Set when code memory is a mapped program image rather than malloc'd */
+    void *code_mapping;
+    size_t code_mapping_size;
+
+    /* Translated blocks of the translate mode, created on first use */
+    struct Block_Cache *block_cache;
 
-    /* Data Memory */
-    int data_memory[4096];
+    /* Data Memory, a power of 2 number of words; addresses wrap around it.
+     * Paged and shared with clones until written, see memory.h */
+    APEX_Memory data_memory;
+
+    /* Set on copies made by APEX_cpu_clone, which use the code memory of
+     * the original */
+    int shares_code_memory;
 
     /* Some stats */
     int ins_completed;
+    uint64_t ins_retired;      // Instructions, not bubbles, through writeback;
+                               // instructions run in the functional modes
+    uint64_t ins_fetched;      // Instructions fetched, which numbers them (seq)
+    uint64_t last_retired;     // seq of the last instruction through writeback
+    int finished;              // Set when APEX_cpu_run completes the program
+    APEX_Counters counters;
+
+    APEX_Config config;
+    APEX_Sample_Config sample_config;
+    APEX_Interval_Config interval_config;
+    APEX_Lanes_Config lanes_config;
+
+    /* Pipeline modes save a checkpoint to checkpoint_file every
+     * checkpoint_interval cycles, if both are set */
+    const char *checkpoint_file;
+    int checkpoint_interval;
+
+    /* Pipeline modes record every cycle to trace if it is set, see trace.h;
+     * trace_record is the record of the cycle running */
+    struct Trace_Writer *trace;
+    struct APEX_Trace_Record *trace_record;
+
+    /* Pipeline modes print their last cycles through flight_recorder once
+     * they stop, if it is set, see flight_recorder.h */
+    struct Flight_Recorder *flight_recorder;
+
+    /* Pipeline modes give every cycle to an instruction in profile, if it
+     * is set, see profile.h */
+    struct APEX_Profile *profile;
+
+    /* Functions libapex calls as it runs the CPU, see apex.h */
+    struct APEX_Callbacks *callbacks;
 
     int zFlag;      // Flag for branching.
     int haltFlag;      // Flag for halt indication.
@@ -79,12 +239,46 @@ typedef struct APEX_CPU {
 
 APEX_Instruction *create_code_memory(const char *filename, int *size);
 
+APEX_Instruction *load_code_memory(const char *filename, int *size,
+                                   APEX_Load_Stats *stats);
+
+APEX_Instruction *load_code_memory_threads(const char *filename, int *size,
+                                           APEX_Load_Stats *stats,
+                                           int num_threads);
+
+const char *get_opcode_name(int opcode_id);
+
 APEX_CPU *APEX_cpu_init(const char *filename);
 
+APEX_CPU *APEX_cpu_clone(const APEX_CPU *cpu);
+
+int APEX_cpu_set_data_memory_size(APEX_CPU *cpu, int words);
+
 int APEX_cpu_run(APEX_CPU *cpu, const char* functionality, const char* cycleCount);
 
 void APEX_cpu_stop(APEX_CPU *cpu);
 
+void APEX_cpu_reset_pipeline(APEX_CPU *cpu);
+
+void APEX_cpu_cycle(APEX_CPU *cpu);
+
+uint64_t APEX_cpu_step(APEX_CPU *cpu, uint64_t cycles);
+
+uint64_t APEX_cpu_run_timed(APEX_CPU *cpu, uint64_t warmup, uint64_t count,
+                            uint64_t *cycles);
+
+int APEX_cpu_run_functional(APEX_CPU *cpu, uint64_t max_instructions,
+                            uint64_t *executed);
+
+int get_code_index(int pc);
+
+void print_stage(FILE *out, int stage_id, CPU_Stage *stage);
+
+void print_code_instruction(FILE *out, const APEX_CPU *cpu, int index);
+
+void print_state(FILE *out, const int *regs, uint32_t pending_regs,
+                 const int *data_memory, int data_memory_words);
+
 int fetch(APEX_CPU *cpu);
 
 int decode(APEX_CPU *cpu);
@@ -3,146 +3,504 @@
  *  Contains functions to parse input file and create
  *  code memory, you can edit this file to add new instructions
  */
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "cpu.h"
+#include "instrument.h"
+#include "thread_pool.h"
+
+/* Maximum number of comma separated tokens looked at per line */
+#define MAX_TOKENS 6
+
+/* Programs smaller than this are parsed on the calling thread only */
+#define PARALLEL_PARSE_MIN_BYTES (4 << 20)
+
+/* Chunks handed out per parser thread, to even out uneven lines */
+#define CHUNKS_PER_THREAD 4
+
+/* Token of a source line, pointing into the mapped file */
+typedef struct Token {
+  const char *start;
+  size_t len;
+} Token;
 
 /*
  * This function is related to parsing input file
  *
- * Note : You are not supposed to edit this function
+ * Parses the number following the first character of a token, the
+ * way atoi() would, e.g. "R12" or "#-8". At most 15 characters are
+ * looked at.
+ */
+static int get_num_from_string(const Token *token) {
+  const char *p = token->start + 1;
+  const char *end = token->start + (token->len < 16 ? token->len : 16);
+  long value = 0;
+  int negative = 0;
+
+  while (p < end && (*p == ' ' || (*p >= '\t' && *p <= '\r'))) {
+    p++;
+  }
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+  while (p < end && *p >= '0' && *p <= '9') {
+    value = value * 10 + (*p - '0');
+    p++;
+  }
+  return (int) (negative ? -value : value);
+}
+
+/*
+ * Parses a register operand such as "R12". Only R0 to R15 exist; any
+ * other index reads as REG_NONE and sets *bad.
  */
-static int get_num_from_string(char *buffer) {
-  char str[16];
-  int j = 0;
-  for (int i = 1; buffer[i] != '\0'; ++i) {
-    str[j] = buffer[i];
-    j++;
-  }
-  str[j] = '\0';
-  return atoi(str);
+static int get_reg_from_string(const Token *token, int *bad) {
+  int reg = get_num_from_string(token);
+  if (reg < 0 || reg >= NUM_ARCH_REGS) {
+    *bad = 1;
+    return REG_NONE;
+  }
+  return reg;
+}
+
+/* Opcode text as written in the input file, indexed by APEX_Opcode */
+static const char *const opcode_names[NUM_OPCODES] = {
+    [OP_EMPTY] = "",
+    [OP_ADD] = "ADD",
+    [OP_SUB] = "SUB",
+    [OP_MUL] = "MUL",
+    [OP_AND] = "AND",
+    [OP_OR] = "OR",
+    [OP_EX_OR] = "EX-OR",
+    [OP_MOVC] = "MOVC",
+    [OP_LOAD] = "LOAD",
+    [OP_STORE] = "STORE",
+    [OP_BZ] = "BZ",
+    [OP_BNZ] = "BNZ",
+    [OP_JUMP] = "JUMP",
+    [OP_HALT] = "HALT",
+    [OP_NOP] = "NOP",
+    [OP_INVALID] = "",
+};
+
+/*
+ * Maps opcode text to its APEX_Opcode. Only real instructions are
+ * recognised, anything else (including "NOP") decodes to OP_INVALID.
+ */
+static int get_opcode_id(const Token *token) {
+  for (int id = OP_ADD; id <= OP_HALT; ++id) {
+    const char *name = opcode_names[id];
+    if (name[0] == token->start[0] && strlen(name) == token->len &&
+        memcmp(name, token->start, token->len) == 0) {
+      return id;
+    }
+  }
+  return OP_INVALID;
+}
+
+/*
+ * Returns the opcode text used when displaying a decoded instruction
+ */
+const char *get_opcode_name(int opcode_id) {
+  return opcode_names[opcode_id];
 }
 
 /*
  * This function is related to parsing input file
  *
+ * Splits one line (including its trailing newline, if any) on ','
+ * without copying it. Empty tokens are skipped, so ",,MOVC" reads the
+ * same as "MOVC". The newline stays part of the last token, which is
+ * why "HALT" must be written as "HALT,".
+ *
  * Note : you can edit this function to add new instructions
+ *
+ * Returns 0, or -1 if a register operand is not one of R0 to R15
  */
-static void create_APEX_instruction(APEX_Instruction *ins, char *buffer) {
-  char *token = strtok(buffer, ",");
+static int create_APEX_instruction(APEX_Instruction *ins,
+                                   const char *line, const char *end) {
+  /* Missing operands read as zero */
+  static const Token zero = {"#0", 2};
+  Token tokens[MAX_TOKENS];
   int token_num = 0;
-  char tokens[6][128];
-  while (token != NULL) {
-    strcpy(tokens[token_num], token);
-    token_num++;
-    token = strtok(NULL, ",");
+  int bad = 0;
+
+  const char *p = line;
+  while (p < end && token_num < MAX_TOKENS) {
+    const char *comma = memchr(p, ',', end - p);
+    const char *token_end = comma ? comma : end;
+    if (token_end > p) {
+      tokens[token_num].start = p;
+      tokens[token_num].len = token_end - p;
+      token_num++;
+    }
+    p = token_end + 1;
+  }
+  for (int i = token_num; i < MAX_TOKENS; ++i) {
+    tokens[i] = zero;
+  }
+
+  ins->opcode_id = token_num ? get_opcode_id(&tokens[0]) : OP_INVALID;
+
+  switch (ins->opcode_id) {
+    case OP_MOVC:
+      ins->rd = get_reg_from_string(&tokens[1], &bad);
+      ins->imm = get_num_from_string(&tokens[2]);
+      ins->rs1 = REG_NONE;
+      ins->rs2 = REG_NONE;
+      break;
+
+    case OP_STORE:
+      ins->rs1 = get_reg_from_string(&tokens[1], &bad);
+      ins->rs2 = get_reg_from_string(&tokens[2], &bad);
+      ins->imm = get_num_from_string(&tokens[3]);
+      ins->rd = REG_NONE;
+      break;
+
+    case OP_LOAD:
+      ins->rd = get_reg_from_string(&tokens[1], &bad);
+      ins->rs1 = get_reg_from_string(&tokens[2], &bad);
+      ins->imm = get_num_from_string(&tokens[3]);
+      ins->rs2 = REG_NONE;
+      break;
+
+    case OP_BZ:
+    case OP_BNZ:
+      ins->imm = get_num_from_string(&tokens[1]);
+      ins->rd = REG_NONE;
+      ins->rs1 = REG_NONE;
+      ins->rs2 = REG_NONE;
+      break;
+
+    case OP_JUMP:
+      ins->rs1 = get_reg_from_string(&tokens[1], &bad);
+      ins->imm = get_num_from_string(&tokens[2]);
+      ins->rd = REG_NONE;
+      ins->rs2 = REG_NONE;
+      break;
+
+    case OP_HALT:
+      /*No any operation*/
+      break;
+
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_AND:
+    case OP_EX_OR:
+    case OP_OR:
+      ins->rd = get_reg_from_string(&tokens[1], &bad);
+      ins->rs1 = get_reg_from_string(&tokens[2], &bad);
+      ins->rs2 = get_reg_from_string(&tokens[3], &bad);
+      break;
+
+    default:
+      break;
+  }
+  return bad ? -1 : 0;
+}
+
+/*
+ * Reads a file that cannot be mapped (a pipe, for instance) into a
+ * malloc'd buffer
+ */
+static char *read_whole_file(int fd, size_t *length) {
+  size_t capacity = 1 << 16;
+  size_t used = 0;
+  char *data = malloc(capacity);
+
+  while (data) {
+    if (used == capacity) {
+      capacity *= 2;
+      char *grown = realloc(data, capacity);
+      if (!grown) {
+        break;
+      }
+      data = grown;
+    }
+    ssize_t nread = read(fd, data + used, capacity - used);
+    if (nread < 0) {
+      break;
+    }
+    if (nread == 0) {
+      *length = used;
+      return data;
+    }
+    used += nread;
   }
+  free(data);
+  return NULL;
+}
 
-  strcpy(ins->opcode, tokens[0]);
+/*
+ * Parses every line of the text in one pass into a growable code
+ * memory array. Sets *bad_line to the number of the first line with a
+ * bad register, if any.
+ */
+static APEX_Instruction *parse_code_memory(const char *data, size_t length,
+                                           int *size, size_t *bad_line) {
+  /* Real programs average well over 8 bytes per line */
+  size_t capacity = length / 8 + 16;
+  size_t count = 0;
+  APEX_Instruction *code_memory = malloc(sizeof(*code_memory) * capacity);
+  if (!code_memory) {
+    return NULL;
+  }
 
-  if (strcmp(ins->opcode, "MOVC") == 0) {
-    ins->rd = get_num_from_string(tokens[1]);
-    ins->imm = get_num_from_string(tokens[2]);
-    ins->rs1 = -1;
-    ins->rs2 = -1;
+  const char *p = data;
+  const char *end = data + length;
+  while (p < end) {
+    const char *newline = memchr(p, '\n', end - p);
+    const char *line_end = newline ? newline + 1 : end;
+
+    if (count == capacity) {
+      capacity *= 2;
+      APEX_Instruction *grown =
+          realloc(code_memory, sizeof(*code_memory) * capacity);
+      if (!grown) {
+        free(code_memory);
+        return NULL;
+      }
+      code_memory = grown;
+    }
+
+    /* Zeroed so operands an instruction does not use read as 0 */
+    memset(&code_memory[count], 0, sizeof(*code_memory));
+    if (create_APEX_instruction(&code_memory[count], p, line_end) != 0 &&
+        !*bad_line) {
+      *bad_line = count + 1;
+    }
+    count++;
+    p = line_end;
   }
 
-  if (strcmp(ins->opcode, "STORE") == 0) {
-    ins->rs1 = get_num_from_string(tokens[1]);
-    ins->rs2 = get_num_from_string(tokens[2]);
-    ins->imm = get_num_from_string(tokens[3]);
-    ins->rd = -1;
+  *size = (int) count;
+  return code_memory;
+}
+
+/* Slice of the program text, starting and ending on a line boundary */
+typedef struct Parse_Chunk {
+  const char *start;
+  const char *end;
+  size_t first_line;  // Code memory index of the first line in the chunk
+  size_t num_lines;
+  size_t bad_line;    // Number of the first line with a bad register, 0 if none
+} Parse_Chunk;
+
+/* Shared state of one parallel parse */
+typedef struct Parse_Job {
+  Parse_Chunk *chunks;
+  APEX_Instruction *code_memory;
+} Parse_Job;
+
+/* Counts lines in a chunk, a last line without newline included */
+static void count_chunk_lines(void *arg, int index) {
+  Parse_Chunk *chunk = &((Parse_Job *) arg)->chunks[index];
+  const char *p = chunk->start;
+  size_t lines = 0;
+
+  while (p < chunk->end) {
+    const char *newline = memchr(p, '\n', chunk->end - p);
+    if (!newline) {
+      lines++;
+      break;
+    }
+    lines++;
+    p = newline + 1;
   }
+  chunk->num_lines = lines;
+}
+
+/* Parses a chunk straight into its slice of code memory */
+static void parse_chunk_lines(void *arg, int index) {
+  Parse_Job *job = arg;
+  Parse_Chunk *chunk = &job->chunks[index];
+  APEX_Instruction *ins = &job->code_memory[chunk->first_line];
+  const char *p = chunk->start;
 
-  if (strcmp(ins->opcode, "LOAD") == 0) {
-    ins->rd = get_num_from_string(tokens[1]);
-    ins->rs1 = get_num_from_string(tokens[2]);
-    ins->imm = get_num_from_string(tokens[3]);
-    ins->rs2 = -1;
+  while (p < chunk->end) {
+    const char *newline = memchr(p, '\n', chunk->end - p);
+    const char *line_end = newline ? newline + 1 : chunk->end;
+    if (create_APEX_instruction(ins, p, line_end) != 0 && !chunk->bad_line) {
+      chunk->bad_line = ins - job->code_memory + 1;
+    }
+    ins++;
+    p = line_end;
   }
+}
 
-  if (
-      strcmp(ins->opcode, "BZ") == 0 ||
-      strcmp(ins->opcode, "BNZ") == 0
-      ) {
-    ins->imm = get_num_from_string(tokens[1]);
-    ins->rd = -1;
-    ins->rs1 = -1;
-    ins->rs2 = -1;
+/*
+ * Parses the text on num_threads threads. The text is cut into chunks
+ * at line boundaries; lines are counted per chunk first, so every
+ * chunk knows the code memory index of its first line and parses
+ * straight into the final array. Line N still lands at index N - 1.
+ * Sets *bad_line as parse_code_memory does.
+ */
+static APEX_Instruction *parse_code_memory_parallel(const char *data,
+                                                    size_t length, int *size,
+                                                    int num_threads,
+                                                    size_t *bad_line) {
+  Thread_Pool *pool = thread_pool_create(num_threads);
+  if (!pool) {
+    return NULL;
   }
 
-  if (strcmp(ins->opcode, "JUMP") == 0) {
-    ins->rs1 = get_num_from_string(tokens[1]);
-    ins->imm = get_num_from_string(tokens[2]);
-    ins->rd = -1;
-    ins->rs2 = -1;
+  int num_chunks = thread_pool_size(pool) * CHUNKS_PER_THREAD;
+  Parse_Job job = {calloc(num_chunks, sizeof(Parse_Chunk)), NULL};
+  if (!job.chunks) {
+    thread_pool_destroy(pool);
+    return NULL;
   }
 
-  if (strcmp(ins->opcode, "HALT") == 0) {
-    /*No any operation*/
+  const char *end = data + length;
+  const char *start = data;
+  for (int i = 0; i < num_chunks; ++i) {
+    const char *chunk_end = end;
+    if (i < num_chunks - 1) {
+      chunk_end = data + length / num_chunks * (i + 1);
+      if (chunk_end < start) {
+        chunk_end = start;
+      }
+      const char *newline = memchr(chunk_end, '\n', end - chunk_end);
+      chunk_end = newline ? newline + 1 : end;
+    }
+    job.chunks[i].start = start;
+    job.chunks[i].end = chunk_end;
+    start = chunk_end;
   }
 
-  if (
-      strcmp(ins->opcode, "ADD") == 0 ||
-      strcmp(ins->opcode, "SUB") == 0 ||
-      strcmp(ins->opcode, "MUL") == 0 ||
-      strcmp(ins->opcode, "AND") == 0 ||
-      strcmp(ins->opcode, "EX-OR") == 0 ||
-      strcmp(ins->opcode, "OR") == 0
-      ) {
-    ins->rd = get_num_from_string(tokens[1]);
-    ins->rs1 = get_num_from_string(tokens[2]);
-    ins->rs2 = get_num_from_string(tokens[3]);
+  thread_pool_run(pool, count_chunk_lines, &job, num_chunks);
+
+  size_t count = 0;
+  for (int i = 0; i < num_chunks; ++i) {
+    job.chunks[i].first_line = count;
+    count += job.chunks[i].num_lines;
   }
 
+  /* Zeroed so operands an instruction does not use read as 0 */
+  job.code_memory = calloc(count ? count : 1, sizeof(APEX_Instruction));
+  if (job.code_memory) {
+    thread_pool_run(pool, parse_chunk_lines, &job, num_chunks);
+    *size = (int) count;
+    for (int i = 0; i < num_chunks && !*bad_line; ++i) {
+      *bad_line = job.chunks[i].bad_line;
+    }
+  }
+
+  free(job.chunks);
+  thread_pool_destroy(pool);
+  return job.code_memory;
+}
+
+static double elapsed_seconds(const struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
 }
 
 /*
  * This function is related to parsing input file
  *
- * Note : You are not supposed to edit this function
+ * Maps the file and parses it. Each line becomes one instruction, so
+ * line N sits at address 4000 + 4 * (N - 1). Large files are parsed on
+ * num_threads threads (0 picks one per CPU), smaller ones in a single
+ * pass. Fills in stats, if given, with the size of the file and the
+ * time taken.
  */
-APEX_Instruction *create_code_memory(const char *filename, int *size) {
+APEX_Instruction *load_code_memory_threads(const char *filename, int *size,
+                                           APEX_Load_Stats *stats,
+                                           int num_threads) {
   if (!filename) {
     return NULL;
   }
 
-  FILE *fp = fopen(filename, "r");
-  if (!fp) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  INSTRUMENT_START(phase);
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
     return NULL;
   }
 
-  char *line = NULL;
-  size_t len = 0;
-  ssize_t nread;
-  int code_memory_size = 0;
+  struct stat st;
+  size_t length = 0;
+  char *data = NULL;
+  int mapped = 0;
 
-  while ((nread = getline(&line, &len, fp)) != -1) {
-    code_memory_size++;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    length = st.st_size;
+    if (length) {
+      data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        data = NULL;
+      } else {
+        madvise(data, length, MADV_SEQUENTIAL);
+        mapped = 1;
+      }
+    }
+  } else {
+    data = read_whole_file(fd, &length);
   }
-  *size = code_memory_size;
-  if (!code_memory_size) {
-    fclose(fp);
-    return NULL;
+  close(fd);
+  INSTRUMENT_LAP(INSTR_PARSE_READ, phase);
+
+  *size = 0;
+  size_t bad_line = 0;
+  APEX_Instruction *code_memory = NULL;
+  if (num_threads <= 0) {
+    num_threads = thread_pool_default_size();
+  }
+  if (data && length) {
+    if (num_threads > 1 && length >= PARALLEL_PARSE_MIN_BYTES) {
+      code_memory = parse_code_memory_parallel(data, length, size, num_threads,
+                                               &bad_line);
+    } else {
+      code_memory = parse_code_memory(data, length, size, &bad_line);
+    }
   }
+  INSTRUMENT_LAP(INSTR_PARSE_LINES, phase);
 
-  APEX_Instruction *code_memory =
-      malloc(sizeof(*code_memory) * code_memory_size);
-  if (!code_memory) {
-    fclose(fp);
-    return NULL;
+  if (mapped) {
+    munmap(data, length);
+  } else {
+    free(data);
   }
+  INSTRUMENT_LAP(INSTR_PARSE_RELEASE, phase);
+  INSTRUMENT_FLUSH();
 
-  rewind(fp);
-  int current_instruction = 0;
-  while ((nread = getline(&line, &len, fp)) != -1) {
-    create_APEX_instruction(&code_memory[current_instruction], line);
-    current_instruction++;
+  if (code_memory && bad_line) {
+    fprintf(stderr, "APEX_Error : %s:%zu: Register out of range, only R0 to "
+            "R15 exist\n", filename, bad_line);
+  }
+  if (code_memory && (!*size || bad_line)) {
+    free(code_memory);
+    code_memory = NULL;
   }
 
-  free(line);
-  fclose(fp);
+  if (stats) {
+    stats->bytes = length;
+    stats->seconds = elapsed_seconds(&start);
+  }
   return code_memory;
 }
+
+APEX_Instruction *load_code_memory(const char *filename, int *size,
+                                   APEX_Load_Stats *stats) {
+  return load_code_memory_threads(filename, size, stats, 0);
+}
+
+/*
+ * This function is related to parsing input file
+ */
+APEX_Instruction *create_code_memory(const char *filename, int *size) {
+  return load_code_memory(filename, size, NULL);
+}
@@ -0,0 +1,133 @@
+/*
+ *  flight_recorder.c
+ *  Contains the flight recorder. Recording every cycle as it runs would
+ *  slow down the whole run for the sake of its last few cycles, so the
+ *  recorder only keeps a copy of the CPU every few thousand cycles.
+ *  When the run stops, the pipeline is run again from the copy that is
+ *  far enough back, silently up to the last cycles and then printing
+ *  them as display does. The pipeline is deterministic, so these are
+ *  the very cycles the run went through.
+ */
+#include <stdlib.h>
+
+#include "flight_recorder.h"
+
+/* Fewest cycles between two copies of the CPU */
+#define SNAPSHOT_MIN_INTERVAL 4096
+
+struct Flight_Recorder {
+  int cycles;              // Cycles to print
+  int trigger_pc;          // Stop the run when the instruction at this pc retires, 0 for none
+  int interval;            // Cycles between copies, at least cycles
+  APEX_CPU *snapshot[2];   // Latest copy and the one before, or NULL
+};
+
+/**
+ * Creates a flight recorder
+ * @param cycles number of cycles to print, above 0
+ * @param trigger_pc pc of the instruction whose retirement ends the run,
+ * 0 for none
+ * @return NULL on error
+ */
+Flight_Recorder *flight_recorder_create(int cycles, int trigger_pc) {
+  if (cycles <= 0) {
+    return NULL;
+  }
+  Flight_Recorder *recorder = calloc(1, sizeof(*recorder));
+  if (!recorder) {
+    return NULL;
+  }
+  recorder->cycles = cycles;
+  recorder->trigger_pc = trigger_pc;
+  return recorder;
+}
+
+void flight_recorder_destroy(Flight_Recorder *recorder) {
+  if (!recorder) {
+    return;
+  }
+  for (int i = 0; i < 2; ++i) {
+    if (recorder->snapshot[i]) {
+      APEX_cpu_stop(recorder->snapshot[i]);
+    }
+  }
+  free(recorder);
+}
+
+/**
+ * Keeps a copy of the CPU as it is now, dropping the oldest one
+ * @param recorder
+ * @param cpu
+ * @return clock of the next copy, or -1 if out of memory
+ */
+int flight_recorder_snapshot(Flight_Recorder *recorder, const APEX_CPU *cpu) {
+  APEX_CPU *copy = APEX_cpu_clone(cpu);
+  if (!copy) {
+    return -1;
+  }
+  if (recorder->snapshot[1]) {
+    APEX_cpu_stop(recorder->snapshot[1]);
+  }
+  recorder->snapshot[1] = recorder->snapshot[0];
+  recorder->snapshot[0] = copy;
+  return cpu->clock + recorder->interval;
+}
+
+/**
+ * Starts recording a run. Copies share the pages of data memory, but
+ * cost its page table and a copy of every page written after, so they
+ * are made at most once per page of it.
+ * @param recorder
+ * @param cpu
+ * @return clock of the next copy, or -1 if out of memory
+ */
+int flight_recorder_start(Flight_Recorder *recorder, const APEX_CPU *cpu) {
+  int interval = SNAPSHOT_MIN_INTERVAL;
+  if (interval < recorder->cycles) {
+    interval = recorder->cycles;
+  }
+  if (interval < cpu->data_memory.num_pages) {
+    interval = cpu->data_memory.num_pages;
+  }
+  recorder->interval = interval;
+  return flight_recorder_snapshot(recorder, cpu);
+}
+
+int flight_recorder_trigger_pc(const Flight_Recorder *recorder) {
+  return recorder->trigger_pc;
+}
+
+/**
+ * Prints the last cycles run, as display printed them
+ * @param recorder
+ * @param cpu the CPU as the run left it
+ * @param out
+ * @return 0 on success, -1 if out of memory
+ */
+int flight_recorder_dump(Flight_Recorder *recorder, const APEX_CPU *cpu,
+                         FILE *out) {
+  int first = cpu->clock - recorder->cycles;
+  const APEX_CPU *from = recorder->snapshot[0];
+  if (!from) {
+    return 0;
+  }
+  if (from->clock > first && recorder->snapshot[1]) {
+    from = recorder->snapshot[1];
+  }
+
+  APEX_CPU *replay = APEX_cpu_clone(from);
+  if (!replay) {
+    return -1;
+  }
+  replay->config.out = NULL;
+  replay->config.debug_messages = 0;
+  while (replay->clock < cpu->clock) {
+    if (replay->clock >= first) {
+      replay->config.out = out;
+      replay->config.debug_messages = 1;
+    }
+    APEX_cpu_cycle(replay);
+  }
+  APEX_cpu_stop(replay);
+  return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef _APEX_FLIGHT_RECORDER_H_
+#define _APEX_FLIGHT_RECORDER_H_
+/**
+ *  flight_recorder.h
+ *  Contains the flight recorder, which prints the last few cycles of a
+ *  pipeline run in the display format once the run stops
+ */
+#include <stdio.h>
+
+#include "cpu.h"
+
+typedef struct Flight_Recorder Flight_Recorder;
+
+Flight_Recorder *flight_recorder_create(int cycles, int trigger_pc);
+
+void flight_recorder_destroy(Flight_Recorder *recorder);
+
+int flight_recorder_start(Flight_Recorder *recorder, const APEX_CPU *cpu);
+
+int flight_recorder_snapshot(Flight_Recorder *recorder, const APEX_CPU *cpu);
+
+int flight_recorder_trigger_pc(const Flight_Recorder *recorder);
+
+int flight_recorder_dump(Flight_Recorder *recorder, const APEX_CPU *cpu,
+                         FILE *out);
+
+#endif
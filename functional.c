@@ -0,0 +1,128 @@
+/*
+ *  functional.c
+ *  Contains the functional (ISA-only) APEX simulator. Instructions run
+ *  one at a time with the semantics of the pipeline's execute, memory
+ *  and writeback stages, but no timing is modelled: no latches, stalls
+ *  or forwarding, and no clock.
+ */
+#include "cpu.h"
+
+/**
+ * Runs instructions from cpu->pc on the architectural state of cpu
+ * (regs, data_memory, pc and zFlag) until HALT, until the pc leaves
+ * code memory or an invalid instruction is reached, or until
+ * max_instructions have run (0 means no limit).
+ *
+ * As in the ISA, only ADD, SUB and MUL set the Z flag; cpu->zFlag
+ * holds the result of the latest of them. BZ and BNZ branch relative
+ * to their own pc and JUMP goes to register + literal.
+ *
+ * @param cpu
+ * @param max_instructions
+ * @param executed if given, incremented by the number of instructions run
+ * @return 1 if the program finished, 0 if it stopped at the limit
+ */
+int APEX_cpu_run_functional(APEX_CPU *cpu, uint64_t max_instructions,
+                            uint64_t *executed) {
+  const APEX_Instruction *code = cpu->code_memory;
+  int *regs = cpu->regs;
+  APEX_Memory *mem = &cpu->data_memory;
+  int pc = cpu->pc;
+  int zFlag = cpu->zFlag;
+  uint64_t count = 0;
+  int finished = 0;
+
+  while (!max_instructions || count < max_instructions) {
+    int index = get_code_index(pc);
+    if (index < 0 || index >= cpu->code_memory_size) {
+      finished = 1;
+      break;
+    }
+
+    const APEX_Instruction *ins = &code[index];
+    int next_pc = pc + 4;
+
+    switch (ins->opcode_id) {
+      case OP_MOVC:
+        regs[ins->rd] = ins->imm;
+        break;
+
+      case OP_ADD:
+        zFlag = regs[ins->rd] = regs[ins->rs1] + regs[ins->rs2];
+        break;
+
+      case OP_SUB:
+        zFlag = regs[ins->rd] = regs[ins->rs1] - regs[ins->rs2];
+        break;
+
+      case OP_MUL:
+        zFlag = regs[ins->rd] = regs[ins->rs1] * regs[ins->rs2];
+        break;
+
+      case OP_AND:
+        regs[ins->rd] = regs[ins->rs1] & regs[ins->rs2];
+        break;
+
+      case OP_OR:
+        regs[ins->rd] = regs[ins->rs1] | regs[ins->rs2];
+        break;
+
+      case OP_EX_OR:
+        regs[ins->rd] = regs[ins->rs1] ^ regs[ins->rs2];
+        break;
+
+      case OP_LOAD:
+        regs[ins->rd] = memory_load(mem, regs[ins->rs1] + ins->imm);
+        break;
+
+      case OP_STORE:
+        memory_store(mem, regs[ins->rs2] + ins->imm, regs[ins->rs1]);
+        break;
+
+      case OP_BZ:
+        if (zFlag == 0) {
+          next_pc = pc + ins->imm;
+        }
+        break;
+
+      case OP_BNZ:
+        if (zFlag != 0) {
+          next_pc = pc + ins->imm;
+        }
+        break;
+
+      case OP_JUMP:
+        next_pc = regs[ins->rs1] + ins->imm;
+        break;
+
+      case OP_HALT:
+        cpu->haltFlag = 1;
+        finished = 1;
+        break;
+
+      case OP_EMPTY:
+        break;
+
+      default:
+        /** fetch never gets past an invalid instruction */
+        finished = 1;
+        break;
+    }
+
+    if (finished) {
+      /** pc is left on the HALT or invalid instruction */
+      count += ins->opcode_id == OP_HALT;
+      break;
+    }
+
+    count++;
+    pc = next_pc;
+  }
+
+  cpu->pc = pc;
+  cpu->zFlag = zFlag;
+  if (executed) {
+    *executed += count;
+  }
+  return finished;
+}
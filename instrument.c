@@ -0,0 +1,121 @@
+/*
+ *  instrument.c
+ *  Contains the totals of the host-side instrumentation and their report,
+ *  see instrument.h. Empty unless built with -DAPEX_INSTRUMENT.
+ */
+#include "instrument.h"
+
+#ifdef APEX_INSTRUMENT
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+__thread APEX_Instrument_Counters apex_instrument_local;
+
+/* Counters flushed by all threads so far */
+static APEX_Instrument_Counters totals;
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Clocks read when the process started, to turn ticks into nanoseconds */
+static uint64_t start_ticks;
+static uint64_t start_ns;
+
+static const char *region_names[NUM_INSTR_REGIONS] = {
+  [INSTR_WRITEBACK] = "writeback",
+  [INSTR_MEMORY] = "memory",
+  [INSTR_EXECUTE] = "execute",
+  [INSTR_DECODE] = "decode",
+  [INSTR_FETCH] = "fetch",
+  [INSTR_RUN] = "run",
+  [INSTR_PARSE_READ] = "parse_read",
+  [INSTR_PARSE_LINES] = "parse_lines",
+  [INSTR_PARSE_RELEASE] = "parse_release",
+};
+
+static uint64_t monotonic_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+/**
+ * Adds the counters of the calling thread to the totals and clears them
+ */
+void instrument_flush(void) {
+  pthread_mutex_lock(&totals_lock);
+  for (int i = 0; i < NUM_INSTR_REGIONS; ++i) {
+    totals.ticks[i] += apex_instrument_local.ticks[i];
+    totals.calls[i] += apex_instrument_local.calls[i];
+  }
+  pthread_mutex_unlock(&totals_lock);
+  for (int i = 0; i < NUM_INSTR_REGIONS; ++i) {
+    apex_instrument_local.ticks[i] = 0;
+    apex_instrument_local.calls[i] = 0;
+  }
+}
+
+/**
+ * Resident set size of the process now, in KiB
+ * @return 0 if unknown
+ */
+static long current_rss_kib(void) {
+  FILE *fp = fopen("/proc/self/statm", "r");
+  if (!fp) {
+    return 0;
+  }
+  long pages = 0, resident = 0;
+  if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) {
+    resident = 0;
+  }
+  fclose(fp);
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * Prints the totals to stderr. Ticks are turned into nanoseconds by the
+ * rate the clock went at over the life of the process.
+ */
+static void instrument_report(void) {
+  instrument_flush();
+
+  uint64_t elapsed_ns = monotonic_ns() - start_ns;
+  uint64_t elapsed_ticks = instrument_ticks() - start_ticks;
+  double ns_per_tick = elapsed_ticks ? (double) elapsed_ns / elapsed_ticks : 1.0;
+
+  fprintf(stderr, "APEX_Instrument : %-14s %14s %16s %12s\n", "region",
+          "calls", "host ns", "ns per call");
+  for (int i = 0; i < NUM_INSTR_REGIONS; ++i) {
+    if (!totals.calls[i]) {
+      continue;
+    }
+    double ns = totals.ticks[i] * ns_per_tick;
+    fprintf(stderr, "APEX_Instrument : %-14s %14llu %16.0f %12.2f\n",
+            region_names[i], (unsigned long long) totals.calls[i], ns,
+            ns / totals.calls[i]);
+  }
+
+  double run_seconds = totals.ticks[INSTR_RUN] * ns_per_tick / 1e9;
+  if (run_seconds > 0) {
+    fprintf(stderr, "APEX_Instrument : %llu cycles simulated in %.6f s, "
+            "%.0f cycles per host second\n",
+            (unsigned long long) totals.calls[INSTR_RUN], run_seconds,
+            totals.calls[INSTR_RUN] / run_seconds);
+  }
+
+  struct rusage usage;
+  long peak_kib = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+  fprintf(stderr, "APEX_Instrument : host memory at exit %ld KiB resident, "
+          "%ld KiB peak\n", current_rss_kib(), peak_kib);
+}
+
+__attribute__((constructor)) static void instrument_init(void) {
+  start_ns = monotonic_ns();
+  start_ticks = instrument_ticks();
+  atexit(instrument_report);
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef _APEX_INSTRUMENT_H_
+#define _APEX_INSTRUMENT_H_
+/**
+ *  instrument.h
+ *  Contains the host-side instrumentation of the simulator, which times
+ *  the pipeline stages and the parser phases on the host. It is only
+ *  compiled in with -DAPEX_INSTRUMENT ("make INSTRUMENT=1"); otherwise
+ *  the macros below expand to nothing and cost nothing.
+ *
+ *  Timings are taken with the time stamp counter where there is one and
+ *  clock_gettime otherwise. Each thread adds them up on its own and
+ *  hands them in with INSTRUMENT_FLUSH once it is done with a run or a
+ *  parse; the totals are printed to stderr when the process exits.
+ */
+#include <stdint.h>
+
+/* Parts of the simulator timed */
+typedef enum APEX_Instrument_Region {
+  INSTR_WRITEBACK,
+  INSTR_MEMORY,
+  INSTR_EXECUTE,
+  INSTR_DECODE,
+  INSTR_FETCH,
+  INSTR_RUN,            // Pipeline loop of APEX_cpu_run, calls are cycles
+  INSTR_PARSE_READ,     // Opening and mapping or reading the program
+  INSTR_PARSE_LINES,    // Turning its lines into code memory
+  INSTR_PARSE_RELEASE,  // Unmapping or freeing the text
+  NUM_INSTR_REGIONS
+} APEX_Instrument_Region;
+
+#ifdef APEX_INSTRUMENT
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+/* Time spent in each region, and the number of times it was entered */
+typedef struct APEX_Instrument_Counters {
+  uint64_t ticks[NUM_INSTR_REGIONS];
+  uint64_t calls[NUM_INSTR_REGIONS];
+} APEX_Instrument_Counters;
+
+/* Counters of the calling thread not flushed yet */
+extern __thread APEX_Instrument_Counters apex_instrument_local;
+
+/**
+ * Reads the clock the regions are timed with: the time stamp counter on
+ * x86, nanoseconds elsewhere
+ * @return
+ */
+static inline uint64_t instrument_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+#endif
+}
+
+/**
+ * Adds to a region the ticks since *start, and moves *start on to now
+ * so that back to back regions take one clock read each
+ * @param region
+ * @param start
+ * @param calls times the region was entered
+ */
+static inline void instrument_lap(APEX_Instrument_Region region,
+                                  uint64_t *start, uint64_t calls) {
+  uint64_t now = instrument_ticks();
+  apex_instrument_local.ticks[region] += now - *start;
+  apex_instrument_local.calls[region] += calls;
+  *start = now;
+}
+
+void instrument_flush(void);
+
+#define INSTRUMENT_START(start) uint64_t start = instrument_ticks()
+#define INSTRUMENT_LAP(region, start) instrument_lap(region, &start, 1)
+#define INSTRUMENT_LAP_CALLS(region, start, calls) \
+  instrument_lap(region, &start, calls)
+#define INSTRUMENT_FLUSH() instrument_flush()
+
+#else
+
+#define INSTRUMENT_START(start)
+#define INSTRUMENT_LAP(region, start)
+#define INSTRUMENT_LAP_CALLS(region, start, calls)
+#define INSTRUMENT_FLUSH()
+
+#endif
+
+#endif
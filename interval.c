@@ -0,0 +1,286 @@
+/*
+ *  interval.c
+ *  Contains the interval mode. A functional pass runs the program and
+ *  keeps the architectural state (regs, data_memory, pc and zFlag) seen
+ *  warmup instructions before the start of every interval. Each interval
+ *  is then run on the pipeline of its own CPU, on the thread pool, from
+ *  that state: the warmup instructions fill the pipeline and the
+ *  interval itself is timed. The first interval starts from the CPU as
+ *  it is, so it needs no warmup. Cycles of all intervals are added up.
+ *
+ *  The functional pass owns the architectural state, as in the sampled
+ *  mode. Intervals are timed independently, so the total differs from a
+ *  plain pipeline run by a few cycles at every interval boundary.
+ */
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "interval.h"
+#include "thread_pool.h"
+
+/* Architectural state an interval is timed from, and its timing */
+typedef struct Interval {
+    int regs[32];
+    int pc;
+    int zFlag;
+    uint64_t warmup;        // Instructions before the interval start
+    uint64_t instructions;  // Instructions of the interval itself
+    uint64_t cycles;        // Cycles the pipeline took for them
+    APEX_Memory data_memory;  // Shares the pages the program has not
+                              // written since
+} Interval;
+
+/* Shared by the interval tasks */
+typedef struct Interval_Job {
+    const APEX_CPU *start;  // CPU as it was before the functional pass
+    Interval **intervals;
+    atomic_int failed;      // Set by any task that ran out of memory
+} Interval_Job;
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Runs the functional mode for up to count instructions, less if the
+ * instruction limit comes first
+ * @return number of instructions run
+ */
+static uint64_t run_functional(APEX_CPU *cpu, uint64_t count,
+                               uint64_t max_instructions,
+                               APEX_Interval_Result *result) {
+  if (max_instructions && max_instructions - result->instructions < count) {
+    count = max_instructions - result->instructions;
+  }
+  uint64_t executed = 0;
+  if (count > 0) {
+    result->finished = APEX_cpu_run_functional(cpu, count, &executed);
+  }
+  result->instructions += executed;
+  return executed;
+}
+
+/**
+ * Times one interval on the pipeline of a copy of the start CPU
+ * @param arg
+ * @param index
+ */
+static void time_interval(void *arg, int index) {
+  Interval_Job *job = arg;
+  Interval *interval = job->intervals[index];
+  APEX_CPU *detail = APEX_cpu_clone(job->start);
+  if (!detail) {
+    atomic_store_explicit(&job->failed, 1, memory_order_relaxed);
+    return;
+  }
+
+  if (index > 0) {
+    memcpy(detail->regs, interval->regs, sizeof(interval->regs));
+    memory_free(&detail->data_memory);
+    if (memory_share(&detail->data_memory, &interval->data_memory) != 0) {
+      APEX_cpu_stop(detail);
+      atomic_store_explicit(&job->failed, 1, memory_order_relaxed);
+      return;
+    }
+    detail->pc = interval->pc;
+    detail->zFlag = interval->zFlag;
+    APEX_cpu_reset_pipeline(detail);
+  }
+
+  APEX_cpu_run_timed(detail, interval->warmup, interval->instructions,
+                     &interval->cycles);
+  APEX_cpu_stop(detail);
+}
+
+/**
+ * Runs the pipeline from the start CPU as APEX_cpu_run would, for the
+ * error check. Like the intervals, it gives up at MAX_TIMED_CPI cycles
+ * per instruction of the functional pass, so that a program that
+ * deadlocks on the pipeline cannot hang it.
+ * @param start
+ * @param max_instructions
+ * @param instructions run by the functional pass
+ * @param gave_up set if the run stopped at that limit
+ * @return cycles taken, from cycle 0
+ */
+static uint64_t run_serial(const APEX_CPU *start, uint64_t max_instructions,
+                           uint64_t instructions, int *gave_up) {
+  APEX_CPU *cpu = APEX_cpu_clone(start);
+  if (!cpu) {
+    return 0;
+  }
+  uint64_t first = cpu->ins_retired;
+  uint64_t max_cycles = MAX_TIMED_CPI * instructions + NUM_STAGES;
+  int start_clock = cpu->clock;
+  while (cpu->ins_completed != cpu->code_memory_size &&
+         (!max_instructions || cpu->ins_retired - first < max_instructions)) {
+    if ((uint64_t) (cpu->clock - start_clock) >= max_cycles) {
+      *gave_up = 1;
+      break;
+    }
+    APEX_cpu_cycle(cpu);
+  }
+  uint64_t cycles = cpu->clock;
+  APEX_cpu_stop(cpu);
+  return cycles;
+}
+
+/**
+ * Runs the program in the interval mode, up to max_instructions (0 means
+ * no limit)
+ * @param cpu
+ * @param config
+ * @param max_instructions
+ * @param result
+ * @return 0 on success, -1 on a bad config or out of memory
+ */
+int APEX_cpu_run_intervals(APEX_CPU *cpu, const APEX_Interval_Config *config,
+                           uint64_t max_instructions,
+                           APEX_Interval_Result *result) {
+  memset(result, 0, sizeof(*result));
+  if (config->interval == 0) {
+    return -1;
+  }
+  uint64_t warmup = config->warmup < config->interval ? config->warmup
+                                                      : config->interval;
+
+  double start_time = now_seconds();
+  Interval_Job job = {0};
+  atomic_init(&job.failed, 0);
+  APEX_CPU *start = APEX_cpu_clone(cpu);
+  int capacity = 0;
+  int ok = start != NULL;
+
+  /** Functional pass: interval i is run up to warmup before its end, the
+   * state there is kept for interval i + 1, then interval i is run on */
+  Interval *interval = calloc(1, sizeof(Interval));
+  ok = ok && interval != NULL;
+  while (ok) {
+    if (result->intervals == capacity) {
+      capacity = capacity ? 2 * capacity : 64;
+      Interval **grown = realloc(job.intervals, capacity * sizeof(*grown));
+      if (!grown) {
+        memory_free(&interval->data_memory);
+        free(interval);
+        ok = 0;
+        break;
+      }
+      job.intervals = grown;
+    }
+    job.intervals[result->intervals++] = interval;
+
+    uint64_t count = run_functional(cpu, config->interval - warmup,
+                                    max_instructions, result);
+    interval->instructions += count;
+    if (result->finished || count < config->interval - warmup) {
+      break;
+    }
+
+    Interval *next = malloc(sizeof(Interval));
+    if (!next || memory_share(&next->data_memory, &cpu->data_memory) != 0) {
+      free(next);
+      ok = 0;
+      break;
+    }
+    memcpy(next->regs, cpu->regs, sizeof(next->regs));
+    next->pc = cpu->pc;
+    next->zFlag = cpu->zFlag;
+    next->warmup = warmup;
+    next->instructions = 0;
+    next->cycles = 0;
+
+    count = run_functional(cpu, warmup, max_instructions, result);
+    interval->instructions += count;
+    if (result->finished || count < warmup ||
+        (max_instructions && result->instructions == max_instructions)) {
+      memory_free(&next->data_memory);
+      free(next);
+      break;
+    }
+    interval = next;
+  }
+  result->functional_seconds = now_seconds() - start_time;
+
+  if (ok) {
+    Thread_Pool *pool = thread_pool_create(config->threads > 0
+                                           ? config->threads
+                                           : thread_pool_default_size());
+    if (pool) {
+      job.start = start;
+      result->threads = thread_pool_size(pool);
+      thread_pool_run(pool, time_interval, &job, result->intervals);
+      thread_pool_destroy(pool);
+      ok = !atomic_load_explicit(&job.failed, memory_order_relaxed);
+    } else {
+      ok = 0;
+    }
+  }
+
+  if (ok) {
+    result->cycles = start->clock;
+    for (int i = 0; i < result->intervals; ++i) {
+      result->cycles += job.intervals[i]->cycles;
+    }
+  }
+  result->seconds = now_seconds() - start_time;
+
+  if (ok && config->check_serial) {
+    double serial_start = now_seconds();
+    result->serial_cycles = run_serial(start, max_instructions,
+                                       result->instructions,
+                                       &result->serial_gave_up);
+    result->serial_seconds = now_seconds() - serial_start;
+  }
+
+  for (int i = 0; i < result->intervals; ++i) {
+    memory_free(&job.intervals[i]->data_memory);
+    free(job.intervals[i]);
+  }
+  free(job.intervals);
+  if (start) {
+    APEX_cpu_stop(start);
+  }
+  return ok ? 0 : -1;
+}
+
+/**
+ * Prints the outcome of an interval run
+ * @param out
+ * @param config
+ * @param result
+ */
+void print_interval_result(FILE *out, const APEX_Interval_Config *config,
+                           const APEX_Interval_Result *result) {
+  fprintf(out, "=========INTERVAL SIMULATION============\n");
+  fprintf(out, " Interval %llu, warmup %llu instructions, %d threads\n",
+          (unsigned long long) config->interval,
+          (unsigned long long) config->warmup, result->threads);
+  fprintf(out, " Instructions          %llu\n",
+          (unsigned long long) result->instructions);
+  fprintf(out, " Intervals             %d\n", result->intervals);
+  fprintf(out, " Cycles                %llu\n", (unsigned long long) result->cycles);
+  fprintf(out, " Time                  %.3f s (functional pass %.3f s)\n",
+          result->seconds, result->functional_seconds);
+  if (config->check_serial) {
+    double error = result->serial_cycles
+                   ? 100.0 * ((double) result->cycles - result->serial_cycles) /
+                     result->serial_cycles
+                   : 0.0;
+    if (result->serial_gave_up) {
+      fprintf(out, " Serial cycles         %llu (gave up at %d cycles per "
+              "instruction)\n", (unsigned long long) result->serial_cycles,
+              MAX_TIMED_CPI);
+    } else {
+      fprintf(out, " Serial cycles         %llu (error %+.4f%%)\n",
+              (unsigned long long) result->serial_cycles, error);
+    }
+    fprintf(out, " Serial time           %.3f s (speedup %.2fx)\n",
+            result->serial_seconds,
+            result->seconds > 0 ? result->serial_seconds / result->seconds : 0.0);
+  }
+}
@@ -0,0 +1,33 @@
+#ifndef _APEX_INTERVAL_H_
+#define _APEX_INTERVAL_H_
+/**
+ *  interval.h
+ *  Contains the interval mode, which splits a run into fixed-size
+ *  intervals and times them on the pipeline in parallel
+ */
+#include <stdint.h>
+
+#include "cpu.h"
+
+/* Outcome of an interval run */
+typedef struct APEX_Interval_Result {
+    uint64_t instructions;      // Instructions run, functionally
+    int intervals;              // Intervals timed on the pipeline
+    int threads;                // Threads they were timed on
+    uint64_t cycles;            // Sum of the interval cycles, from cycle 0
+    double seconds;             // Wall time of the whole run
+    double functional_seconds;  // Wall time of the functional pass
+    uint64_t serial_cycles;     // Cycles of a plain pipeline run, if checked
+    int serial_gave_up;         // Set if that run hit MAX_TIMED_CPI
+    double serial_seconds;      // Wall time of that run
+    int finished;               // 1 if the program finished
+} APEX_Interval_Result;
+
+int APEX_cpu_run_intervals(APEX_CPU *cpu, const APEX_Interval_Config *config,
+                           uint64_t max_instructions,
+                           APEX_Interval_Result *result);
+
+void print_interval_result(FILE *out, const APEX_Interval_Config *config,
+                           const APEX_Interval_Result *result);
+
+#endif
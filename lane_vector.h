@@ -0,0 +1,58 @@
+#ifndef _APEX_LANE_VECTOR_H_
+#define _APEX_LANE_VECTOR_H_
+/**
+ *  lane_vector.h
+ *  Contains the vectors of lanes the lanes and lockstep modes keep their
+ *  per-instance state in: one int32 per lane, LANE_WIDTH lanes to a
+ *  vector, operated on with the GCC vector extensions
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Lanes per vector: a 256-bit register with AVX2, 128 bits otherwise */
+#ifdef __AVX2__
+#define LANE_WIDTH 8
+#else
+#define LANE_WIDTH 4
+#endif
+
+typedef int32_t Lane_Vector __attribute__((vector_size(LANE_WIDTH * sizeof(int32_t))));
+typedef uint32_t Lane_Bits __attribute__((vector_size(LANE_WIDTH * sizeof(uint32_t))));
+typedef int64_t Count_Vector __attribute__((vector_size(LANE_WIDTH * sizeof(int64_t))));
+
+/* a in the lanes set in mask, b in the others; masks are -1 in a set
+ * lane, 0 otherwise */
+#define blend(mask, a, b) (((a) & (mask)) | ((b) & ~(mask)))
+
+/**
+ * Tells whether any lane of a mask is set
+ * @param mask
+ * @return
+ */
+static inline int lane_any(Lane_Vector mask) {
+  int any = 0;
+  for (int i = 0; i < LANE_WIDTH; ++i) {
+    any |= mask[i];
+  }
+  return any != 0;
+}
+
+/**
+ * Allocates count zeroed vectors, or blocks of vectors, of size bytes
+ * each, aligned to their size
+ * @param count
+ * @param size a multiple of sizeof(Lane_Vector)
+ * @return NULL if out of memory
+ */
+static inline void *alloc_vectors(size_t count, size_t size) {
+  size_t alignment = sizeof(Count_Vector);
+  void *p = aligned_alloc(alignment, (count * size + alignment - 1) /
+                                     alignment * alignment);
+  if (p) {
+    memset(p, 0, count * size);
+  }
+  return p;
+}
+
+#endif
@@ -0,0 +1,537 @@
+/*
+ *  lanes.c
+ *  Contains the lanes mode, vector functional lanes. Many instances
+ *  (lanes) of one program, each with its own registers, flags, pc and
+ *  data memory, are run in the functional mode with the semantics of
+ *  APEX_cpu_run_functional. Only the architectural state is kept per
+ *  lane; lockstep.c runs the pipeline over lanes.
+ *
+ *  Lane state is kept as a structure of arrays: every register is a row
+ *  of Lane_Vectors, LANE_WIDTH lanes each, so one instruction is applied
+ *  to all lanes with vector operations (SSE, or AVX2 when built for it,
+ *  e.g. with CFLAGS=-march=native). Every step issues the instruction
+ *  at the lowest pc of the running lanes to all lanes at that pc,
+ *  masking out the others. Lanes that branch apart are thereby stepped
+ *  in turns, and come back together when the ones behind catch up, e.g.
+ *  at the end of a loop. LOAD and STORE go lane by lane, as every lane
+ *  has its own memory. Lane memories start out sharing the pages of the
+ *  CPU's, so a lane only costs memory for the pages it stores to.
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lane_vector.h"
+#include "lanes.h"
+
+struct APEX_Lanes {
+  const APEX_Instruction *code_memory;
+  int code_memory_size;
+  int lanes;
+  int vectors;            // lanes / LANE_WIDTH, rounded up
+
+  /* One entry per vector; masks are -1 in a set lane, 0 otherwise */
+  Lane_Vector *regs;      // regs[reg * vectors + v], all 32 register slots
+  Lane_Vector *pc;
+  Lane_Vector *zFlag;
+  Lane_Vector *done;      // Lane no longer runs
+  Lane_Vector *finished;  // Lane ran to its end rather than to the limit
+  Count_Vector *instructions;
+  uint64_t steps;
+
+  APEX_Memory *data_memory;   // One per lane
+  int data_memory_size;
+};
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Creates lanes instances of the program of cpu, all starting from its
+ * architectural state (regs, data_memory, pc and zFlag)
+ * @param cpu
+ * @param lanes
+ * @return NULL if out of memory
+ */
+APEX_Lanes *APEX_lanes_create(const APEX_CPU *cpu, int lanes) {
+  if (lanes <= 0) {
+    return NULL;
+  }
+  APEX_Lanes *ls = calloc(1, sizeof(*ls));
+  if (!ls) {
+    return NULL;
+  }
+  ls->code_memory = cpu->code_memory;
+  ls->code_memory_size = cpu->code_memory_size;
+  ls->lanes = lanes;
+  ls->vectors = (lanes + LANE_WIDTH - 1) / LANE_WIDTH;
+  ls->data_memory_size = cpu->data_memory.size;
+
+  int vectors = ls->vectors;
+  ls->regs = alloc_vectors(32 * vectors, sizeof(Lane_Vector));
+  ls->pc = alloc_vectors(vectors, sizeof(Lane_Vector));
+  ls->zFlag = alloc_vectors(vectors, sizeof(Lane_Vector));
+  ls->done = alloc_vectors(vectors, sizeof(Lane_Vector));
+  ls->finished = alloc_vectors(vectors, sizeof(Lane_Vector));
+  ls->instructions = alloc_vectors(vectors, sizeof(Count_Vector));
+  ls->data_memory = calloc(lanes, sizeof(*ls->data_memory));
+  if (!ls->regs || !ls->pc || !ls->zFlag || !ls->done || !ls->finished ||
+      !ls->instructions || !ls->data_memory) {
+    APEX_lanes_destroy(ls);
+    return NULL;
+  }
+  for (int lane = 0; lane < lanes; ++lane) {
+    if (memory_share(&ls->data_memory[lane], &cpu->data_memory) != 0) {
+      APEX_lanes_destroy(ls);
+      return NULL;
+    }
+  }
+
+  for (int v = 0; v < vectors; ++v) {
+    for (int i = 0; i < LANE_WIDTH; ++i) {
+      for (int reg = 0; reg < 32; ++reg) {
+        ls->regs[reg * vectors + v][i] = cpu->regs[reg];
+      }
+      ls->pc[v][i] = cpu->pc;
+      ls->zFlag[v][i] = cpu->zFlag;
+      /** Padding lanes past the last one never run */
+      ls->done[v][i] = v * LANE_WIDTH + i < lanes ? 0 : -1;
+    }
+  }
+  return ls;
+}
+
+void APEX_lanes_destroy(APEX_Lanes *ls) {
+  if (!ls) {
+    return;
+  }
+  free(ls->regs);
+  free(ls->pc);
+  free(ls->zFlag);
+  free(ls->done);
+  free(ls->finished);
+  free(ls->instructions);
+  if (ls->data_memory) {
+    for (int lane = 0; lane < ls->lanes; ++lane) {
+      memory_free(&ls->data_memory[lane]);
+    }
+    free(ls->data_memory);
+  }
+  free(ls);
+}
+
+/**
+ * Data memory of one lane, data_memory_size words, to set up its input
+ * @param ls
+ * @param lane
+ * @return
+ */
+APEX_Memory *APEX_lanes_data_memory(APEX_Lanes *ls, int lane) {
+  return &ls->data_memory[lane];
+}
+
+/**
+ * Reads data memory images, one per line of whitespace separated words
+ * starting at MRM[0]; '#' starts a comment and blank lines are skipped.
+ * Lane i gets image i modulo the number of images; words past the end
+ * of an image keep their value.
+ * @param ls NULL to only count the images
+ * @param filename
+ * @return number of images, -1 on error
+ */
+int APEX_lanes_load_data(APEX_Lanes *ls, const char *filename) {
+  return APEX_lanes_load_memories(ls ? ls->data_memory : NULL,
+                                  ls ? ls->lanes : 0, filename);
+}
+
+/**
+ * Reads data memory images into the memories of lanes, as
+ * APEX_lanes_load_data does
+ * @param memories one per lane, all of the same size; NULL to only count
+ * the images
+ * @param lanes
+ * @param filename
+ * @return number of images, -1 on error
+ */
+int APEX_lanes_load_memories(APEX_Memory *memories, int lanes,
+                             const char *filename) {
+  FILE *fp = fopen(filename, "r");
+  if (!fp) {
+    fprintf(stderr, "APEX_Error : Unable to open lane data %s\n", filename);
+    return -1;
+  }
+
+  int images = 0;
+  int line_number = 0;
+  char *line = NULL;
+  size_t capacity = 0;
+  int *image = NULL;
+  int image_capacity = 0;
+  while (getline(&line, &capacity, fp) != -1) {
+    line_number++;
+    char *comment = strchr(line, '#');
+    if (comment) {
+      *comment = '\0';
+    }
+    if (strspn(line, " \t\r\n") == strlen(line)) {
+      continue;
+    }
+
+    int words = 0;
+    char *p = line;
+    while (1) {
+      char *end;
+      long value = strtol(p, &end, 10);
+      if (end == p) {
+        break;
+      }
+      if (memories && words == memories[0].size) {
+        fprintf(stderr, "APEX_Error : %s:%d: Image larger than data memory\n",
+                filename, line_number);
+        images = -1;
+        break;
+      }
+      if (words == image_capacity) {
+        int grown = image_capacity ? 2 * image_capacity : 256;
+        int *larger = realloc(image, sizeof(int) * grown);
+        if (!larger) {
+          fprintf(stderr, "APEX_Error : Out of memory for lane data\n");
+          images = -1;
+          break;
+        }
+        image = larger;
+        image_capacity = grown;
+      }
+      image[words++] = (int) value;
+      p = end;
+    }
+    if (images < 0) {
+      break;
+    }
+    if (strspn(p, " \t\r\n") != strlen(p)) {
+      fprintf(stderr, "APEX_Error : %s:%d: Bad word\n", filename, line_number);
+      images = -1;
+      break;
+    }
+    /** Image i goes to lane i, and is shared by the later lanes below */
+    if (memories && images < lanes) {
+      memory_write(&memories[images], 0, words, image);
+    }
+    images++;
+  }
+  free(image);
+  free(line);
+  fclose(fp);
+
+  if (memories && images > 0) {
+    for (int lane = images; lane < lanes; ++lane) {
+      memory_free(&memories[lane]);
+      if (memory_share(&memories[lane], &memories[lane % images]) != 0) {
+        fprintf(stderr, "APEX_Error : Out of memory for lane data\n");
+        return -1;
+      }
+    }
+  }
+  return images;
+}
+
+/**
+ * Runs every lane until it finishes, as APEX_cpu_run_functional would,
+ * or until it has run max_instructions in all (0 means no limit)
+ * @param ls
+ * @param max_instructions
+ * @return number of steps taken
+ */
+uint64_t APEX_lanes_run(APEX_Lanes *ls, uint64_t max_instructions) {
+  const int vectors = ls->vectors;
+  Lane_Vector *const regs = ls->regs;
+  Lane_Vector *const pcs = ls->pc;
+  Lane_Vector *const done = ls->done;
+  const Count_Vector limit = (Count_Vector) {} + (int64_t) max_instructions;
+  uint64_t first_step = ls->steps;
+
+  Lane_Vector *issued = malloc(sizeof(Lane_Vector) * vectors);
+  int *issued_vectors = malloc(sizeof(int) * vectors);
+  if (!issued || !issued_vectors) {
+    free(issued);
+    free(issued_vectors);
+    return 0;
+  }
+
+/* Register reg of the lanes of vector v */
+#define REG(reg, v) regs[(reg) * vectors + (v)]
+
+/* Runs body for every vector with lanes at the issued pc, with v and mask set */
+#define FOR_EACH_ISSUED(body) \
+  for (int k = 0; k < num_issued; ++k) { \
+    const int v = issued_vectors[k]; \
+    const Lane_Vector mask = issued[v]; \
+    body \
+  }
+
+  /** Lanes stopped at an earlier limit carry on up to this one */
+  for (int v = 0; v < vectors; ++v) {
+    for (int i = 0; i < LANE_WIDTH; ++i) {
+      done[v][i] = v * LANE_WIDTH + i >= ls->lanes || ls->finished[v][i] ||
+                   (max_instructions && ls->instructions[v][i] >= limit[i])
+                   ? -1 : 0;
+    }
+  }
+
+  while (1) {
+    /** Lowest pc of the running lanes */
+    const Lane_Vector none = (Lane_Vector) {} + INT_MAX;
+    Lane_Vector lowest = none;
+    for (int v = 0; v < vectors; ++v) {
+      Lane_Vector pc = blend(done[v], none, pcs[v]);
+      lowest = blend(pc < lowest, pc, lowest);
+    }
+    int pc = INT_MAX;
+    for (int i = 0; i < LANE_WIDTH; ++i) {
+      pc = lowest[i] < pc ? lowest[i] : pc;
+    }
+    if (pc == INT_MAX) {
+      break;
+    }
+
+    const Lane_Vector target = (Lane_Vector) {} + pc;
+    int num_issued = 0;
+    for (int v = 0; v < vectors; ++v) {
+      issued[v] = (pcs[v] == target) & ~done[v];
+      if (lane_any(issued[v])) {
+        issued_vectors[num_issued++] = v;
+      }
+    }
+
+    int index = get_code_index(pc);
+    static const APEX_Instruction outside = {.opcode_id = OP_INVALID};
+    const APEX_Instruction *ins = index >= 0 && index < ls->code_memory_size
+                                  ? &ls->code_memory[index] : &outside;
+    const int rd = ins->rd, rs1 = ins->rs1, rs2 = ins->rs2, imm = ins->imm;
+    Lane_Vector next_pc = target + 4;
+
+    switch (ins->opcode_id) {
+      case OP_MOVC:
+        FOR_EACH_ISSUED(REG(rd, v) = blend(mask, (Lane_Vector) {} + imm, REG(rd, v));)
+        break;
+
+      case OP_ADD:
+        FOR_EACH_ISSUED(
+          Lane_Vector result = REG(rs1, v) + REG(rs2, v);
+          REG(rd, v) = blend(mask, result, REG(rd, v));
+          ls->zFlag[v] = blend(mask, result, ls->zFlag[v]);)
+        break;
+
+      case OP_SUB:
+        FOR_EACH_ISSUED(
+          Lane_Vector result = REG(rs1, v) - REG(rs2, v);
+          REG(rd, v) = blend(mask, result, REG(rd, v));
+          ls->zFlag[v] = blend(mask, result, ls->zFlag[v]);)
+        break;
+
+      case OP_MUL:
+        FOR_EACH_ISSUED(
+          Lane_Vector result = REG(rs1, v) * REG(rs2, v);
+          REG(rd, v) = blend(mask, result, REG(rd, v));
+          ls->zFlag[v] = blend(mask, result, ls->zFlag[v]);)
+        break;
+
+      case OP_AND:
+        FOR_EACH_ISSUED(REG(rd, v) = blend(mask, REG(rs1, v) & REG(rs2, v), REG(rd, v));)
+        break;
+
+      case OP_OR:
+        FOR_EACH_ISSUED(REG(rd, v) = blend(mask, REG(rs1, v) | REG(rs2, v), REG(rd, v));)
+        break;
+
+      case OP_EX_OR:
+        FOR_EACH_ISSUED(REG(rd, v) = blend(mask, REG(rs1, v) ^ REG(rs2, v), REG(rd, v));)
+        break;
+
+      case OP_LOAD:
+        FOR_EACH_ISSUED(
+          for (int i = 0; i < LANE_WIDTH; ++i) {
+            if (mask[i]) {
+              REG(rd, v)[i] = memory_load(&ls->data_memory[v * LANE_WIDTH + i],
+                                          REG(rs1, v)[i] + imm);
+            }
+          })
+        break;
+
+      case OP_STORE:
+        FOR_EACH_ISSUED(
+          for (int i = 0; i < LANE_WIDTH; ++i) {
+            if (mask[i]) {
+              memory_store(&ls->data_memory[v * LANE_WIDTH + i],
+                           REG(rs2, v)[i] + imm, REG(rs1, v)[i]);
+            }
+          })
+        break;
+
+      case OP_BZ:
+      case OP_BNZ:
+        FOR_EACH_ISSUED(
+          Lane_Vector taken = ins->opcode_id == OP_BZ ? ls->zFlag[v] == 0
+                                                       : ls->zFlag[v] != 0;
+          pcs[v] = blend(mask, next_pc + (taken & (imm - 4)), pcs[v]);)
+        break;
+
+      case OP_JUMP:
+        FOR_EACH_ISSUED(pcs[v] = blend(mask, REG(rs1, v) + imm, pcs[v]);)
+        break;
+
+      case OP_HALT:
+      case OP_EMPTY:
+        break;
+
+      default:
+        /** Invalid instruction or pc outside code memory, as in the
+         * functional mode: the lane finishes there, not counted */
+        FOR_EACH_ISSUED(
+          done[v] |= mask;
+          ls->finished[v] |= mask;)
+        continue;
+    }
+
+    ls->steps++;
+    FOR_EACH_ISSUED(
+      if (ins->opcode_id == OP_HALT) {
+        /** pc is left on the HALT */
+        done[v] |= mask;
+        ls->finished[v] |= mask;
+      } else if (ins->opcode_id < OP_BZ || ins->opcode_id == OP_EMPTY) {
+        pcs[v] = blend(mask, next_pc, pcs[v]);
+      }
+      ls->instructions[v] -= __builtin_convertvector(mask, Count_Vector);
+      if (max_instructions) {
+        Lane_Vector at_limit =
+            __builtin_convertvector(ls->instructions[v] >= limit, Lane_Vector);
+        done[v] |= mask & at_limit;
+      })
+  }
+
+#undef FOR_EACH_ISSUED
+#undef REG
+
+  free(issued);
+  free(issued_vectors);
+  return ls->steps - first_step;
+}
+
+/**
+ * Gives the state and outcome of one lane
+ * @param ls
+ * @param lane
+ * @param result
+ */
+void APEX_lanes_get_lane(const APEX_Lanes *ls, int lane,
+                            APEX_Lane *result) {
+  int v = lane / LANE_WIDTH;
+  int i = lane % LANE_WIDTH;
+  result->finished = ls->finished[v][i] != 0;
+  result->instructions = ls->instructions[v][i];
+  result->pc = ls->pc[v][i];
+  result->zFlag = ls->zFlag[v][i];
+  for (int reg = 0; reg < 16; ++reg) {
+    result->regs[reg] = ls->regs[reg * ls->vectors + v][i];
+  }
+}
+
+/**
+ * Runs the program of cpu in the lanes mode, up to max_instructions
+ * per lane (0 means no limit). The architectural state of cpu becomes
+ * that of lane 0.
+ * @param cpu
+ * @param config
+ * @param max_instructions
+ * @param result lanes are to be freed by the caller
+ * @return 0 on success, -1 on bad lane data or out of memory
+ */
+int APEX_cpu_run_lanes(APEX_CPU *cpu, const APEX_Lanes_Config *config,
+                          uint64_t max_instructions,
+                          APEX_Lanes_Result *result) {
+  memset(result, 0, sizeof(*result));
+  int lanes = config->lanes;
+  if (lanes <= 0) {
+    lanes = config->lane_data ? APEX_lanes_load_data(NULL, config->lane_data)
+                              : 1;
+    if (lanes <= 0) {
+      return -1;
+    }
+  }
+
+  APEX_Lanes *ls = APEX_lanes_create(cpu, lanes);
+  result->lane = malloc(sizeof(*result->lane) * lanes);
+  if (!ls || !result->lane ||
+      (config->lane_data && APEX_lanes_load_data(ls, config->lane_data) <= 0)) {
+    APEX_lanes_destroy(ls);
+    free(result->lane);
+    result->lane = NULL;
+    return -1;
+  }
+
+  double start_time = now_seconds();
+  result->steps = APEX_lanes_run(ls, max_instructions);
+  result->seconds = now_seconds() - start_time;
+
+  result->lanes = lanes;
+  for (int lane = 0; lane < lanes; ++lane) {
+    APEX_Lane *state = &result->lane[lane];
+    APEX_lanes_get_lane(ls, lane, state);
+    result->finished_lanes += state->finished;
+    result->instructions += state->instructions;
+  }
+
+  /** Lane 0 back into cpu */
+  const APEX_Lane *first = &result->lane[0];
+  for (int reg = 0; reg < 32; ++reg) {
+    cpu->regs[reg] = ls->regs[reg * ls->vectors][0];
+  }
+  /** Lane 0's memory is handed over rather than copied */
+  memory_free(&cpu->data_memory);
+  cpu->data_memory = ls->data_memory[0];
+  memset(&ls->data_memory[0], 0, sizeof(ls->data_memory[0]));
+  cpu->pc = first->pc;
+  cpu->zFlag = first->zFlag;
+  int index = get_code_index(first->pc);
+  cpu->haltFlag = first->finished && index >= 0 && index < cpu->code_memory_size &&
+                  cpu->code_memory[index].opcode_id == OP_HALT;
+
+  APEX_lanes_destroy(ls);
+  return 0;
+}
+
+/**
+ * Prints the outcome of a lanes run, with a line per lane
+ * @param out
+ * @param result
+ */
+void print_lanes_result(FILE *out, const APEX_Lanes_Result *result) {
+  fprintf(out, "=========VECTOR LANES SIMULATION============\n");
+  fprintf(out, " Lanes                 %d (%d finished), %d per vector\n",
+          result->lanes, result->finished_lanes, LANE_WIDTH);
+  fprintf(out, " Instructions          %llu over all lanes\n",
+          (unsigned long long) result->instructions);
+  fprintf(out, " Steps                 %llu (%.1f%% of lanes busy)\n",
+          (unsigned long long) result->steps,
+          result->steps ? 100.0 * result->instructions /
+                          ((double) result->steps * result->lanes) : 0.0);
+  fprintf(out, " Time                  %.3f s, %.1f M instance-instructions/s\n",
+          result->seconds,
+          result->seconds > 0 ? result->instructions / result->seconds / 1e6 : 0.0);
+  fprintf(out, " Lane status instructions pc R0-R15\n");
+  for (int lane = 0; lane < result->lanes; ++lane) {
+    const APEX_Lane *state = &result->lane[lane];
+    fprintf(out, " %d %s %llu %d", lane, state->finished ? "complete" : "stopped",
+            (unsigned long long) state->instructions, state->pc);
+    for (int reg = 0; reg < 16; ++reg) {
+      fprintf(out, " %d", state->regs[reg]);
+    }
+    fprintf(out, "\n");
+  }
+}
@@ -0,0 +1,56 @@
+#ifndef _APEX_LANES_H_
+#define _APEX_LANES_H_
+/**
+ *  lanes.h
+ *  Contains the lanes mode, which runs many instances (lanes) of one
+ *  program side by side, each on its own data, in the functional mode
+ *  with vector instructions
+ */
+#include <stdint.h>
+
+#include "cpu.h"
+
+/* Outcome of one lane */
+typedef struct APEX_Lane {
+    int finished;               // 1 if the lane finished, 0 if it stopped at the limit
+    uint64_t instructions;
+    int pc;
+    int zFlag;
+    int regs[16];
+} APEX_Lane;
+
+/* Outcome of a lanes run */
+typedef struct APEX_Lanes_Result {
+    int lanes;
+    int finished_lanes;
+    uint64_t steps;             // Instructions issued, each to all lanes at its pc
+    uint64_t instructions;      // Instructions run, summed over lanes
+    double seconds;
+    APEX_Lane *lane;   // lanes entries, malloc'd
+} APEX_Lanes_Result;
+
+typedef struct APEX_Lanes APEX_Lanes;
+
+APEX_Lanes *APEX_lanes_create(const APEX_CPU *cpu, int lanes);
+
+void APEX_lanes_destroy(APEX_Lanes *ls);
+
+APEX_Memory *APEX_lanes_data_memory(APEX_Lanes *ls, int lane);
+
+int APEX_lanes_load_data(APEX_Lanes *ls, const char *filename);
+
+int APEX_lanes_load_memories(APEX_Memory *memories, int lanes,
+                             const char *filename);
+
+uint64_t APEX_lanes_run(APEX_Lanes *ls, uint64_t max_instructions);
+
+void APEX_lanes_get_lane(const APEX_Lanes *ls, int lane,
+                            APEX_Lane *result);
+
+int APEX_cpu_run_lanes(APEX_CPU *cpu, const APEX_Lanes_Config *config,
+                          uint64_t max_instructions,
+                          APEX_Lanes_Result *result);
+
+void print_lanes_result(FILE *out, const APEX_Lanes_Result *result);
+
+#endif
@@ -0,0 +1,998 @@
+/*
+ *  lockstep.c
+ *  Contains the lockstep mode. Many instances (lanes) of the pipeline,
+ *  each with its own latches, scoreboard, registers, pc and data memory,
+ *  run one program in lockstep: every clock cycle advances all lanes,
+ *  stage by stage in the order APEX_cpu_run uses, with the semantics of
+ *  the stage functions of cpu.c. A lane comes to the same cycle count
+ *  and state as APEX_cpu_run would on its data.
+ *
+ *  Lane state is kept as a structure of arrays, in blocks of LANE_WIDTH
+ *  lanes (a Lane_Pipeline): every field of every latch, and every
+ *  register, is a Lane_Vector of the lanes of the block. A stage is a
+ *  kernel over a block: the conditions of cpu.c become per-lane masks,
+ *  and every update is blended into the lanes its mask selects, so lanes
+ *  that branch apart, stall or flush at different times still advance
+ *  together. Only register file reads and writes, instruction fetch,
+ *  LOAD and STORE go lane by lane, as they index per-lane state. Lane
+ *  memories start out sharing the pages of the CPU's, as in lanes.c.
+ *
+ *  The lanes run without the profile, trace, flight recorder,
+ *  checkpoints and performance counters of APEX_cpu_run.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lane_vector.h"
+#include "lanes.h"
+#include "lockstep.h"
+
+#define ALWAYS_INLINE __attribute__((always_inline))
+
+/* A latch of the lanes of a block, one vector per field of CPU_Stage.
+ * Flags hold masks, -1 when set. */
+typedef struct Lane_Latch {
+  Lane_Vector pc;
+  Lane_Vector imm;
+  Lane_Vector rs1_value;
+  Lane_Vector rs2_value;
+  Lane_Vector buffer;
+  Lane_Vector mem_address;
+  Lane_Vector zFlag;
+  Lane_Vector seq;
+  Lane_Vector opcode_id;
+  Lane_Vector rs1;
+  Lane_Vector rs2;
+  Lane_Vector rd;
+  Lane_Vector rdPrev;
+  Lane_Vector busy;
+  Lane_Vector stalled;
+  Lane_Vector stallDueToNextStage;
+  Lane_Vector flushInNextStage;
+  Lane_Vector handleJumpInNextStage;
+  Lane_Vector handleBZInNextStage;
+  Lane_Vector handleBNZInNextStage;
+  Lane_Vector stallDueToLoadFlag;
+  Lane_Vector mulCycles;
+} Lane_Latch;
+
+/* Pipelines of a block of LANE_WIDTH lanes */
+typedef struct Lane_Pipeline {
+  Lane_Latch stage[NUM_STAGES];
+  Lane_Vector regs[32];           // All 32 register slots
+  Lane_Bits pending_regs;
+  Lane_Bits written_regs;
+  Lane_Vector pc;
+  Lane_Vector ins_completed;
+  Lane_Vector zFlag;
+  Lane_Vector haltFlag;           // Mask
+  Lane_Vector clock;
+  Lane_Vector ins_fetched;
+  Lane_Vector last_retired;
+  Lane_Vector ins_retired;
+  Lane_Vector done;               // Lane no longer runs
+  Lane_Vector finished;           // Lane ran to its end rather than to the limit
+} Lane_Pipeline;
+
+struct APEX_Lockstep {
+  const APEX_Instruction *code_memory;
+  int code_memory_size;
+  int forwarding;
+  int mul_latency;
+  int lanes;
+  int vectors;                // Blocks, lanes / LANE_WIDTH rounded up
+  int clock;                  // Cycle the lanes still running are at
+  uint64_t cycles;
+
+  Lane_Pipeline *pipeline;    // One per block
+  APEX_Memory *data_memory;   // One per lane
+};
+
+/* Fetches past either end of code memory see an empty slot */
+static const APEX_Instruction empty_instruction;
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Vector of a value in every lane */
+#define splat(value) ((Lane_Vector) {} + (value))
+
+/**
+ * Scoreboard bits of the register slots of a vector of lanes, as REG_BIT
+ * @param reg
+ * @return
+ */
+static inline ALWAYS_INLINE Lane_Bits reg_bit(Lane_Vector reg) {
+  return ((Lane_Bits) {} + 1) << ((Lane_Bits) reg & 31);
+}
+
+/**
+ * Marks a register as written back, or freed by a flush, in the lanes
+ * of mask
+ * @param p
+ * @param mask
+ * @param reg
+ */
+static inline ALWAYS_INLINE void set_reg_written(Lane_Pipeline *p,
+                                                 Lane_Vector mask,
+                                                 Lane_Vector reg) {
+  Lane_Bits bit = reg_bit(reg) & (Lane_Bits) mask;
+  p->pending_regs &= ~bit;
+  p->written_regs |= bit;
+}
+
+/**
+ * Mask of the lanes in which a register has been written back, or freed
+ * by a flush, and is not pending again since
+ * @param p
+ * @param reg
+ * @return
+ */
+static inline ALWAYS_INLINE Lane_Vector is_reg_written(const Lane_Pipeline *p,
+                                                       Lane_Vector reg) {
+  return (p->written_regs & ~p->pending_regs & reg_bit(reg)) != 0;
+}
+
+/**
+ * Copies a latch into another in the lanes of mask
+ * @param to
+ * @param from
+ * @param mask
+ */
+static inline ALWAYS_INLINE void copy_latch(Lane_Latch *to,
+                                            const Lane_Latch *from,
+                                            Lane_Vector mask) {
+  if (!lane_any(mask)) {
+    return;
+  }
+  Lane_Vector *dst = (Lane_Vector *) to;
+  const Lane_Vector *src = (const Lane_Vector *) from;
+  for (size_t f = 0; f < sizeof(Lane_Latch) / sizeof(Lane_Vector); ++f) {
+    dst[f] = blend(mask, src[f], dst[f]);
+  }
+}
+
+/**
+ * Empties a latch in the lanes of mask, as flushStageWithEmpty
+ * @param p
+ * @param stageName
+ * @param mask
+ */
+static inline ALWAYS_INLINE void flush_with_empty(Lane_Pipeline *p,
+                                                  enum myEnum stageName,
+                                                  Lane_Vector mask) {
+  Lane_Latch *stage = &p->stage[stageName];
+  if (!lane_any(mask)) {
+    return;
+  }
+  set_reg_written(p, mask, stage->rd);
+  stage->opcode_id = blend(mask, splat(OP_EMPTY), stage->opcode_id);
+  stage->rd = blend(mask, splat(REG_FLUSHED), stage->rd);
+  stage->rs1 = blend(mask, splat(REG_FLUSHED), stage->rs1);
+  stage->rs2 = blend(mask, splat(REG_FLUSHED), stage->rs2);
+  stage->imm = blend(mask, splat(999), stage->imm);
+  stage->rdPrev = blend(mask, splat(REG_FLUSHED), stage->rdPrev);
+}
+
+/**
+ * Turns a latch into a NOP in the lanes of mask, as flushStageWithNOP
+ * @param p
+ * @param stageName
+ * @param mask
+ * @param dontChangeValid
+ * @param fromJump
+ */
+static inline ALWAYS_INLINE void flush_with_nop(Lane_Pipeline *p,
+                                                enum myEnum stageName,
+                                                Lane_Vector mask,
+                                                const int dontChangeValid,
+                                                const int fromJump) {
+  Lane_Latch *stage = &p->stage[stageName];
+  if (!lane_any(mask)) {
+    return;
+  }
+  if (!dontChangeValid) {
+    set_reg_written(p, mask, stage->rd);
+  }
+  stage->opcode_id = blend(mask, splat(OP_NOP), stage->opcode_id);
+  stage->rd = blend(mask, splat(REG_FLUSHED), stage->rd);
+  stage->rs1 = blend(mask, splat(REG_FLUSHED), stage->rs1);
+  stage->rs2 = blend(mask, splat(REG_FLUSHED), stage->rs2);
+  stage->imm = blend(mask, splat(999), stage->imm);
+  stage->rdPrev = blend(mask, splat(REG_FLUSHED), stage->rdPrev);
+  if (fromJump) {
+    stage->stallDueToNextStage &= ~mask;
+    stage->flushInNextStage &= ~mask;
+    stage->handleJumpInNextStage &= ~mask;
+    stage->handleBZInNextStage &= ~mask;
+    stage->handleBNZInNextStage &= ~mask;
+    stage->stallDueToLoadFlag &= ~mask;
+  }
+}
+
+/**
+ * Forwards a source operand from EX into decode in the lanes of mask,
+ * as forward_from_ex in cpu.c
+ * @param p
+ * @param memory data memories of the lanes of the block
+ * @param mask
+ * @param value source operand to fill in
+ * @param valueFilled set in the lanes it was filled in, cleared in those
+ * that stall for a LOAD
+ * @return mask of the lanes that have just stalled for a LOAD
+ */
+static inline ALWAYS_INLINE Lane_Vector forward_from_ex(Lane_Pipeline *p,
+                                                        APEX_Memory *memory,
+                                                        Lane_Vector mask,
+                                                        Lane_Vector *value,
+                                                        Lane_Vector *valueFilled) {
+  Lane_Latch *stage = &p->stage[DRF];
+  const Lane_Latch *ex = &p->stage[EX];
+  const Lane_Latch *mem = &p->stage[MEM];
+
+  Lane_Vector waiting = mask & stage->stallDueToLoadFlag;
+  Lane_Vector loaded = waiting & (mem->opcode_id == OP_LOAD);
+  if (lane_any(loaded)) {
+    for (int i = 0; i < LANE_WIDTH; ++i) {
+      if (loaded[i]) {
+        (*value)[i] = memory_load(&memory[i], mem->mem_address[i]);
+      }
+    }
+  }
+  stage->stalled = blend(waiting, ~loaded, stage->stalled);
+  stage->stallDueToLoadFlag &= ~loaded;
+  *valueFilled |= loaded;
+
+  Lane_Vector now = mask & ~waiting;
+  *value = blend(now, ex->buffer, *value);
+  Lane_Vector justStalled = now & (ex->opcode_id == OP_LOAD);
+  stage->stalled |= justStalled;
+  stage->stallDueToLoadFlag |= justStalled;
+  *valueFilled = blend(now, ~justStalled, *valueFilled);
+  return justStalled;
+}
+
+/**
+ * Fetch stage of the lanes of a block, as fetch_stage
+ * @param ls
+ * @param p
+ * @param run lanes still running
+ */
+static inline ALWAYS_INLINE void fetch_lanes(const APEX_Lockstep *ls,
+                                             Lane_Pipeline *p, Lane_Vector run) {
+  Lane_Latch *stage = &p->stage[F];
+  Lane_Latch *decode = &p->stage[DRF];
+
+  Lane_Vector resumed = run & ~decode->stalled & stage->stalled &
+                        stage->stallDueToNextStage;
+  if (lane_any(resumed)) {
+    stage->stallDueToNextStage &= ~resumed;
+    stage->stalled &= ~resumed;
+    copy_latch(decode, stage, resumed);
+  }
+
+  Lane_Vector exec = run & ~resumed & ~stage->busy & ~stage->stalled;
+  if (!lane_any(exec)) {
+    return;
+  }
+  stage->pc = blend(exec, p->pc, stage->pc);
+
+  Lane_Vector opcode_id = {}, rd = {}, rs1 = {}, rs2 = {}, imm = {};
+  for (int i = 0; i < LANE_WIDTH; ++i) {
+    if (exec[i]) {
+      int index = get_code_index(p->pc[i]);
+      const APEX_Instruction *ins = index >= 0 && index < ls->code_memory_size
+                                    ? &ls->code_memory[index] : &empty_instruction;
+      opcode_id[i] = ins->opcode_id;
+      rd[i] = ins->rd;
+      rs1[i] = ins->rs1;
+      rs2[i] = ins->rs2;
+      imm[i] = ins->imm;
+    }
+  }
+
+  /** Only valid instructions are accepted */
+  Lane_Vector valid = exec & (opcode_id < OP_INVALID);
+  stage->opcode_id = blend(valid, opcode_id, stage->opcode_id);
+  stage->rd = blend(valid, rd, stage->rd);
+  stage->rs1 = blend(valid, rs1, stage->rs1);
+  stage->rs2 = blend(valid, rs2, stage->rs2);
+  stage->imm = blend(valid, imm, stage->imm);
+  stage->rdPrev = blend(valid, splat(REG_FLUSHED), stage->rdPrev);
+  p->ins_fetched -= valid;
+  stage->seq = blend(valid, p->ins_fetched, stage->seq);
+  p->pc += valid & 4;
+
+  flush_with_empty(p, F, valid & p->haltFlag);
+
+  copy_latch(decode, stage, valid & ~decode->stalled & ~stage->stalled);
+
+  Lane_Vector backpressure = valid & ~stage->stalled & decode->stalled;
+  stage->stalled |= backpressure;
+  stage->stallDueToNextStage |= backpressure;
+}
+
+/**
+ * Decode stage of the lanes of a block, as decode_stage
+ * @param p
+ * @param memory data memories of the lanes of the block
+ * @param run lanes still running
+ * @param forwarding
+ */
+static inline ALWAYS_INLINE void decode_lanes(Lane_Pipeline *p,
+                                              APEX_Memory *memory,
+                                              Lane_Vector run,
+                                              const int forwarding) {
+  Lane_Latch *stage = &p->stage[DRF];
+  Lane_Latch *ex = &p->stage[EX];
+  const Lane_Latch *mem = &p->stage[MEM];
+  const Lane_Latch *wb = &p->stage[WB];
+  const Lane_Vector op = stage->opcode_id;
+  const Lane_Vector rs1 = stage->rs1;
+  const Lane_Vector rs2 = stage->rs2;
+
+  /** Sources valid and available: JUMP and LOAD have only one */
+  Lane_Vector oneSrcReg = (op == OP_JUMP) | (op == OP_LOAD);
+  Lane_Bits sources = reg_bit(rs1) | reg_bit(rs2);
+  Lane_Vector hasRs1 = rs1 != REG_NONE;
+  Lane_Vector available =
+      (~oneSrcReg & hasRs1 & (rs2 != REG_NONE) &
+       ((p->pending_regs & sources) == 0)) |
+      (oneSrcReg & hasRs1 & ((p->pending_regs & reg_bit(rs1)) == 0));
+  stage->stalled &= ~(run & available);
+
+  Lane_Vector resumed = run & ~ex->stalled & stage->stalled &
+                        stage->stallDueToNextStage;
+  stage->stallDueToNextStage &= ~resumed;
+  stage->stalled &= ~resumed;
+
+  Lane_Vector justRemovedBZStall = run & stage->stalled & (op == OP_BZ) &
+                                   is_reg_written(p, stage->rdPrev);
+  stage->stalled &= ~justRemovedBZStall;
+  stage->rdPrev = blend(justRemovedBZStall, splat(REG_FLUSHED), stage->rdPrev);
+
+  Lane_Vector justRemovedBNZStall = run & stage->stalled & (op == OP_BNZ) &
+                                    is_reg_written(p, stage->rdPrev);
+  stage->stalled &= ~justRemovedBNZStall;
+  stage->rdPrev = blend(justRemovedBNZStall, splat(REG_FLUSHED), stage->rdPrev);
+
+  stage->stalled &= ~(run & stage->stallDueToLoadFlag);
+
+  Lane_Vector exec = run & ~stage->busy & ~stage->stalled;
+  if (!lane_any(exec)) {
+    return;
+  }
+
+  Lane_Vector notEmpty = op != OP_EMPTY;
+  Lane_Vector dependent = exec & notEmpty & ((p->pending_regs & sources) != 0);
+  Lane_Vector forwarded = {};
+  if (forwarding) {
+    forwarded = dependent;
+  } else {
+    stage->stalled |= dependent;
+  }
+
+  Lane_Vector pending = exec & notEmpty & ~stage->stalled & (stage->rd != REG_NONE);
+  p->pending_regs |= reg_bit(stage->rd) & (Lane_Bits) pending;
+
+  /** Register file reads, of ADD to EX_OR, STORE, LOAD and JUMP */
+  Lane_Vector alu = (op >= OP_ADD) & (op <= OP_EX_OR);
+  Lane_Vector readRs1 = exec & (alu | (op == OP_STORE) | (op == OP_LOAD) |
+                                (op == OP_JUMP));
+  Lane_Vector readRs2 = exec & (alu | (op == OP_STORE));
+  if (lane_any(readRs1)) {
+    for (int i = 0; i < LANE_WIDTH; ++i) {
+      if (readRs1[i]) {
+        stage->rs1_value[i] = p->regs[rs1[i]][i];
+      }
+      if (readRs2[i]) {
+        stage->rs2_value[i] = p->regs[rs2[i]][i];
+      }
+    }
+  }
+
+  if (!forwarding) {
+    Lane_Vector bz = exec & (op == OP_BZ);
+    Lane_Vector bnz = exec & (op == OP_BNZ);
+    Lane_Vector resolved = (bz & justRemovedBZStall) | (bnz & justRemovedBNZStall);
+    Lane_Vector waits = (bz | bnz) & ~resolved;
+    stage->handleBZInNextStage = blend(bz, justRemovedBZStall,
+                                       stage->handleBZInNextStage);
+    stage->handleBNZInNextStage = blend(bnz, justRemovedBNZStall,
+                                        stage->handleBNZInNextStage);
+    stage->zFlag = blend(resolved, p->zFlag, blend(waits, splat(999), stage->zFlag));
+    stage->stalled |= waits;
+    stage->rdPrev = blend(waits, ex->rd, stage->rdPrev);
+  }
+
+  if (forwarding && lane_any(forwarded)) {
+    Lane_Vector valueFilled = {};
+
+    Lane_Vector needed = forwarded & ((p->pending_regs & reg_bit(rs1)) != 0);
+    Lane_Vector fromEx = ex->rd == rs1;
+    Lane_Vector fromMem = mem->rd == rs1;
+    Lane_Vector fromWb = wb->rd == rs1;
+    /** STORE of a register other than its address register only takes
+     * it from MEM or WB, and goes ahead either way */
+    Lane_Vector store = needed & (op == OP_STORE) & (rs1 != rs2);
+    fromEx &= ~store;
+    valueFilled |= store;
+    Lane_Vector justStalledForBonusLoad =
+        forward_from_ex(p, memory, needed & fromEx, &stage->rs1_value,
+                        &valueFilled);
+    Lane_Vector taken = needed & ~fromEx & fromMem;
+    stage->rs1_value = blend(taken, mem->buffer, stage->rs1_value);
+    valueFilled |= taken;
+    taken = needed & ~fromEx & ~fromMem & fromWb;
+    stage->rs1_value = blend(taken, wb->buffer, stage->rs1_value);
+    valueFilled |= taken;
+
+    needed = forwarded & ((p->pending_regs & reg_bit(rs2)) != 0) &
+             ~justStalledForBonusLoad;
+    fromEx = ex->rd == rs2;
+    fromMem = mem->rd == rs2;
+    fromWb = wb->rd == rs2;
+    forward_from_ex(p, memory, needed & fromEx, &stage->rs2_value, &valueFilled);
+    taken = needed & ~fromEx & fromMem;
+    stage->rs2_value = blend(taken, mem->buffer, stage->rs2_value);
+    valueFilled |= taken;
+    taken = needed & ~fromEx & ~fromMem & fromWb;
+    stage->rs2_value = blend(taken, wb->buffer, stage->rs2_value);
+    valueFilled |= taken;
+
+    stage->stalled |= forwarded & ~valueFilled;
+  }
+
+  copy_latch(ex, stage, exec & ~ex->stalled & ~stage->stalled);
+
+  Lane_Vector backpressure = exec & ~stage->stalled & ex->stalled;
+  stage->stalled |= backpressure;
+  stage->stallDueToNextStage |= backpressure;
+}
+
+/**
+ * Execute stage of the lanes of a block, as execute_stage
+ * @param ls
+ * @param p
+ * @param run lanes still running
+ * @param forwarding
+ */
+static inline ALWAYS_INLINE void execute_lanes(const APEX_Lockstep *ls,
+                                               Lane_Pipeline *p,
+                                               Lane_Vector run,
+                                               const int forwarding) {
+  Lane_Latch *stage = &p->stage[EX];
+  const Lane_Latch *mem = &p->stage[MEM];
+  const Lane_Latch *wb = &p->stage[WB];
+
+  /** MUL held for mul_latency cycles; mulCycles counts in 8 bits */
+  Lane_Vector justRemovedMULStall = run & stage->stalled &
+                                    (stage->opcode_id == OP_MUL);
+  if (lane_any(justRemovedMULStall)) {
+    stage->mulCycles = blend(justRemovedMULStall, (stage->mulCycles + 1) & 255,
+                             stage->mulCycles);
+    justRemovedMULStall &= stage->mulCycles >= ls->mul_latency - 1;
+    stage->stalled &= ~justRemovedMULStall;
+  }
+
+  Lane_Vector exec = run & ~stage->busy & ~stage->stalled;
+  if (!lane_any(exec)) {
+    return;
+  }
+  const Lane_Vector op = stage->opcode_id;
+
+  Lane_Vector store = exec & (op == OP_STORE);
+  if (lane_any(store)) {
+    stage->mem_address = blend(store, stage->rs2_value + stage->imm,
+                               stage->mem_address);
+    Lane_Vector fromMem = store & (mem->rd == stage->rs1);
+    Lane_Vector fromWb = store & ~fromMem & (wb->rd == stage->rs1);
+    stage->rs1_value = blend(fromMem, mem->buffer,
+                             blend(fromWb, wb->buffer, stage->rs1_value));
+  }
+  stage->mem_address = blend(exec & (op == OP_LOAD), stage->rs1_value + stage->imm,
+                             stage->mem_address);
+
+  const Lane_Vector a = stage->rs1_value;
+  const Lane_Vector b = stage->rs2_value;
+  Lane_Vector result = stage->buffer;
+  result = blend(op == OP_MOVC, stage->imm, result);
+  result = blend(op == OP_ADD, a + b, result);
+  result = blend(op == OP_SUB, a - b, result);
+  result = blend(op == OP_MUL, a * b, result);
+  result = blend(op == OP_AND, a & b, result);
+  result = blend(op == OP_OR, a | b, result);
+  result = blend(op == OP_EX_OR, a ^ b, result);
+  stage->buffer = blend(exec, result, stage->buffer);
+
+  if (ls->mul_latency > 1) {
+    Lane_Vector held = exec & (op == OP_MUL) & ~justRemovedMULStall;
+    stage->stalled |= held;
+    stage->mulCycles &= ~held;
+  }
+
+  Lane_Vector bz = exec & (op == OP_BZ);
+  Lane_Vector bnz = exec & (op == OP_BNZ);
+  if (lane_any(bz | bnz)) {
+    Lane_Vector taken;
+    if (forwarding) {
+      Lane_Vector zero = mem->buffer == 0;
+      taken = (bz & zero) | (bnz & ~zero);
+    } else {
+      Lane_Vector zero = stage->zFlag == 0;
+      taken = (bz & stage->handleBZInNextStage & zero) |
+              (bnz & stage->handleBNZInNextStage & ~zero);
+      stage->handleBZInNextStage &= ~(bz & taken);
+      stage->handleBNZInNextStage &= ~(bnz & taken);
+      stage->zFlag = blend(taken, splat(999), stage->zFlag);
+    }
+    /** As bzBnzBranchHandling */
+    p->pc = blend(taken, p->pc + (stage->imm - 8) - 4, p->pc);
+    p->ins_completed = blend(taken, p->ins_completed + stage->imm / 4 - 1,
+                             p->ins_completed);
+    stage->flushInNextStage |= taken;
+  }
+
+  stage->handleJumpInNextStage |= exec & (op == OP_JUMP);
+
+  Lane_Vector halt = exec & (op == OP_HALT);
+  if (lane_any(halt)) {
+    flush_with_empty(p, F, halt);
+    flush_with_empty(p, DRF, halt);
+    p->ins_completed = blend(halt, splat(ls->code_memory_size - 2),
+                             p->ins_completed);
+    p->haltFlag |= halt;
+  }
+
+  const Lane_Latch *decode = &p->stage[DRF];
+  Lane_Vector branch = (op == OP_BZ) | (op == OP_BNZ);
+  flush_with_nop(p, EX, exec & ~stage->stalled & ~branch & decode->stalled &
+                        ~decode->stallDueToNextStage, 1, 0);
+
+  copy_latch(&p->stage[MEM], stage, exec & ~stage->stalled);
+}
+
+/**
+ * Memory stage of the lanes of a block, as memory_stage
+ * @param p
+ * @param memory data memories of the lanes of the block
+ * @param run lanes still running
+ */
+static inline ALWAYS_INLINE void memory_lanes(Lane_Pipeline *p,
+                                              APEX_Memory *memory,
+                                              Lane_Vector run) {
+  Lane_Latch *stage = &p->stage[MEM];
+
+  Lane_Vector exec = run & ~stage->busy & ~stage->stalled;
+  if (!lane_any(exec)) {
+    return;
+  }
+
+  Lane_Vector store = exec & (stage->opcode_id == OP_STORE);
+  Lane_Vector load = exec & (stage->opcode_id == OP_LOAD);
+  if (lane_any(store | load)) {
+    for (int i = 0; i < LANE_WIDTH; ++i) {
+      if (store[i]) {
+        memory_store(&memory[i], stage->mem_address[i], stage->rs1_value[i]);
+      } else if (load[i]) {
+        stage->buffer[i] = memory_load(&memory[i], stage->mem_address[i]);
+      }
+    }
+  }
+
+  /** Taken BZ and BNZ flush decode and EX */
+  Lane_Vector flush = exec & stage->flushInNextStage;
+  if (lane_any(flush)) {
+    flush_with_nop(p, DRF, flush, 0, 0);
+    flush_with_nop(p, EX, flush, 0, 0);
+    stage->flushInNextStage &= ~flush;
+  }
+
+  Lane_Vector jump = exec & stage->handleJumpInNextStage;
+  if (lane_any(jump)) {
+    Lane_Vector target = stage->rs1_value + stage->imm;
+    p->pc = blend(jump, target, p->pc);
+    p->ins_completed = blend(jump, (target - 4000) / 4 - 1, p->ins_completed);
+    flush_with_nop(p, DRF, jump, 0, 1);
+    flush_with_nop(p, EX, jump, 0, 1);
+    stage->handleJumpInNextStage &= ~jump;
+  }
+
+  flush_with_nop(p, MEM, exec & p->stage[EX].stalled, 1, 0);
+
+  copy_latch(&p->stage[WB], stage, exec);
+}
+
+/**
+ * Writeback stage of the lanes of a block, as writeback_stage
+ * @param p
+ * @param run lanes still running
+ */
+static inline ALWAYS_INLINE void writeback_lanes(Lane_Pipeline *p,
+                                                 Lane_Vector run) {
+  Lane_Latch *stage = &p->stage[WB];
+
+  Lane_Vector exec = run & ~stage->busy & ~stage->stalled;
+  if (!lane_any(exec)) {
+    return;
+  }
+  const Lane_Vector op = stage->opcode_id;
+
+  /** MOVC, ADD, SUB, MUL, AND, OR, EX_OR and LOAD, OP_ADD to OP_LOAD */
+  Lane_Vector writes = exec & (op >= OP_ADD) & (op <= OP_LOAD);
+  if (lane_any(writes)) {
+    for (int i = 0; i < LANE_WIDTH; ++i) {
+      if (writes[i]) {
+        p->regs[stage->rd[i]][i] = stage->buffer[i];
+      }
+    }
+  }
+
+  Lane_Vector arithmetic = (op == OP_ADD) | (op == OP_SUB) | (op == OP_MUL);
+  p->zFlag = blend(exec, blend(arithmetic, stage->buffer, splat(999)), p->zFlag);
+
+  set_reg_written(p, exec & ~((stage->rd == p->stage[DRF].rd) |
+                              (stage->rd == p->stage[EX].rd)), stage->rd);
+
+  Lane_Vector completed = exec & (op != OP_NOP);
+  p->ins_completed -= completed;
+  /** An instruction retires only the first time it gets here */
+  Lane_Vector retired = completed & (op != OP_EMPTY) &
+                        (stage->seq > p->last_retired);
+  p->last_retired = blend(retired, stage->seq, p->last_retired);
+  p->ins_retired -= retired;
+}
+
+/**
+ * Advances the running lanes of a block by one clock cycle
+ * @param ls
+ * @param p
+ * @param memory data memories of the lanes of the block
+ * @param run
+ * @param forwarding
+ */
+static inline ALWAYS_INLINE void cycle_lanes(const APEX_Lockstep *ls,
+                                             Lane_Pipeline *p,
+                                             APEX_Memory *memory,
+                                             Lane_Vector run,
+                                             const int forwarding) {
+  writeback_lanes(p, run);
+  memory_lanes(p, memory, run);
+  execute_lanes(ls, p, run, forwarding);
+  decode_lanes(p, memory, run, forwarding);
+  fetch_lanes(ls, p, run);
+  p->clock -= run;
+}
+
+/**
+ * Creates lanes instances of the pipeline of cpu, all starting from its
+ * state: latches, scoreboard, registers, pc, flags, clock and data memory
+ * @param cpu
+ * @param lanes
+ * @return NULL if out of memory
+ */
+APEX_Lockstep *APEX_lockstep_create(const APEX_CPU *cpu, int lanes) {
+  if (lanes <= 0) {
+    return NULL;
+  }
+  APEX_Lockstep *ls = calloc(1, sizeof(*ls));
+  if (!ls) {
+    return NULL;
+  }
+  ls->code_memory = cpu->code_memory;
+  ls->code_memory_size = cpu->code_memory_size;
+  ls->forwarding = cpu->config.data_forwarding != 0;
+  ls->mul_latency = cpu->config.mul_latency;
+  ls->lanes = lanes;
+  ls->vectors = (lanes + LANE_WIDTH - 1) / LANE_WIDTH;
+  ls->clock = cpu->clock;
+
+  ls->pipeline = alloc_vectors(ls->vectors, sizeof(Lane_Pipeline));
+  ls->data_memory = calloc(lanes, sizeof(*ls->data_memory));
+  if (!ls->pipeline || !ls->data_memory) {
+    APEX_lockstep_destroy(ls);
+    return NULL;
+  }
+  for (int lane = 0; lane < lanes; ++lane) {
+    if (memory_share(&ls->data_memory[lane], &cpu->data_memory) != 0) {
+      APEX_lockstep_destroy(ls);
+      return NULL;
+    }
+  }
+
+  for (int v = 0; v < ls->vectors; ++v) {
+    Lane_Pipeline *p = &ls->pipeline[v];
+    for (int i = 0; i < LANE_WIDTH; ++i) {
+      for (int s = 0; s < NUM_STAGES; ++s) {
+        const CPU_Stage *from = &cpu->stage[s];
+        Lane_Latch *to = &p->stage[s];
+        to->pc[i] = from->pc;
+        to->imm[i] = from->imm;
+        to->rs1_value[i] = from->rs1_value;
+        to->rs2_value[i] = from->rs2_value;
+        to->buffer[i] = from->buffer;
+        to->mem_address[i] = from->mem_address;
+        to->zFlag[i] = from->zFlag;
+        to->seq[i] = (int32_t) from->seq;
+        to->opcode_id[i] = from->opcode_id;
+        to->rs1[i] = from->rs1;
+        to->rs2[i] = from->rs2;
+        to->rd[i] = from->rd;
+        to->rdPrev[i] = from->rdPrev;
+        to->busy[i] = -(int32_t) from->busy;
+        to->stalled[i] = -(int32_t) from->stalled;
+        to->stallDueToNextStage[i] = -(int32_t) from->stallDueToNextStage;
+        to->flushInNextStage[i] = -(int32_t) from->flushInNextStage;
+        to->handleJumpInNextStage[i] = -(int32_t) from->handleJumpInNextStage;
+        to->handleBZInNextStage[i] = -(int32_t) from->handleBZInNextStage;
+        to->handleBNZInNextStage[i] = -(int32_t) from->handleBNZInNextStage;
+        to->stallDueToLoadFlag[i] = -(int32_t) from->stallDueToLoadFlag;
+        to->mulCycles[i] = from->mulCycles;
+      }
+      for (int reg = 0; reg < 32; ++reg) {
+        p->regs[reg][i] = cpu->regs[reg];
+      }
+      p->pending_regs[i] = cpu->pending_regs;
+      p->written_regs[i] = cpu->written_regs;
+      p->pc[i] = cpu->pc;
+      p->ins_completed[i] = cpu->ins_completed;
+      p->zFlag[i] = cpu->zFlag;
+      p->haltFlag[i] = cpu->haltFlag ? -1 : 0;
+      p->clock[i] = cpu->clock;
+      p->ins_fetched[i] = (int32_t) cpu->ins_fetched;
+      p->last_retired[i] = (int32_t) cpu->last_retired;
+      p->ins_retired[i] = (int32_t) cpu->ins_retired;
+      /** Padding lanes past the last one never run */
+      p->done[i] = v * LANE_WIDTH + i < lanes ? 0 : -1;
+    }
+  }
+  return ls;
+}
+
+void APEX_lockstep_destroy(APEX_Lockstep *ls) {
+  if (!ls) {
+    return;
+  }
+  free(ls->pipeline);
+  if (ls->data_memory) {
+    for (int lane = 0; lane < ls->lanes; ++lane) {
+      memory_free(&ls->data_memory[lane]);
+    }
+    free(ls->data_memory);
+  }
+  free(ls);
+}
+
+/**
+ * Data memory of one lane, to set up its input
+ * @param ls
+ * @param lane
+ * @return
+ */
+APEX_Memory *APEX_lockstep_data_memory(APEX_Lockstep *ls, int lane) {
+  return &ls->data_memory[lane];
+}
+
+/**
+ * Runs the lanes cycle by cycle, as run_lockstep does with a constant
+ * forwarding setting
+ * @param ls
+ * @param cycles
+ * @param forwarding
+ * @return
+ */
+static inline ALWAYS_INLINE uint64_t run_lanes(APEX_Lockstep *ls, int cycles,
+                                               const int forwarding) {
+  const Lane_Vector code_memory_size = splat(ls->code_memory_size);
+  uint64_t first_cycle = ls->cycles;
+  while (1) {
+    /** Lanes that committed all the instructions stop, before the cycle */
+    int running = 0;
+    for (int v = 0; v < ls->vectors; ++v) {
+      Lane_Pipeline *p = &ls->pipeline[v];
+      Lane_Vector complete = ~p->done & (p->ins_completed == code_memory_size);
+      p->finished |= complete;
+      p->done |= complete;
+      running |= lane_any(~p->done);
+    }
+    if (!running) {
+      break;
+    }
+
+    for (int v = 0; v < ls->vectors; ++v) {
+      Lane_Pipeline *p = &ls->pipeline[v];
+      Lane_Vector run = ~p->done;
+      if (lane_any(run)) {
+        cycle_lanes(ls, p, &ls->data_memory[v * LANE_WIDTH], run, forwarding);
+      }
+    }
+    ls->cycles++;
+
+    if (++ls->clock == cycles) {
+      break;
+    }
+  }
+  return ls->cycles - first_cycle;
+}
+
+/**
+ * Runs every lane until it finishes, as APEX_cpu_run would, or until the
+ * clock reaches cycles (0 means no limit)
+ * @param ls
+ * @param cycles
+ * @return number of cycles stepped
+ */
+uint64_t APEX_lockstep_run(APEX_Lockstep *ls, int cycles) {
+  return ls->forwarding ? run_lanes(ls, cycles, 1) : run_lanes(ls, cycles, 0);
+}
+
+/**
+ * Gives the state and outcome of one lane
+ * @param ls
+ * @param lane
+ * @param result
+ */
+void APEX_lockstep_get_lane(const APEX_Lockstep *ls, int lane,
+                            APEX_Lockstep_Lane *result) {
+  const Lane_Pipeline *p = &ls->pipeline[lane / LANE_WIDTH];
+  int i = lane % LANE_WIDTH;
+  result->finished = p->finished[i] != 0;
+  result->clock = p->clock[i];
+  result->instructions = (uint32_t) p->ins_retired[i];
+  result->pc = p->pc[i];
+  for (int reg = 0; reg < 16; ++reg) {
+    result->regs[reg] = p->regs[reg][i];
+  }
+}
+
+/**
+ * Gives cpu the full pipeline state of one lane, so that APEX_cpu_run
+ * can carry on from it. cpu's data memory becomes a copy of the lane's.
+ * @param ls
+ * @param lane
+ * @param cpu
+ * @return 0 on success, -1 if out of memory
+ */
+int APEX_lockstep_get_cpu(APEX_Lockstep *ls, int lane, APEX_CPU *cpu) {
+  APEX_Memory data_memory;
+  if (memory_share(&data_memory, &ls->data_memory[lane]) != 0) {
+    return -1;
+  }
+  memory_free(&cpu->data_memory);
+  cpu->data_memory = data_memory;
+
+  const Lane_Pipeline *p = &ls->pipeline[lane / LANE_WIDTH];
+  int i = lane % LANE_WIDTH;
+  for (int s = 0; s < NUM_STAGES; ++s) {
+    const Lane_Latch *from = &p->stage[s];
+    CPU_Stage *to = &cpu->stage[s];
+    to->pc = from->pc[i];
+    to->imm = from->imm[i];
+    to->rs1_value = from->rs1_value[i];
+    to->rs2_value = from->rs2_value[i];
+    to->buffer = from->buffer[i];
+    to->mem_address = from->mem_address[i];
+    to->zFlag = from->zFlag[i];
+    to->seq = (uint32_t) from->seq[i];
+    to->opcode_id = from->opcode_id[i];
+    to->rs1 = from->rs1[i];
+    to->rs2 = from->rs2[i];
+    to->rd = from->rd[i];
+    to->rdPrev = from->rdPrev[i];
+    to->busy = from->busy[i] != 0;
+    to->stalled = from->stalled[i] != 0;
+    to->stallDueToNextStage = from->stallDueToNextStage[i] != 0;
+    to->flushInNextStage = from->flushInNextStage[i] != 0;
+    to->handleJumpInNextStage = from->handleJumpInNextStage[i] != 0;
+    to->handleBZInNextStage = from->handleBZInNextStage[i] != 0;
+    to->handleBNZInNextStage = from->handleBNZInNextStage[i] != 0;
+    to->stallDueToLoadFlag = from->stallDueToLoadFlag[i] != 0;
+    to->mulCycles = from->mulCycles[i];
+  }
+  for (int reg = 0; reg < 32; ++reg) {
+    cpu->regs[reg] = p->regs[reg][i];
+  }
+  cpu->pending_regs = p->pending_regs[i];
+  cpu->written_regs = p->written_regs[i];
+  cpu->pc = p->pc[i];
+  cpu->ins_completed = p->ins_completed[i];
+  cpu->zFlag = p->zFlag[i];
+  cpu->haltFlag = p->haltFlag[i] != 0;
+  cpu->clock = p->clock[i];
+  cpu->ins_fetched = (uint32_t) p->ins_fetched[i];
+  cpu->last_retired = (uint32_t) p->last_retired[i];
+  cpu->ins_retired = (uint32_t) p->ins_retired[i];
+  return 0;
+}
+
+/**
+ * Runs the program of cpu in the lockstep mode, until the clock reaches
+ * cycles (0 means no limit). cpu takes over the state of lane 0.
+ * @param cpu
+ * @param config lanes and the data images they start from
+ * @param cycles
+ * @param result lanes are to be freed by the caller
+ * @return 0 on success, -1 on bad lane data or out of memory
+ */
+int APEX_cpu_run_lockstep(APEX_CPU *cpu, const APEX_Lanes_Config *config,
+                          int cycles, APEX_Lockstep_Result *result) {
+  memset(result, 0, sizeof(*result));
+  int lanes = config->lanes;
+  if (lanes <= 0) {
+    lanes = config->lane_data
+            ? APEX_lanes_load_memories(NULL, 0, config->lane_data) : 1;
+    if (lanes <= 0) {
+      return -1;
+    }
+  }
+
+  APEX_Lockstep *ls = APEX_lockstep_create(cpu, lanes);
+  result->lane = malloc(sizeof(*result->lane) * lanes);
+  if (!ls || !result->lane ||
+      (config->lane_data &&
+       APEX_lanes_load_memories(ls->data_memory, lanes, config->lane_data) <= 0)) {
+    APEX_lockstep_destroy(ls);
+    free(result->lane);
+    result->lane = NULL;
+    return -1;
+  }
+
+  int start_clock = cpu->clock;
+  uint64_t start_retired = cpu->ins_retired;
+  double start_time = now_seconds();
+  result->cycles = APEX_lockstep_run(ls, cycles);
+  result->seconds = now_seconds() - start_time;
+
+  result->lanes = lanes;
+  for (int lane = 0; lane < lanes; ++lane) {
+    APEX_Lockstep_Lane *state = &result->lane[lane];
+    APEX_lockstep_get_lane(ls, lane, state);
+    result->finished_lanes += state->finished;
+    result->instance_cycles += state->clock - start_clock;
+    result->instructions += state->instructions - start_retired;
+  }
+
+  int status = APEX_lockstep_get_cpu(ls, 0, cpu);
+  APEX_lockstep_destroy(ls);
+  if (status != 0) {
+    free(result->lane);
+    result->lane = NULL;
+  }
+  return status;
+}
+
+/**
+ * Prints the outcome of a lockstep run, with a line per lane
+ * @param out
+ * @param result
+ */
+void print_lockstep_result(FILE *out, const APEX_Lockstep_Result *result) {
+  fprintf(out, "=========LOCKSTEP PIPELINE SIMULATION============\n");
+  fprintf(out, " Lanes                 %d (%d finished), %d per vector\n",
+          result->lanes, result->finished_lanes, LANE_WIDTH);
+  fprintf(out, " Cycles                %llu, %llu over all lanes\n",
+          (unsigned long long) result->cycles,
+          (unsigned long long) result->instance_cycles);
+  fprintf(out, " Instructions          %llu over all lanes\n",
+          (unsigned long long) result->instructions);
+  fprintf(out, " Time                  %.3f s, %.1f M instance-cycles/s\n",
+          result->seconds,
+          result->seconds > 0 ? result->instance_cycles / result->seconds / 1e6
+                              : 0.0);
+  fprintf(out, " Lane status cycles instructions pc R0-R15\n");
+  for (int lane = 0; lane < result->lanes; ++lane) {
+    const APEX_Lockstep_Lane *state = &result->lane[lane];
+    fprintf(out, " %d %s %d %llu %d", lane,
+            state->finished ? "complete" : "stopped", state->clock,
+            (unsigned long long) state->instructions, state->pc);
+    for (int reg = 0; reg < 16; ++reg) {
+      fprintf(out, " %d", state->regs[reg]);
+    }
+    fprintf(out, "\n");
+  }
+}
@@ -0,0 +1,53 @@
+#ifndef _APEX_LOCKSTEP_H_
+#define _APEX_LOCKSTEP_H_
+/**
+ *  lockstep.h
+ *  Contains the lockstep mode, which runs many instances (lanes) of the
+ *  pipeline on one program side by side, each on its own data, all
+ *  advanced a clock cycle at a time with vector instructions
+ */
+#include <stdint.h>
+
+#include "cpu.h"
+
+/* Outcome of one lane */
+typedef struct APEX_Lockstep_Lane {
+    int finished;               // 1 if the lane finished, 0 if it stopped at the limit
+    int clock;                  // Cycles the lane ran, as APEX_cpu_run counts them
+    uint64_t instructions;      // Instructions retired
+    int pc;
+    int regs[16];
+} APEX_Lockstep_Lane;
+
+/* Outcome of a lockstep run */
+typedef struct APEX_Lockstep_Result {
+    int lanes;
+    int finished_lanes;
+    uint64_t cycles;            // Cycles stepped, each by all running lanes
+    uint64_t instance_cycles;   // Cycles run, summed over lanes
+    uint64_t instructions;      // Instructions retired, summed over lanes
+    double seconds;
+    APEX_Lockstep_Lane *lane;   // lanes entries, malloc'd
+} APEX_Lockstep_Result;
+
+typedef struct APEX_Lockstep APEX_Lockstep;
+
+APEX_Lockstep *APEX_lockstep_create(const APEX_CPU *cpu, int lanes);
+
+void APEX_lockstep_destroy(APEX_Lockstep *ls);
+
+APEX_Memory *APEX_lockstep_data_memory(APEX_Lockstep *ls, int lane);
+
+uint64_t APEX_lockstep_run(APEX_Lockstep *ls, int cycles);
+
+void APEX_lockstep_get_lane(const APEX_Lockstep *ls, int lane,
+                            APEX_Lockstep_Lane *result);
+
+int APEX_lockstep_get_cpu(APEX_Lockstep *ls, int lane, APEX_CPU *cpu);
+
+int APEX_cpu_run_lockstep(APEX_CPU *cpu, const APEX_Lanes_Config *config,
+                          int cycles, APEX_Lockstep_Result *result);
+
+void print_lockstep_result(FILE *out, const APEX_Lockstep_Result *result);
+
+#endif
@@ -3,32 +3,318 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "block_cache.h"
+#include "checkpoint.h"
+#include "counters.h"
 #include "cpu.h"
+#include "flight_recorder.h"
+#include "profile.h"
+#include "trace.h"
+
+/**
+ * Reads the value of a "--name=N" option into value
+ * @param arg
+ * @param name option name, "=" included
+ * @param value
+ * @return 1 if arg is that option
+ */
+static int parse_count_option(const char *arg, const char *name,
+                              uint64_t *value) {
+  size_t len = strlen(name);
+  if (strncmp(arg, name, len) != 0) {
+    return 0;
+  }
+  char *end;
+  *value = strtoull(arg + len, &end, 10);
+  if (end == arg + len || *end != '\0') {
+    fprintf(stderr, "APEX_Error : Bad value in %s\n", arg);
+    exit(1);
+  }
+  return 1;
+}
+
+/**
+ * Writes the profile of a run to a file, or to stdout if filename is "-"
+ * @param cpu
+ * @param source file the program was loaded from
+ * @param filename
+ * @param write APEX_profile_write_listing or APEX_profile_write_folded
+ * @return 0 on success, -1 on error
+ */
+static int write_profile(const APEX_CPU *cpu, const char *source,
+                         const char *filename,
+                         int (*write)(const APEX_Profile *, const APEX_CPU *,
+                                      const char *, FILE *)) {
+  if (strcmp(filename, "-") == 0) {
+    return write(cpu->profile, cpu, source, stdout);
+  }
+  FILE *fp = fopen(filename, "w");
+  if (!fp) {
+    return -1;
+  }
+  int result = write(cpu->profile, cpu, source, fp);
+  return fclose(fp) == 0 ? result : -1;
+}
+
+/* Cycles the flight recorder keeps if only --flight-trigger is given */
+#define FLIGHT_RECORDER_CYCLES 50
 
 int main(int argc, char const *argv[]) {
   if (argc < 2) {
-    fprintf(stderr, "APEX_Help : Usage %s <input_file>\n", argv[0]);
+    fprintf(stderr,
+            "APEX_Help : Usage %s <input_file> [<functionality> <cycles>] "
+            "[--load-stats] [--cache-stats] [--sample-period=N] "
+            "[--sample-window=N] [--sample-warmup=N] [--restore-checkpoint=FILE] "
+            "[--save-checkpoint=FILE] [--checkpoint-every=N] [--interval=N] "
+            "[--interval-warmup=N] [--threads=N] [--check-serial] "
+            "[--no-forwarding] [--mul-latency=N] [--data-memory=N] "
+            "[--lanes=N] [--lane-data=FILE] [--trace=FILE] "
+            "[--flight-recorder=N] [--flight-trigger=PC] [--counters=FILE] "
+            "[--profile=FILE] [--profile-folded=FILE]\n",
+            argv[0]);
     exit(1);
   }
 
-  APEX_CPU *cpu = APEX_cpu_init(argv[1]);
+  /* Positional arguments first, then any "--" options */
+  const char *positional[3] = {NULL, "display", "0"};
+  int num_positional = 0;
+  int showLoadStats = 0;
+  int showCacheStats = 0;
+  int noForwarding = 0;
+  uint64_t mulLatency = 0;
+  uint64_t dataMemory = 0;
+  uint64_t lanes = 0;
+  const char *laneData = NULL;
+  const char *traceFile = NULL;
+  const char *countersFile = NULL;
+  const char *profileFile = NULL;
+  const char *foldedFile = NULL;
+  uint64_t flightCycles = 0;
+  uint64_t flightTrigger = 0;
+  APEX_Sample_Config sampleConfig = {0, 0, 0};
+  int setSamplePeriod = 0, setSampleWindow = 0, setSampleWarmup = 0;
+  const char *restoreCheckpoint = NULL;
+  const char *saveCheckpoint = NULL;
+  uint64_t checkpointEvery = 0;
+  APEX_Interval_Config intervalConfig = {0, 0, 0, 0};
+  int setInterval = 0, setIntervalWarmup = 0;
+  uint64_t threads = 0;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--load-stats") == 0) {
+      showLoadStats = 1;
+    } else if (strcmp(argv[i], "--cache-stats") == 0) {
+      showCacheStats = 1;
+    } else if (parse_count_option(argv[i], "--sample-period=",
+                                  &sampleConfig.period)) {
+      setSamplePeriod = 1;
+    } else if (parse_count_option(argv[i], "--sample-window=",
+                                  &sampleConfig.window)) {
+      setSampleWindow = 1;
+    } else if (parse_count_option(argv[i], "--sample-warmup=",
+                                  &sampleConfig.warmup)) {
+      setSampleWarmup = 1;
+    } else if (strncmp(argv[i], "--restore-checkpoint=", 21) == 0) {
+      restoreCheckpoint = argv[i] + 21;
+    } else if (strncmp(argv[i], "--save-checkpoint=", 18) == 0) {
+      saveCheckpoint = argv[i] + 18;
+    } else if (parse_count_option(argv[i], "--checkpoint-every=",
+                                  &checkpointEvery)) {
+      if (checkpointEvery > 0x7fffffff) {
+        fprintf(stderr, "APEX_Error : Bad value in %s\n", argv[i]);
+        exit(1);
+      }
+    } else if (parse_count_option(argv[i], "--interval=",
+                                  &intervalConfig.interval)) {
+      setInterval = 1;
+    } else if (parse_count_option(argv[i], "--interval-warmup=",
+                                  &intervalConfig.warmup)) {
+      setIntervalWarmup = 1;
+    } else if (parse_count_option(argv[i], "--threads=", &threads)) {
+      if (threads > 1024) {
+        fprintf(stderr, "APEX_Error : Bad value in %s\n", argv[i]);
+        exit(1);
+      }
+    } else if (strcmp(argv[i], "--no-forwarding") == 0) {
+      noForwarding = 1;
+    } else if (parse_count_option(argv[i], "--mul-latency=", &mulLatency)) {
+      if (mulLatency < 1 || mulLatency > 256) {
+        fprintf(stderr, "APEX_Error : Bad value in %s\n", argv[i]);
+        exit(1);
+      }
+    } else if (parse_count_option(argv[i], "--data-memory=", &dataMemory)) {
+      if (dataMemory == 0 || dataMemory > 0x40000000 ||
+          (dataMemory & (dataMemory - 1)) != 0) {
+        fprintf(stderr, "APEX_Error : Data memory size must be a power of 2 "
+                "in %s\n", argv[i]);
+        exit(1);
+      }
+    } else if (parse_count_option(argv[i], "--lanes=", &lanes)) {
+      if (lanes > 0x1000000) {
+        fprintf(stderr, "APEX_Error : Bad value in %s\n", argv[i]);
+        exit(1);
+      }
+    } else if (strncmp(argv[i], "--lane-data=", 12) == 0) {
+      laneData = argv[i] + 12;
+    } else if (strncmp(argv[i], "--counters=", 11) == 0) {
+      countersFile = argv[i] + 11;
+    } else if (strncmp(argv[i], "--profile=", 10) == 0) {
+      profileFile = argv[i] + 10;
+    } else if (strncmp(argv[i], "--profile-folded=", 17) == 0) {
+      foldedFile = argv[i] + 17;
+    } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+      traceFile = argv[i] + 8;
+    } else if (parse_count_option(argv[i], "--flight-recorder=",
+                                  &flightCycles)) {
+      if (flightCycles == 0 || flightCycles > 0x1000000) {
+        fprintf(stderr, "APEX_Error : Bad value in %s\n", argv[i]);
+        exit(1);
+      }
+    } else if (parse_count_option(argv[i], "--flight-trigger=",
+                                  &flightTrigger)) {
+      if (flightTrigger < 4000 || flightTrigger > 0x7fffffff) {
+        fprintf(stderr, "APEX_Error : Bad value in %s\n", argv[i]);
+        exit(1);
+      }
+    } else if (strcmp(argv[i], "--check-serial") == 0) {
+      intervalConfig.check_serial = 1;
+    } else if (strncmp(argv[i], "--", 2) == 0) {
+      fprintf(stderr, "APEX_Error : Unknown option %s\n", argv[i]);
+      exit(1);
+    } else if (num_positional < 3) {
+      positional[num_positional++] = argv[i];
+    }
+  }
+
+  APEX_CPU *cpu = APEX_cpu_init(positional[0]);
   if (!cpu) {
     fprintf(stderr, "APEX_Error : Unable to initialize CPU\n");
     exit(1);
   }
 
-  const char* functionality;
-  const char* cycleCount;
-  if(argc >2){
-    functionality = argv[2];
-    cycleCount = argv[3];
-  }else{
-    functionality = "display";
-    cycleCount = "0";
+  if (noForwarding) {
+    cpu->config.data_forwarding = 0;
+  }
+  if (mulLatency) {
+    cpu->config.mul_latency = (int) mulLatency;
+  }
+  if (dataMemory && APEX_cpu_set_data_memory_size(cpu, (int) dataMemory) != 0) {
+    fprintf(stderr, "APEX_Error : Unable to allocate data memory\n");
+    APEX_cpu_stop(cpu);
+    exit(1);
+  }
+  if (setSamplePeriod) {
+    cpu->sample_config.period = sampleConfig.period;
+  }
+  if (setSampleWindow) {
+    cpu->sample_config.window = sampleConfig.window;
+  }
+  if (setSampleWarmup) {
+    cpu->sample_config.warmup = sampleConfig.warmup;
+  }
+
+  if (setInterval) {
+    cpu->interval_config.interval = intervalConfig.interval;
+  }
+  if (setIntervalWarmup) {
+    cpu->interval_config.warmup = intervalConfig.warmup;
+  }
+  cpu->interval_config.threads = (int) threads;
+  cpu->interval_config.check_serial = intervalConfig.check_serial;
+  cpu->lanes_config.lanes = (int) lanes;
+  cpu->lanes_config.lane_data = laneData;
+
+  if (restoreCheckpoint &&
+      APEX_cpu_restore_checkpoint(cpu, restoreCheckpoint) != 0) {
+    fprintf(stderr, "APEX_Error : Unable to restore checkpoint %s\n",
+            restoreCheckpoint);
+    APEX_cpu_stop(cpu);
+    exit(1);
+  }
+  cpu->checkpoint_file = saveCheckpoint;
+  cpu->checkpoint_interval = (int) checkpointEvery;
+
+  if (traceFile) {
+    cpu->trace = trace_writer_open(traceFile);
+    if (!cpu->trace) {
+      fprintf(stderr, "APEX_Error : Unable to write trace %s\n", traceFile);
+      APEX_cpu_stop(cpu);
+      exit(1);
+    }
+  }
+
+  if (showLoadStats) {
+    double seconds = cpu->load_stats.seconds;
+    fprintf(stderr,
+            "APEX_CPU : Loaded %d instructions, %zu bytes in %.3f ms (%.1f MB/s)\n",
+            cpu->code_memory_size, cpu->load_stats.bytes, seconds * 1e3,
+            seconds > 0 ? cpu->load_stats.bytes / seconds / 1e6 : 0.0);
+  }
+
+  const char* functionality = positional[1];
+  const char* cycleCount = positional[2];
+
+  if (flightTrigger && !flightCycles) {
+    flightCycles = FLIGHT_RECORDER_CYCLES;
+  }
+  if (flightCycles) {
+    cpu->flight_recorder = flight_recorder_create((int) flightCycles,
+                                                  (int) flightTrigger);
+    if (!cpu->flight_recorder) {
+      fprintf(stderr, "APEX_Error : Unable to allocate flight recorder\n");
+      APEX_cpu_stop(cpu);
+      exit(1);
+    }
+  }
+
+  if (profileFile || foldedFile) {
+    cpu->profile = APEX_profile_create(cpu->code_memory_size);
+    if (!cpu->profile) {
+      fprintf(stderr, "APEX_Error : Unable to allocate profile\n");
+      APEX_cpu_stop(cpu);
+      exit(1);
+    }
   }
 
   APEX_cpu_run(cpu, functionality, cycleCount);
+
+  if (profileFile && write_profile(cpu, positional[0], profileFile,
+                                   APEX_profile_write_listing) != 0) {
+    fprintf(stderr, "APEX_Error : Unable to write profile %s\n", profileFile);
+  }
+  if (foldedFile && write_profile(cpu, positional[0], foldedFile,
+                                  APEX_profile_write_folded) != 0) {
+    fprintf(stderr, "APEX_Error : Unable to write profile %s\n", foldedFile);
+  }
+  APEX_profile_destroy(cpu->profile);
+  cpu->profile = NULL;
+
+  if (traceFile && trace_writer_close(cpu->trace, cpu) != 0) {
+    fprintf(stderr, "APEX_Error : Unable to write trace %s\n", traceFile);
+  }
+  cpu->trace = NULL;
+  flight_recorder_destroy(cpu->flight_recorder);
+  cpu->flight_recorder = NULL;
+
+  if (countersFile && APEX_cpu_write_counters(cpu, countersFile) != 0) {
+    fprintf(stderr, "APEX_Error : Unable to write counters %s\n",
+            countersFile);
+  }
+
+  if (saveCheckpoint && APEX_cpu_save_checkpoint(cpu, saveCheckpoint) != 0) {
+    fprintf(stderr, "APEX_Error : Unable to save checkpoint %s\n",
+            saveCheckpoint);
+  }
+
+  if (showCacheStats && cpu->block_cache) {
+    Block_Cache_Stats stats = block_cache_stats(cpu->block_cache);
+    fprintf(stderr,
+            "APEX_CPU : Block cache %d blocks, %llu hits, %llu misses, "
+            "%llu invalidations\n", stats.blocks,
+            (unsigned long long) stats.hits, (unsigned long long) stats.misses,
+            (unsigned long long) stats.invalidations);
+  }
   APEX_cpu_stop(cpu);
   return 0;
-}
\ No newline at end of file
+}
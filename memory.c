@@ -0,0 +1,214 @@
+/*
+ *  memory.c
+ *  Contains the paged, copy-on-write data memory, see memory.h
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory.h"
+
+/* Read in place of every page never stored to. Its count is never 1, so
+ * memory_store never writes it. */
+static Memory_Page zero_page = {2, {0}};
+
+/**
+ * Gives up a memory's hold on a page, freeing it with the last one
+ * @param page
+ */
+static void release_page(Memory_Page *page) {
+  if (page && atomic_fetch_sub_explicit(&page->refs, 1, memory_order_acq_rel) == 1) {
+    free(page);
+  }
+}
+
+/**
+ * Sets up a data memory of the given number of words, all zeros
+ * @param memory
+ * @param words a power of 2, at most MEMORY_MAX_WORDS
+ * @return 0 on success, -1 on a bad size or out of memory
+ */
+int memory_init(APEX_Memory *memory, int words) {
+  if (words <= 0 || words > MEMORY_MAX_WORDS || (words & (words - 1)) != 0) {
+    return -1;
+  }
+  int num_pages = (words + MEMORY_PAGE_WORDS - 1) >> MEMORY_PAGE_BITS;
+  Memory_Page **pages = calloc(num_pages, sizeof(*pages));
+  if (!pages) {
+    return -1;
+  }
+  memory->pages = pages;
+  memory->num_pages = num_pages;
+  memory->size = words;
+  memory->last_page = -1;
+  memory->last = NULL;
+  return 0;
+}
+
+void memory_free(APEX_Memory *memory) {
+  if (!memory->pages) {
+    return;
+  }
+  for (int i = 0; i < memory->num_pages; ++i) {
+    release_page(memory->pages[i]);
+  }
+  free(memory->pages);
+  memory->pages = NULL;
+  memory->last_page = -1;
+  memory->last = NULL;
+}
+
+/**
+ * Makes copy a copy of memory that shares its pages. Only the page table
+ * is copied; a page is copied once either memory stores to it.
+ * @param copy not set up, or freed
+ * @param memory
+ * @return 0 on success, -1 if out of memory
+ */
+int memory_share(APEX_Memory *copy, const APEX_Memory *memory) {
+  Memory_Page **pages = malloc(memory->num_pages * sizeof(*pages));
+  if (!pages) {
+    return -1;
+  }
+  memcpy(pages, memory->pages, memory->num_pages * sizeof(*pages));
+  for (int i = 0; i < memory->num_pages; ++i) {
+    if (pages[i]) {
+      atomic_fetch_add_explicit(&pages[i]->refs, 1, memory_order_relaxed);
+    }
+  }
+  copy->pages = pages;
+  copy->num_pages = memory->num_pages;
+  copy->size = memory->size;
+  copy->last_page = -1;
+  copy->last = NULL;
+  return 0;
+}
+
+/**
+ * Makes a page the last page used, the slow path of memory_load and
+ * memory_store. For a store the page is allocated if it never was, and
+ * copied if it is shared.
+ * @param memory
+ * @param page
+ * @param store
+ */
+void memory_use_page(APEX_Memory *memory, int page, int store) {
+  Memory_Page *used = memory->pages[page];
+  if (store && (!used ||
+                atomic_load_explicit(&used->refs, memory_order_acquire) != 1)) {
+    Memory_Page *own = malloc(sizeof(*own));
+    if (!own) {
+      /** The pipeline has no way to fail a STORE */
+      fprintf(stderr, "APEX_Error : Out of memory for a data memory page\n");
+      abort();
+    }
+    if (used) {
+      memcpy(own->words, used->words, sizeof(own->words));
+    } else {
+      memset(own->words, 0, sizeof(own->words));
+    }
+    atomic_init(&own->refs, 1);
+    release_page(used);
+    memory->pages[page] = own;
+    used = own;
+  }
+  memory->last_page = page;
+  memory->last = used ? used : &zero_page;
+}
+
+/**
+ * Words of a page, which must not be written
+ * @param memory
+ * @param page
+ * @return zeros if the page was never stored to
+ */
+const int *memory_page_words(const APEX_Memory *memory, int page) {
+  const Memory_Page *words = memory->pages[page];
+  return words ? words->words : zero_page.words;
+}
+
+/**
+ * Word of data memory, read without going through the last page, so
+ * that the memory is left as it is
+ * @param memory
+ * @param address wrapped to the memory size
+ * @return
+ */
+int memory_word(const APEX_Memory *memory, int address) {
+  address &= memory->size - 1;
+  return memory_page_words(memory, address >> MEMORY_PAGE_BITS)
+      [address & (MEMORY_PAGE_WORDS - 1)];
+}
+
+/**
+ * Number of words from a wrapped address to the end of its page, or of
+ * the memory if it is smaller than a page, up to count
+ */
+static int run_length(const APEX_Memory *memory, int address, int count) {
+  int length = MEMORY_PAGE_WORDS - (address & (MEMORY_PAGE_WORDS - 1));
+  if (length > memory->size - address) {
+    length = memory->size - address;
+  }
+  return length < count ? length : count;
+}
+
+/**
+ * Copies count words of data memory from address on, wrapping around
+ * @param memory
+ * @param address
+ * @param count
+ * @param words
+ */
+void memory_read(const APEX_Memory *memory, int address, int count, int *words) {
+  for (int i = 0; i < count;) {
+    int wrapped = (int) ((unsigned) address + i) & (memory->size - 1);
+    int length = run_length(memory, wrapped, count - i);
+    memcpy(words + i, memory_page_words(memory, wrapped >> MEMORY_PAGE_BITS) +
+           (wrapped & (MEMORY_PAGE_WORDS - 1)), sizeof(int) * length);
+    i += length;
+  }
+}
+
+/**
+ * Stores count words to data memory from address on, wrapping around.
+ * Zeros going to pages never stored to leave them unallocated.
+ * @param memory
+ * @param address
+ * @param count
+ * @param words
+ */
+void memory_write(APEX_Memory *memory, int address, int count, const int *words) {
+  for (int i = 0; i < count;) {
+    int wrapped = (int) ((unsigned) address + i) & (memory->size - 1);
+    int length = run_length(memory, wrapped, count - i);
+    int page = wrapped >> MEMORY_PAGE_BITS;
+    int zeros = !memory->pages[page];
+    for (int j = 0; zeros && j < length; ++j) {
+      zeros = words[i + j] == 0;
+    }
+    if (!zeros) {
+      memory_use_page(memory, page, 1);
+      memcpy(memory->last->words + (wrapped & (MEMORY_PAGE_WORDS - 1)),
+             words + i, sizeof(int) * length);
+    }
+    i += length;
+  }
+}
+
+/**
+ * FNV-1a hash of the bytes of data memory, as if it were one array
+ * @param memory
+ * @return
+ */
+uint64_t memory_hash(const APEX_Memory *memory) {
+  int page_words = memory->size < MEMORY_PAGE_WORDS ? memory->size
+                                                    : MEMORY_PAGE_WORDS;
+  uint64_t hash = 14695981039346656037ull;
+  for (int i = 0; i < memory->num_pages; ++i) {
+    const unsigned char *bytes = (const void *) memory_page_words(memory, i);
+    for (size_t j = 0; j < sizeof(int) * page_words; ++j) {
+      hash = (hash ^ bytes[j]) * 1099511628211ull;
+    }
+  }
+  return hash;
+}
@@ -0,0 +1,93 @@
+#ifndef _APEX_MEMORY_H_
+#define _APEX_MEMORY_H_
+/**
+ *  memory.h
+ *  Contains the data memory of a CPU: a power of 2 number of words, which
+ *  addresses wrap around, held in pages. A page is allocated on the first
+ *  store to it and reads as zeros until then, so a large memory costs
+ *  only its page table and the pages the program touches.
+ *
+ *  Memories copied with memory_share share their pages until one of them
+ *  stores to a page, which then gets a copy of its own (copy on write).
+ *  Pages are reference counted atomically, so copies may run on other
+ *  threads. LOAD and STORE go through a cache of the last page used,
+ *  inlined even into unoptimised builds as they run every instruction.
+ */
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* Words of a page, 4 KiB */
+#define MEMORY_PAGE_BITS 10
+#define MEMORY_PAGE_WORDS (1 << MEMORY_PAGE_BITS)
+
+/* Largest data memory, in words */
+#define MEMORY_MAX_WORDS 0x40000000
+
+/* Page of data memory, shared by refs memories */
+typedef struct Memory_Page {
+    atomic_int refs;
+    int words[MEMORY_PAGE_WORDS];
+} Memory_Page;
+
+typedef struct APEX_Memory {
+    Memory_Page **pages;     // NULL for a page never stored to
+    int num_pages;
+    int size;                // Words, a power of 2
+    int last_page;           // Index of the page last used, -1 for none
+    Memory_Page *last;       // That page, or the zero page if it is NULL
+} APEX_Memory;
+
+int memory_init(APEX_Memory *memory, int words);
+
+void memory_free(APEX_Memory *memory);
+
+int memory_share(APEX_Memory *copy, const APEX_Memory *memory);
+
+void memory_use_page(APEX_Memory *memory, int page, int store);
+
+const int *memory_page_words(const APEX_Memory *memory, int page);
+
+int memory_word(const APEX_Memory *memory, int address);
+
+void memory_read(const APEX_Memory *memory, int address, int count, int *words);
+
+void memory_write(APEX_Memory *memory, int address, int count, const int *words);
+
+uint64_t memory_hash(const APEX_Memory *memory);
+
+/**
+ * Word of data memory at a word address, wrapped to the memory size
+ * @param memory
+ * @param address
+ * @return
+ */
+static inline __attribute__((always_inline))
+int memory_load(APEX_Memory *memory, int address) {
+  address &= memory->size - 1;
+  int page = address >> MEMORY_PAGE_BITS;
+  if (page != memory->last_page) {
+    memory_use_page(memory, page, 0);
+  }
+  return memory->last->words[address & (MEMORY_PAGE_WORDS - 1)];
+}
+
+/**
+ * Stores a word of data memory at a word address, wrapped to the memory
+ * size. The last page may since have been shared, so it is only written
+ * in place while no other memory holds it.
+ * @param memory
+ * @param address
+ * @param value
+ */
+static inline __attribute__((always_inline))
+void memory_store(APEX_Memory *memory, int address, int value) {
+  address &= memory->size - 1;
+  int page = address >> MEMORY_PAGE_BITS;
+  if (page != memory->last_page ||
+      atomic_load_explicit(&memory->last->refs, memory_order_acquire) != 1) {
+    memory_use_page(memory, page, 1);
+  }
+  memory->last->words[address & (MEMORY_PAGE_WORDS - 1)] = value;
+}
+
+#endif
@@ -0,0 +1,217 @@
+/*
+ *  profile.c
+ *  Contains the output of the per-pc profile: an annotated listing of
+ *  the program, and folded stacks for flame graph tools, one line per
+ *  instruction and state with the cycles spent in it:
+ *     <program>;<pc> <instruction>;<state> <cycles>
+ *  where state is "running" or the cause the instruction was stalled
+ *  for while the pipeline waited on it.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "counters.h"
+#include "profile.h"
+#include "program_image.h"
+
+/* Lines of a program's source text */
+typedef struct Source_Lines {
+    char *text;      // Whole file, with each line end replaced by a NUL
+    char **lines;
+    int count;
+} Source_Lines;
+
+/**
+ * Creates an empty profile for a program
+ * @param code_memory_size
+ * @return NULL if out of memory
+ */
+APEX_Profile *APEX_profile_create(int code_memory_size) {
+  APEX_Profile *profile = calloc(1, sizeof(*profile));
+  if (!profile) {
+    return NULL;
+  }
+  profile->entries = calloc(code_memory_size > 0 ? code_memory_size : 1,
+                            sizeof(APEX_Profile_Entry));
+  if (!profile->entries) {
+    free(profile);
+    return NULL;
+  }
+  profile->size = code_memory_size;
+  return profile;
+}
+
+void APEX_profile_destroy(APEX_Profile *profile) {
+  if (profile) {
+    free(profile->entries);
+    free(profile);
+  }
+}
+
+/**
+ * Reads the lines of a text program. Program images have no source, so
+ * they give no lines.
+ * @param filename
+ * @param source
+ */
+static void read_source(const char *filename, Source_Lines *source) {
+  memset(source, 0, sizeof(*source));
+  if (!filename || is_program_image(filename)) {
+    return;
+  }
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    return;
+  }
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  source->text = malloc(size + 1);
+  if (!source->text || size < 0 || fread(source->text, 1, size, fp) != (size_t) size) {
+    free(source->text);
+    source->text = NULL;
+    fclose(fp);
+    return;
+  }
+  fclose(fp);
+  source->text[size] = '\0';
+
+  int capacity = 0;
+  char *p = source->text;
+  while (p < source->text + size) {
+    if (source->count == capacity) {
+      capacity = capacity ? 2 * capacity : 1024;
+      char **grown = realloc(source->lines, capacity * sizeof(*grown));
+      if (!grown) {
+        break;
+      }
+      source->lines = grown;
+    }
+    source->lines[source->count++] = p;
+    char *newline = strchr(p, '\n');
+    char *end = newline ? newline : source->text + size;
+    char *next = end + 1;
+    *end = '\0';
+    /** Trailing blanks and carriage returns are not part of the text */
+    while (end > p && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t')) {
+      *--end = '\0';
+    }
+    p = next;
+  }
+}
+
+static void free_source(Source_Lines *source) {
+  free(source->lines);
+  free(source->text);
+}
+
+/**
+ * Prints the text of an instruction: its source line, or what display
+ * shows for it if there is no source
+ * @param out
+ * @param cpu
+ * @param source
+ * @param index code memory index
+ * @param frame if set, keep ';' out as folded stacks use it
+ */
+static void print_text(FILE *out, const APEX_CPU *cpu, const Source_Lines *source,
+                       int index, int frame) {
+  if (index >= source->count) {
+    print_code_instruction(out, cpu, index);
+    return;
+  }
+  for (const char *c = source->lines[index]; *c; ++c) {
+    fputc(frame && *c == ';' ? ':' : *c, out);
+  }
+}
+
+/**
+ * Writes the profile as the program listing, each instruction annotated
+ * with its cycles, retirements and stalls
+ * @param profile
+ * @param cpu the CPU of the run profiled
+ * @param source file the program was loaded from
+ * @param out
+ * @return 0 on success, -1 on a write error
+ */
+int APEX_profile_write_listing(const APEX_Profile *profile, const APEX_CPU *cpu,
+                               const char *source, FILE *out) {
+  Source_Lines lines;
+  read_source(source, &lines);
+
+  uint64_t cycles = profile->idle_cycles;
+  uint64_t instructions = 0;
+  for (int i = 0; i < profile->size; ++i) {
+    cycles += profile->entries[i].cycles;
+    instructions += profile->entries[i].retired;
+  }
+
+  fprintf(out, "# Profile of %s: %llu cycles, %llu instructions, CPI %.4f\n",
+          source, (unsigned long long) cycles, (unsigned long long) instructions,
+          instructions ? (double) cycles / instructions : 0.0);
+  fprintf(out, "# cycles: cycles it was the oldest instruction in flight (%llu "
+          "with none at the end)\n", (unsigned long long) profile->idle_cycles);
+  fprintf(out, "# retired: times through writeback; stall columns: cycles it "
+          "ended stalled for that cause, in any stage\n");
+  fprintf(out, "%12s %7s %12s", "cycles", "%", "retired");
+  for (int cause = 0; cause < NUM_STALL_CAUSES; ++cause) {
+    fprintf(out, " %12s", get_stall_cause_name(cause));
+  }
+  fprintf(out, "  %-6s %s\n", "pc", "source");
+
+  for (int i = 0; i < profile->size; ++i) {
+    const APEX_Profile_Entry *entry = &profile->entries[i];
+    fprintf(out, "%12llu %6.2f%% %12llu", (unsigned long long) entry->cycles,
+            cycles ? 100.0 * entry->cycles / cycles : 0.0,
+            (unsigned long long) entry->retired);
+    for (int cause = 0; cause < NUM_STALL_CAUSES; ++cause) {
+      fprintf(out, " %12llu", (unsigned long long) entry->stalls[cause]);
+    }
+    fprintf(out, "  %-6d ", 4000 + 4 * i);
+    print_text(out, cpu, &lines, i, 0);
+    fprintf(out, "\n");
+  }
+  free_source(&lines);
+  return ferror(out) ? -1 : 0;
+}
+
+/**
+ * Writes the profile as folded stacks, see the top of this file
+ * @param profile
+ * @param cpu the CPU of the run profiled
+ * @param source file the program was loaded from
+ * @param out
+ * @return 0 on success, -1 on a write error
+ */
+int APEX_profile_write_folded(const APEX_Profile *profile, const APEX_CPU *cpu,
+                              const char *source, FILE *out) {
+  Source_Lines lines;
+  read_source(source, &lines);
+
+  const char *program = strrchr(source, '/') ? strrchr(source, '/') + 1 : source;
+  for (int i = 0; i < profile->size; ++i) {
+    const APEX_Profile_Entry *entry = &profile->entries[i];
+    uint64_t running = entry->cycles;
+    for (int cause = 0; cause <= NUM_STALL_CAUSES; ++cause) {
+      uint64_t count = running;
+      const char *state = "running";
+      if (cause < NUM_STALL_CAUSES) {
+        count = entry->oldest_stalls[cause];
+        state = get_stall_cause_name(cause);
+        running -= count;
+      }
+      if (!count) {
+        continue;
+      }
+      fprintf(out, "%s;%d ", program, 4000 + 4 * i);
+      print_text(out, cpu, &lines, i, 1);
+      fprintf(out, ";%s %llu\n", state, (unsigned long long) count);
+    }
+  }
+  if (profile->idle_cycles) {
+    fprintf(out, "%s;(pipeline empty) %llu\n", program,
+            (unsigned long long) profile->idle_cycles);
+  }
+  free_source(&lines);
+  return ferror(out) ? -1 : 0;
+}
@@ -0,0 +1,43 @@
+#ifndef _APEX_PROFILE_H_
+#define _APEX_PROFILE_H_
+/**
+ *  profile.h
+ *  Contains the per-pc profile of a pipeline run: which instructions the
+ *  cycles went to, and what held them up
+ */
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cpu.h"
+
+/* Profile of one instruction of code memory */
+typedef struct APEX_Profile_Entry {
+    uint64_t cycles;                           // Cycles it was the oldest instruction in flight
+    uint64_t oldest_stalls[NUM_STALL_CAUSES];  // Of those, the ones it ended stalled, by cause
+    uint64_t stalls[NUM_STALL_CAUSES];         // Cycles it ended stalled in any stage, by cause
+    uint64_t retired;                          // Times it went through writeback
+} APEX_Profile_Entry;
+
+/* Profile of a run. Each cycle goes to the oldest instruction in flight
+ * once the cycle is over, the one the pipeline waits on to retire next.
+ * Instructions retire in order and the oldest is never flushed, so these
+ * are the cycles since the instruction before it retired, which is how
+ * they are counted. */
+typedef struct APEX_Profile {
+    int size;                       // Entries, one per instruction of code memory
+    APEX_Profile_Entry *entries;
+    uint64_t idle_cycles;           // Cycles at the end of the run with no instruction in flight
+    int last_retire_clock;          // Clock at which the last instruction retired
+} APEX_Profile;
+
+APEX_Profile *APEX_profile_create(int code_memory_size);
+
+void APEX_profile_destroy(APEX_Profile *profile);
+
+int APEX_profile_write_listing(const APEX_Profile *profile, const APEX_CPU *cpu,
+                               const char *source, FILE *out);
+
+int APEX_profile_write_folded(const APEX_Profile *profile, const APEX_CPU *cpu,
+                              const char *source, FILE *out);
+
+#endif
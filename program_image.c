@@ -0,0 +1,186 @@
+/*
+ *  program_image.c
+ *  Contains functions to write and map pre-assembled program images.
+ *  An image holds the decoded code memory exactly as the simulator
+ *  uses it, so loading it is a single mmap with no parsing or copying.
+ *  Images are written for the host they are made on; the header
+ *  records byte order and instruction layout so a foreign or stale
+ *  image is rejected instead of misread.
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "program_image.h"
+
+/**
+ * Fills in a header describing an image of size instructions
+ * @param header
+ * @param size
+ */
+static void init_header(APEX_Image_Header *header, int size) {
+  memset(header, 0, sizeof(*header));
+  strcpy(header->magic, APEX_IMAGE_MAGIC);
+  header->version = APEX_IMAGE_VERSION;
+  header->byte_order = APEX_IMAGE_BYTE_ORDER;
+  header->header_size = sizeof(*header);
+  header->instruction_size = sizeof(APEX_Instruction);
+  header->num_instructions = size;
+}
+
+/**
+ * Checks whether a file starts with the image magic
+ * @param filename
+ * @return
+ */
+int is_program_image(const char *filename) {
+  char magic[sizeof(APEX_IMAGE_MAGIC)];
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    return 0;
+  }
+  size_t nread = fread(magic, 1, sizeof(magic), fp);
+  fclose(fp);
+  return nread == sizeof(magic) && memcmp(magic, APEX_IMAGE_MAGIC, sizeof(magic)) == 0;
+}
+
+/**
+ * Writes code memory out as an image
+ * @param filename
+ * @param code_memory
+ * @param size
+ * @return 0 on success, -1 on failure
+ */
+int write_program_image(const char *filename, const APEX_Instruction *code_memory,
+                        int size) {
+  FILE *fp = fopen(filename, "wb");
+  if (!fp) {
+    return -1;
+  }
+
+  APEX_Image_Header header;
+  init_header(&header, size);
+
+  int ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+           fwrite(code_memory, sizeof(*code_memory), size, fp) == (size_t) size;
+  if (fclose(fp) != 0) {
+    ok = 0;
+  }
+  return ok ? 0 : -1;
+}
+
+/**
+ * Checks that an instruction read from an image can be run: its opcode
+ * one the parser produces, and its registers R0 to R15 or the slots
+ * REG_FLUSHED and REG_NONE. OP_INVALID is kept, as for a text program,
+ * for fetch to reject.
+ * @param ins
+ * @return 1 if it is valid
+ */
+static int valid_instruction(const APEX_Instruction *ins) {
+  const uint8_t regs[3] = {ins->rd, ins->rs1, ins->rs2};
+  if (ins->opcode_id > OP_INVALID || ins->opcode_id == OP_EMPTY ||
+      ins->opcode_id == OP_NOP) {
+    return 0;
+  }
+  for (int i = 0; i < 3; ++i) {
+    if (regs[i] >= NUM_ARCH_REGS && regs[i] != REG_FLUSHED &&
+        regs[i] != REG_NONE) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * Maps an image read-only and returns its instruction array, to be used
+ * directly as code memory. Every instruction is checked, so that a
+ * corrupt image is rejected rather than run. Release it with
+ * unmap_program_image().
+ * @param filename
+ * @param size
+ * @param mapping set to the start of the mapping
+ * @param mapping_size set to the length of the mapping
+ * @param stats filled in with file size and load time, if given
+ * @return
+ */
+APEX_Instruction *map_program_image(const char *filename, int *size,
+                                    void **mapping, size_t *mapping_size,
+                                    APEX_Load_Stats *stats) {
+  struct timespec start, now;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(APEX_Image_Header)) {
+    fprintf(stderr, "APEX_Error : %s is too short for a program image\n", filename);
+    close(fd);
+    return NULL;
+  }
+
+  size_t length = st.st_size;
+  char *data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return NULL;
+  }
+
+  const APEX_Image_Header *header = (const APEX_Image_Header *) data;
+  APEX_Image_Header expected;
+  init_header(&expected, 0);
+
+  if (memcmp(header->magic, expected.magic, sizeof(header->magic)) != 0 ||
+      header->version != expected.version ||
+      header->byte_order != expected.byte_order ||
+      header->instruction_size != expected.instruction_size ||
+      header->header_size < sizeof(*header) ||
+      header->header_size % sizeof(APEX_Instruction) != 0 ||
+      header->num_instructions == 0 ||
+      header->num_instructions > (uint64_t) (length - header->header_size) /
+                                 sizeof(APEX_Instruction) ||
+      header->num_instructions > 0x7fffffff) {
+    fprintf(stderr, "APEX_Error : %s is not a valid version %d program image\n",
+            filename, APEX_IMAGE_VERSION);
+    munmap(data, length);
+    return NULL;
+  }
+
+  const APEX_Instruction *code_memory =
+      (const APEX_Instruction *) (data + header->header_size);
+  for (uint64_t i = 0; i < header->num_instructions; ++i) {
+    if (!valid_instruction(&code_memory[i])) {
+      fprintf(stderr, "APEX_Error : %s: Bad instruction %llu in program image\n",
+              filename, (unsigned long long) i + 1);
+      munmap(data, length);
+      return NULL;
+    }
+  }
+
+  *size = (int) header->num_instructions;
+  *mapping = data;
+  *mapping_size = length;
+
+  if (stats) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    stats->bytes = length;
+    stats->seconds = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+  }
+  return (APEX_Instruction *) (data + header->header_size);
+}
+
+/**
+ * Releases a mapping made by map_program_image()
+ * @param mapping
+ * @param mapping_size
+ */
+void unmap_program_image(void *mapping, size_t mapping_size) {
+  munmap(mapping, mapping_size);
+}
@@ -0,0 +1,38 @@
+#ifndef _APEX_PROGRAM_IMAGE_H_
+#define _APEX_PROGRAM_IMAGE_H_
+/**
+ *  program_image.h
+ *  Contains the binary, pre-assembled program format written by
+ *  apex_asm and mapped straight into code memory by APEX_cpu_init
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu.h"
+
+#define APEX_IMAGE_MAGIC "APEXBIN"
+#define APEX_IMAGE_VERSION 1
+#define APEX_IMAGE_BYTE_ORDER 0x01020304u
+
+/* Header at the start of an image, followed by the instruction array */
+typedef struct APEX_Image_Header {
+    char magic[8];               // APEX_IMAGE_MAGIC, NUL padded
+    uint32_t version;            // APEX_IMAGE_VERSION
+    uint32_t byte_order;         // APEX_IMAGE_BYTE_ORDER as written by the host
+    uint32_t header_size;        // Offset of the first instruction
+    uint32_t instruction_size;   // sizeof(APEX_Instruction)
+    uint64_t num_instructions;   // Number of program lines
+} APEX_Image_Header;
+
+int is_program_image(const char *filename);
+
+int write_program_image(const char *filename, const APEX_Instruction *code_memory,
+                        int size);
+
+APEX_Instruction *map_program_image(const char *filename, int *size,
+                                    void **mapping, size_t *mapping_size,
+                                    APEX_Load_Stats *stats);
+
+void unmap_program_image(void *mapping, size_t mapping_size);
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ *  sample.c
+ *  Contains the sampled mode, in the style of SMARTS: the program runs
+ *  in the functional mode, and every period the next warmup + window
+ *  instructions are also run on the pipeline of a second CPU, starting
+ *  from the same architectural state. The warmup fills the pipeline and
+ *  the window is timed. Total cycles are the mean CPI of the windows
+ *  times the number of instructions.
+ *
+ *  The functional mode owns the architectural state; the pipeline CPU
+ *  only provides timing, and its results are dropped after each window.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sample.h"
+
+/* Normal quantile of the 95% confidence interval */
+#define CONFIDENCE_Z 1.96
+
+/**
+ * Hands the architectural state of cpu over to the pipeline of detail.
+ * Data memory is shared, so only the pages either writes get copied.
+ * @param detail
+ * @param cpu
+ * @return 0 on success, -1 if out of memory
+ */
+static int handoff_to_pipeline(APEX_CPU *detail, const APEX_CPU *cpu) {
+  memory_free(&detail->data_memory);
+  if (memory_share(&detail->data_memory, &cpu->data_memory) != 0) {
+    return -1;
+  }
+  memcpy(detail->regs, cpu->regs, sizeof(cpu->regs));
+  detail->pc = cpu->pc;
+  detail->zFlag = cpu->zFlag;
+  APEX_cpu_reset_pipeline(detail);
+  return 0;
+}
+
+/**
+ * Runs the program in the sampled mode, up to max_instructions (0 means
+ * no limit). A window shortened by the end of the program or by the
+ * limit is timed as far as it goes.
+ * @param cpu
+ * @param config
+ * @param max_instructions
+ * @param result
+ * @return 0 on success, -1 on a bad config or out of memory
+ */
+int APEX_cpu_run_sampled(APEX_CPU *cpu, const APEX_Sample_Config *config,
+                         uint64_t max_instructions, APEX_Sample_Result *result) {
+  memset(result, 0, sizeof(*result));
+  if (config->window == 0 ||
+      config->period < config->warmup + config->window) {
+    return -1;
+  }
+
+  /** Pipeline CPU sharing the code memory of cpu */
+  APEX_CPU *detail = APEX_cpu_clone(cpu);
+  if (!detail) {
+    return -1;
+  }
+
+  uint64_t detailed = config->warmup + config->window;
+  double cpi_sum = 0;
+  double cpi_sum_squares = 0;
+
+  while (!result->finished &&
+         (!max_instructions || result->instructions < max_instructions)) {
+    uint64_t budget = detailed;
+    if (max_instructions && max_instructions - result->instructions < budget) {
+      budget = max_instructions - result->instructions;
+    }
+
+    /** Functional run of the window first, to know how far it really goes */
+    if (handoff_to_pipeline(detail, cpu) != 0) {
+      APEX_cpu_stop(detail);
+      return -1;
+    }
+    uint64_t count = 0;
+    result->finished = APEX_cpu_run_functional(cpu, budget, &count);
+    result->instructions += count;
+
+    if (count > config->warmup) {
+      uint64_t cycles;
+      uint64_t timed = APEX_cpu_run_timed(detail, config->warmup,
+                                          count - config->warmup, &cycles);
+      if (timed > 0) {
+        double cpi = (double) cycles / timed;
+        cpi_sum += cpi;
+        cpi_sum_squares += cpi * cpi;
+        result->samples++;
+        result->sampled_instructions += timed;
+        result->sampled_cycles += cycles;
+      }
+    }
+
+    /** Fast-forward to the next window */
+    if (result->finished || count < budget) {
+      break;
+    }
+    budget = config->period - detailed;
+    if (max_instructions && max_instructions - result->instructions < budget) {
+      budget = max_instructions - result->instructions;
+    }
+    count = 0;
+    result->finished = APEX_cpu_run_functional(cpu, budget, &count);
+    result->instructions += count;
+  }
+  APEX_cpu_stop(detail);
+
+  if (result->samples > 0) {
+    double n = result->samples;
+    result->cpi = cpi_sum / n;
+    if (result->samples > 1) {
+      double variance = (cpi_sum_squares - n * result->cpi * result->cpi) / (n - 1);
+      result->cpi_error = CONFIDENCE_Z * sqrt(variance > 0 ? variance : 0) / sqrt(n);
+    }
+    result->cycles = result->cpi * result->instructions;
+    result->cycles_error = result->cpi_error * result->instructions;
+  }
+  return 0;
+}
+
+/**
+ * Prints the estimate of a sampled run
+ * @param out
+ * @param config
+ * @param result
+ */
+void print_sample_result(FILE *out, const APEX_Sample_Config *config,
+                         const APEX_Sample_Result *result) {
+  fprintf(out, "=========SAMPLED SIMULATION============\n");
+  fprintf(out, " Period %llu, warmup %llu, window %llu instructions\n",
+          (unsigned long long) config->period,
+          (unsigned long long) config->warmup,
+          (unsigned long long) config->window);
+  fprintf(out, " Instructions          %llu\n",
+          (unsigned long long) result->instructions);
+  fprintf(out, " Samples               %llu (%llu instructions, %llu cycles)\n",
+          (unsigned long long) result->samples,
+          (unsigned long long) result->sampled_instructions,
+          (unsigned long long) result->sampled_cycles);
+  if (result->samples == 0) {
+    fprintf(out, " No window was timed, program shorter than the warmup\n");
+    return;
+  }
+  fprintf(out, " CPI                   %.4f +/- %.4f (95%%)\n", result->cpi,
+          result->cpi_error);
+  fprintf(out, " Estimated cycles      %.0f +/- %.0f (95%%)\n", result->cycles,
+          result->cycles_error);
+}
@@ -0,0 +1,31 @@
+#ifndef _APEX_SAMPLE_H_
+#define _APEX_SAMPLE_H_
+/**
+ *  sample.h
+ *  Contains the sampled mode, which times short windows of the program
+ *  on the pipeline and runs the rest in the functional mode
+ */
+#include <stdint.h>
+
+#include "cpu.h"
+
+/* Outcome of a sampled run, extrapolated from the timed windows */
+typedef struct APEX_Sample_Result {
+    uint64_t instructions;          // Instructions run, functionally
+    uint64_t samples;               // Windows timed on the pipeline
+    uint64_t sampled_instructions;  // Instructions timed over all windows
+    uint64_t sampled_cycles;        // Cycles those instructions took
+    double cpi;                     // Mean CPI of the windows
+    double cpi_error;               // Half-width of the 95% confidence interval
+    double cycles;                  // Estimated cycles of the whole run
+    double cycles_error;            // Half-width of the 95% confidence interval
+    int finished;                   // 1 if the program finished
+} APEX_Sample_Result;
+
+int APEX_cpu_run_sampled(APEX_CPU *cpu, const APEX_Sample_Config *config,
+                         uint64_t max_instructions, APEX_Sample_Result *result);
+
+void print_sample_result(FILE *out, const APEX_Sample_Config *config,
+                         const APEX_Sample_Result *result);
+
+#endif
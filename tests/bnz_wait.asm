@@ -0,0 +1,34 @@
+MOVC,R12,#1
+MOVC,R13,#4000
+MOVC,R1,#15
+MOVC,R2,#1
+MOVC,R3,#18
+MOVC,R4,#3
+MOVC,R5,#9
+MOVC,R6,#-3
+MOVC,R7,#15
+MOVC,R8,#-3
+MOVC,R11,#3
+MOVC,R2,#8
+ADD,R7,R6,R5
+AND,R5,R9,R3
+LOAD,R1,R0,#35
+EX-OR,R1,R9,R6
+EX-OR,R6,R4,R1
+EX-OR,R2,R6,R5
+OR,R3,R3,R6
+MUL,R1,R1,R5
+MUL,R6,R5,R3
+STORE,R2,R0,#16
+MUL,R5,R5,R3
+STORE,R9,R0,#95
+ADD,R2,R7,R4
+SUB,R7,R8,R4
+SUB,R4,R8,R4
+SUB,R11,R11,R12
+BNZ,#-68
+STORE,R1,R0,#83
+STORE,R1,R0,#76
+STORE,R4,R0,#12
+STORE,R2,R0,#18
+HALT,
@@ -0,0 +1,41 @@
+#!/bin/sh
+# Checks that a run restored from a checkpoint ends as the run it was
+# taken of, and that checkpoints with a stage latch, pc or scoreboard out
+# of range are rejected instead of restored. Run from the project
+# directory.
+set -u
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+failed=0
+program=tests/golden/mul_load_loop.asm
+
+./apex_sim $program display 12 --save-checkpoint="$dir/good.ckpt" > /dev/null ||
+  { echo "FAIL saving a checkpoint"; exit 1; }
+./apex_sim $program simulate 3000 > "$dir/full.out"
+./apex_sim $program simulate 3000 --restore-checkpoint="$dir/good.ckpt" > "$dir/restored.out"
+if ! cmp -s "$dir/full.out" "$dir/restored.out"; then
+  echo "FAIL restored run ends differently from the full run"
+  failed=1
+fi
+
+# The state follows the 56 byte header: clock, pc at 60, the registers,
+# pending_regs at 192, written_regs, then the latches from 200 on, 48
+# bytes each. MEM is at 344: opcode_id at 384, then rs1, rs2, rd and
+# rdPrev. Each case sets one byte.
+for corrupt in "384 200 opcode" "385 40 rs1" "386 16 rs2" "387 200 rd" \
+               "388 29 rdPrev" "60 1 pc" "194 16 pending_regs"; do
+  set -- $corrupt
+  cp "$dir/good.ckpt" "$dir/bad.ckpt"
+  printf "$(printf '\\%03o' "$2")" |
+    dd of="$dir/bad.ckpt" bs=1 seek="$1" conv=notrunc 2>/dev/null
+  ./apex_sim $program simulate 3000 --restore-checkpoint="$dir/bad.ckpt" \
+    > /dev/null 2> "$dir/err"
+  status=$?
+  if [ $status -ne 1 ] || ! grep -q "is not a valid version" "$dir/err"; then
+    echo "FAIL checkpoint with $3 byte $2 not rejected (exit status $status)"
+    failed=1
+  fi
+done
+
+[ $failed -eq 0 ] && echo "checkpoint_check: ok"
+exit $failed
@@ -0,0 +1,39 @@
+#!/bin/sh
+# Checks the per-opcode retired counts of the pipeline: every instruction
+# counts once as it leaves writeback, HALT included, however long it is
+# held on the way. Run from the project directory.
+set -u
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+failed=0
+
+# check <program> <expected instructions> <expected retired> <apex_sim options...>
+check() {
+  program=$1
+  instructions=$2
+  retired=$3
+  shift 3
+  ./apex_sim "$program" "$@" --counters="$dir/counters.json" > /dev/null
+  if ! grep -q "\"instructions\": $instructions," "$dir/counters.json" ||
+     ! grep -q "\"retired\": {$retired}" "$dir/counters.json"; then
+    echo "FAIL $program $*: counts differ"
+    grep -E '"instructions"|"retired"' "$dir/counters.json"
+    failed=1
+  fi
+}
+
+# A MUL loop, whatever the MUL latency: 4 MOVC, 3 times round the loop,
+# then STORE and HALT
+loop='"ADD": 3, "SUB": 3, "MUL": 3, "AND": 0, "OR": 0, "EX-OR": 0, "MOVC": 4, "LOAD": 0, "STORE": 1, "BZ": 0, "BNZ": 3, "JUMP": 0, "HALT": 1'
+check tests/mul_loop.asm 18 "$loop" simulate 0
+check tests/mul_loop.asm 18 "$loop" simulate 0 --mul-latency=1
+check tests/mul_loop.asm 18 "$loop" simulate 0 --mul-latency=4
+check tests/mul_loop.asm 18 "$loop" display 0
+
+# Without forwarding this program gets stuck; first a BNZ waits in EX and
+# is handed to writeback on every cycle it waits, but retires once
+wait='"ADD": 6, "SUB": 9, "MUL": 6, "AND": 3, "OR": 3, "EX-OR": 9, "MOVC": 14, "LOAD": 3, "STORE": 6, "BZ": 0, "BNZ": 3, "JUMP": 0, "HALT": 0'
+check tests/bnz_wait.asm 62 "$wait" simulate 1000 --no-forwarding
+
+[ $failed -eq 0 ] && echo "counters_check: ok"
+exit $failed
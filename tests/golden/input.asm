@@ -0,0 +1,6 @@
+MOVC,R1,#10
+MOVC,R2,#20
+MOVC,R3,#30
+STORE,R2,R10,#200
+MUL,R3,R3,R1
+MUL,R8,R4,R7
\ No newline at end of file
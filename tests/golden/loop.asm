@@ -0,0 +1,8 @@
+MOVC,R1,#5
+MOVC,R2,#1
+MOVC,R3,#0
+ADD,R3,R3,R1
+SUB,R1,R1,R2
+BNZ,#-8
+STORE,R3,R0,#4
+HALT,
@@ -0,0 +1,12 @@
+MOVC,R1,#3
+MOVC,R2,#1
+MOVC,R3,#0
+MOVC,R5,#7
+ADD,R3,R3,R2
+MUL,R4,R3,R2
+AND,R6,R4,R5
+STORE,R6,R0,#8
+LOAD,R7,R0,#8
+SUB,R1,R1,R2
+BNZ,#-24
+HALT,
@@ -0,0 +1,34 @@
+MOVC,R12,#1
+MOVC,R13,#4000
+MOVC,R1,#7
+MOVC,R2,#19
+MOVC,R3,#8
+MOVC,R4,#-4
+MOVC,R5,#3
+MOVC,R6,#11
+MOVC,R7,#10
+MOVC,R8,#7
+OR,R3,R2,R5
+LOAD,R6,R0,#12
+AND,R6,R4,R9
+ADD,R5,R1,R9
+MUL,R7,R1,R8
+OR,R6,R2,R4
+ADD,R3,R9,R8
+ADD,R6,R9,R8
+MUL,R5,R2,R9
+MUL,R7,R6,R4
+AND,R3,R1,R5
+ADD,R3,R3,R1
+MOVC,R4,#6
+MUL,R8,R6,R2
+STORE,R6,R0,#31
+MUL,R5,R2,R4
+LOAD,R6,R0,#12
+LOAD,R4,R0,#77
+LOAD,R1,R0,#77
+STORE,R6,R0,#14
+STORE,R1,R0,#77
+STORE,R1,R0,#24
+STORE,R3,R0,#91
+HALT,
@@ -0,0 +1,46 @@
+MOVC,R12,#1
+MOVC,R13,#4000
+MOVC,R1,#-1
+MOVC,R2,#13
+MOVC,R3,#20
+MOVC,R4,#19
+MOVC,R5,#-3
+MOVC,R6,#3
+MOVC,R7,#-2
+MOVC,R8,#10
+MOVC,R11,#2
+ADD,R4,R2,R8
+LOAD,R5,R0,#40
+AND,R1,R9,R1
+LOAD,R7,R0,#28
+LOAD,R8,R0,#44
+ADD,R4,R8,R5
+ADD,R2,R3,R5
+LOAD,R7,R0,#38
+OR,R8,R9,R7
+EX-OR,R3,R6,R9
+LOAD,R6,R0,#84
+MOVC,R3,#2
+MOVC,R1,#1
+LOAD,R7,R0,#64
+OR,R1,R4,R9
+MUL,R6,R6,R8
+STORE,R7,R0,#16
+MOVC,R4,#4
+MOVC,R6,#-3
+MOVC,R6,#9
+ADD,R3,R9,R3
+LOAD,R5,R0,#10
+MUL,R2,R3,R6
+SUB,R3,R5,R9
+STORE,R8,R0,#63
+MOVC,R1,#2
+MUL,R4,R5,R2
+EX-OR,R7,R3,R1
+SUB,R11,R11,R12
+BNZ,#-116
+STORE,R8,R0,#90
+STORE,R9,R0,#86
+STORE,R7,R0,#69
+STORE,R4,R0,#80
+HALT,
@@ -0,0 +1,41 @@
+MOVC,R12,#1
+MOVC,R13,#4000
+MOVC,R1,#5
+MOVC,R2,#-1
+MOVC,R3,#7
+MOVC,R4,#15
+MOVC,R5,#-4
+MOVC,R6,#-3
+MOVC,R7,#12
+MOVC,R8,#-2
+MOVC,R11,#4
+OR,R2,R4,R2
+OR,R2,R4,R1
+STORE,R4,R0,#71
+MOVC,R5,#-2
+STORE,R6,R0,#70
+LOAD,R1,R0,#87
+MOVC,R6,#2
+OR,R3,R4,R2
+MUL,R8,R6,R8
+STORE,R2,R0,#53
+AND,R6,R3,R8
+MUL,R2,R9,R6
+LOAD,R8,R0,#11
+LOAD,R5,R0,#91
+MUL,R6,R1,R8
+SUB,R2,R8,R1
+LOAD,R3,R0,#50
+OR,R5,R3,R7
+SUB,R7,R6,R7
+EX-OR,R3,R3,R4
+MUL,R8,R3,R5
+OR,R7,R9,R6
+STORE,R9,R0,#58
+SUB,R11,R11,R12
+BNZ,#-96
+STORE,R2,R0,#61
+STORE,R7,R0,#7
+STORE,R4,R0,#8
+STORE,R4,R0,#56
+HALT,
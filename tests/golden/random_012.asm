@@ -0,0 +1,18 @@
+MOVC,R12,#1
+MOVC,R13,#4000
+MOVC,R1,#10
+MOVC,R2,#3
+MOVC,R3,#16
+MOVC,R4,#11
+MOVC,R5,#16
+MOVC,R6,#6
+MOVC,R7,#-1
+MOVC,R8,#7
+LOAD,R4,R0,#84
+STORE,R6,R0,#43
+MOVC,R6,#-3
+STORE,R1,R0,#84
+STORE,R9,R0,#28
+STORE,R2,R0,#54
+STORE,R8,R0,#14
+HALT,
@@ -0,0 +1,33 @@
+MOVC,R12,#1
+MOVC,R13,#4000
+MOVC,R1,#7
+MOVC,R2,#19
+MOVC,R3,#-5
+MOVC,R4,#1
+MOVC,R5,#4
+MOVC,R6,#15
+MOVC,R7,#10
+MOVC,R8,#-4
+MOVC,R11,#5
+STORE,R2,R0,#65
+EX-OR,R8,R9,R2
+STORE,R7,R0,#24
+STORE,R2,R0,#51
+STORE,R1,R0,#22
+AND,R4,R7,R9
+AND,R8,R9,R8
+ADD,R8,R5,R3
+MOVC,R4,#-2
+LOAD,R3,R0,#97
+AND,R3,R9,R9
+AND,R6,R8,R8
+MOVC,R7,#2
+MOVC,R2,#2
+LOAD,R5,R0,#94
+SUB,R11,R11,R12
+BNZ,#-64
+STORE,R6,R0,#10
+STORE,R2,R0,#52
+STORE,R3,R0,#69
+STORE,R6,R0,#16
+HALT,
@@ -0,0 +1,33 @@
+MOVC,R12,#1
+MOVC,R13,#4000
+MOVC,R1,#20
+MOVC,R2,#-4
+MOVC,R3,#19
+MOVC,R4,#19
+MOVC,R5,#1
+MOVC,R6,#-3
+MOVC,R7,#12
+MOVC,R8,#7
+MOVC,R11,#3
+ADD,R7,R4,R1
+LOAD,R8,R0,#93
+BNZ,#12
+OR,R5,R7,R2
+STORE,R2,R0,#44
+OR,R1,R3,R2
+SUB,R7,R6,R4
+MOVC,R4,#2
+SUB,R2,R6,R9
+OR,R2,R4,R9
+EX-OR,R1,R8,R1
+MUL,R2,R8,R5
+BZ,#8
+OR,R6,R2,R2
+AND,R6,R8,R1
+SUB,R11,R11,R12
+BNZ,#-64
+STORE,R6,R0,#62
+STORE,R7,R0,#38
+STORE,R9,R0,#69
+STORE,R6,R0,#90
+HALT,
@@ -0,0 +1,27 @@
+MOVC,R12,#1
+MOVC,R13,#4000
+MOVC,R1,#6
+MOVC,R2,#18
+MOVC,R3,#7
+MOVC,R4,#12
+MOVC,R5,#6
+MOVC,R6,#18
+MOVC,R7,#12
+MOVC,R8,#0
+MOVC,R11,#3
+MOVC,R8,#6
+MOVC,R3,#-2
+STORE,R6,R0,#46
+BZ,#12
+SUB,R5,R1,R8
+MUL,R5,R6,R6
+LOAD,R3,R0,#45
+BNZ,#12
+OR,R3,R4,R5
+SUB,R11,R11,R12
+BNZ,#-40
+STORE,R2,R0,#9
+STORE,R5,R0,#49
+STORE,R6,R0,#66
+STORE,R8,R0,#55
+HALT,
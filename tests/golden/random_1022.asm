@@ -0,0 +1,27 @@
+MOVC,R12,#1
+MOVC,R13,#4000
+MOVC,R1,#-1
+MOVC,R2,#8
+MOVC,R3,#14
+MOVC,R4,#6
+MOVC,R5,#-3
+MOVC,R6,#7
+MOVC,R7,#12
+MOVC,R8,#16
+MOVC,R11,#5
+BNZ,#8
+LOAD,R7,R0,#19
+OR,R8,R1,R3
+EX-OR,R6,R6,R3
+BNZ,#12
+OR,R2,R4,R9
+JUMP,R13,#4080
+LOAD,R6,R0,#47
+LOAD,R4,R0,#18
+SUB,R11,R11,R12
+BNZ,#-40
+STORE,R2,R0,#43
+STORE,R4,R0,#12
+STORE,R4,R0,#76
+STORE,R3,R0,#62
+HALT,
@@ -0,0 +1,39 @@
+MOVC,R12,#1
+MOVC,R13,#4000
+MOVC,R1,#-5
+MOVC,R2,#11
+MOVC,R3,#-2
+MOVC,R4,#16
+MOVC,R5,#12
+MOVC,R6,#19
+MOVC,R7,#14
+MOVC,R8,#12
+MOVC,R11,#5
+BZ,#12
+ADD,R5,R3,R9
+BNZ,#12
+MOVC,R3,#1
+LOAD,R5,R0,#42
+BZ,#12
+JUMP,R13,#4088
+AND,R1,R1,R4
+MUL,R8,R6,R6
+BNZ,#12
+MUL,R1,R7,R2
+MOVC,R7,#6
+SUB,R4,R4,R1
+MOVC,R4,#9
+SUB,R7,R6,R5
+EX-OR,R8,R7,R5
+STORE,R9,R0,#85
+LOAD,R5,R0,#20
+STORE,R9,R0,#17
+STORE,R6,R0,#70
+EX-OR,R3,R7,R2
+SUB,R11,R11,R12
+BNZ,#-88
+STORE,R1,R0,#69
+STORE,R2,R0,#61
+STORE,R7,R0,#82
+STORE,R1,R0,#50
+HALT,
@@ -0,0 +1,38 @@
+MOVC,R12,#1
+MOVC,R13,#4000
+MOVC,R1,#18
+MOVC,R2,#-2
+MOVC,R3,#-2
+MOVC,R4,#15
+MOVC,R5,#10
+MOVC,R6,#1
+MOVC,R7,#17
+MOVC,R8,#9
+BNZ,#12
+JUMP,R13,#4060
+SUB,R7,R9,R7
+BZ,#8
+BZ,#8
+BZ,#8
+STORE,R7,R0,#65
+EX-OR,R6,R9,R4
+SUB,R5,R2,R5
+LOAD,R7,R0,#43
+EX-OR,R2,R9,R6
+MUL,R7,R9,R6
+BNZ,#12
+ADD,R4,R1,R5
+ADD,R1,R2,R8
+EX-OR,R1,R9,R5
+LOAD,R4,R0,#20
+MOVC,R6,#-2
+LOAD,R4,R0,#72
+SUB,R3,R5,R8
+AND,R1,R6,R9
+STORE,R3,R0,#61
+SUB,R1,R2,R1
+STORE,R7,R0,#10
+STORE,R9,R0,#94
+STORE,R6,R0,#9
+STORE,R5,R0,#56
+HALT,
@@ -0,0 +1,37 @@
+#!/bin/sh
+# Checks the pipeline against the golden programs in tests/golden: the
+# display output, which shows every stage of every cycle, and the final
+# state from simulate must match the expected outputs byte for byte.
+# Without forwarding most programs never finish, so only their first
+# cycles are compared. Run from the project directory; with --update the
+# expected outputs are rewritten from the current apex_sim instead.
+set -u
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+update=0
+[ "${1:-}" = "--update" ] && update=1
+failed=0
+
+# check <program> <suffix> <apex_sim arguments...>
+check() {
+  program=$1
+  expected=${program%.asm}.$2
+  shift 2
+  ./apex_sim "$program" "$@" > "$dir/out" 2>&1
+  if [ $update -eq 1 ]; then
+    cp "$dir/out" "$expected"
+  elif ! cmp -s "$dir/out" "$expected"; then
+    echo "FAIL $program $*: output differs from $expected"
+    diff "$expected" "$dir/out" | head -10
+    failed=1
+  fi
+}
+
+for program in tests/golden/*.asm; do
+  check "$program" display display 3000
+  check "$program" simulate simulate 3000
+  check "$program" no_forwarding display 60 --no-forwarding
+done
+
+[ $failed -eq 0 ] && echo "golden_check: ok"
+exit $failed
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Checks that apex_sim runs an image made by apex_asm as it runs the
+# text program, and rejects images with a corrupt instruction record
+# instead of running them. Run from the project directory.
+set -u
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+failed=0
+
+./apex_asm input.asm "$dir/good.img" 2>/dev/null || { echo "FAIL apex_asm"; exit 1; }
+./apex_sim input.asm simulate 100 > "$dir/text.out"
+./apex_sim "$dir/good.img" simulate 100 > "$dir/image.out"
+if ! cmp -s "$dir/text.out" "$dir/image.out"; then
+  echo "FAIL image runs differently from its text program"
+  failed=1
+fi
+
+# Instruction records follow the 32 byte header: opcode_id, rd, rs1,
+# rs2, then the literal. Each case sets one byte of the first record.
+for corrupt in "0 200 opcode" "0 14 opcode" "1 40 rd" "2 16 rs1" "3 29 rs2"; do
+  set -- $corrupt
+  cp "$dir/good.img" "$dir/bad.img"
+  printf "$(printf '\\%03o' "$2")" |
+    dd of="$dir/bad.img" bs=1 seek=$((32 + $1)) conv=notrunc 2>/dev/null
+  ./apex_sim "$dir/bad.img" simulate 100 > /dev/null 2> "$dir/err"
+  status=$?
+  if [ $status -ne 1 ] || ! grep -q "Bad instruction 1 in program image" "$dir/err"; then
+    echo "FAIL image with $3 byte $2 not rejected (exit status $status)"
+    failed=1
+  fi
+done
+
+[ $failed -eq 0 ] && echo "image_check: ok"
+exit $failed
@@ -0,0 +1,194 @@
+/*
+ *  lockstep.c
+ *  Check of the lockstep mode. Every program given is run on lanes of
+ *  the lockstep pipeline, each lane on data memory of its own, in a set
+ *  of configurations (forwarding, MUL latency). Every lane must come to
+ *  the same clock, instructions, registers, data memory and pipeline
+ *  state as APEX_cpu_run simulating the program on its data alone, or
+ *  the exit status is 1.
+ *  Usage: apex_lockstep [--lanes=N] <input_file>...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cpu.h"
+#include "../lockstep.h"
+
+/* Default number of lanes, not a multiple of the vector width so that
+ * the last vector has padding lanes */
+#define DEFAULT_LANES 37
+
+/* Words of data memory every lane starts with, small values mostly so
+ * that loop counts and branch conditions vary between lanes */
+#define DATA_WORDS 64
+
+/* Cycles every run is limited to, so that programs that deadlock
+ * without forwarding still stop */
+#define CHECK_CYCLES 3000
+
+/* MUL latencies tried; 0 keeps the default */
+static const int mul_latencies[] = {0, 1, 4};
+#define NUM_MUL_LATENCIES (sizeof(mul_latencies) / sizeof(*mul_latencies))
+
+/**
+ * Fills in the data of every lane, the same for every run
+ * @param data lanes * DATA_WORDS words
+ * @param lanes
+ */
+static void make_data(int *data, int lanes) {
+  uint32_t state = 12345;
+  for (int i = 0; i < lanes * DATA_WORDS; ++i) {
+    state = state * 1103515245 + 12345;
+    int value = (int) (state >> 16) % 6 - 2;
+    data[i] = (state >> 8) % 8 == 0 ? value * 10 : value;
+  }
+}
+
+static APEX_CPU *make_cpu(const char *filename, int no_forwarding,
+                          int mul_latency) {
+  APEX_CPU *cpu = APEX_cpu_init(filename);
+  if (cpu) {
+    cpu->config.out = NULL;
+    cpu->config.data_forwarding = !no_forwarding;
+    if (mul_latency) {
+      cpu->config.mul_latency = mul_latency;
+    }
+  }
+  return cpu;
+}
+
+/**
+ * Whether two CPUs are in the same state
+ */
+static int same_state(const APEX_CPU *a, const APEX_CPU *b) {
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    const CPU_Stage *x = &a->stage[i];
+    const CPU_Stage *y = &b->stage[i];
+    if (x->pc != y->pc || x->imm != y->imm || x->rs1_value != y->rs1_value ||
+        x->rs2_value != y->rs2_value || x->buffer != y->buffer ||
+        x->mem_address != y->mem_address || x->zFlag != y->zFlag ||
+        x->seq != y->seq || x->opcode_id != y->opcode_id || x->rs1 != y->rs1 ||
+        x->rs2 != y->rs2 || x->rd != y->rd || x->rdPrev != y->rdPrev ||
+        x->busy != y->busy || x->stalled != y->stalled ||
+        x->stallDueToNextStage != y->stallDueToNextStage ||
+        x->flushInNextStage != y->flushInNextStage ||
+        x->handleJumpInNextStage != y->handleJumpInNextStage ||
+        x->handleBZInNextStage != y->handleBZInNextStage ||
+        x->handleBNZInNextStage != y->handleBNZInNextStage ||
+        x->stallDueToLoadFlag != y->stallDueToLoadFlag ||
+        x->mulCycles != y->mulCycles) {
+      return 0;
+    }
+  }
+  return a->clock == b->clock && a->pc == b->pc &&
+         memcmp(a->regs, b->regs, sizeof(a->regs)) == 0 &&
+         a->pending_regs == b->pending_regs &&
+         a->written_regs == b->written_regs &&
+         a->ins_completed == b->ins_completed &&
+         a->ins_retired == b->ins_retired &&
+         a->ins_fetched == b->ins_fetched &&
+         a->last_retired == b->last_retired && a->zFlag == b->zFlag &&
+         a->haltFlag == b->haltFlag &&
+         memory_hash(&a->data_memory) == memory_hash(&b->data_memory);
+}
+
+/**
+ * Runs a program on lanes in one configuration and checks every lane
+ * against a serial run on its data
+ * @return number of lanes that differ, -1 if the program could not run
+ */
+static int check_lanes(const char *filename, int lanes, const int *data,
+                       int no_forwarding, int mul_latency) {
+  APEX_CPU *cpu = make_cpu(filename, no_forwarding, mul_latency);
+  APEX_Lockstep *ls = cpu ? APEX_lockstep_create(cpu, lanes) : NULL;
+  if (!ls) {
+    APEX_cpu_stop(cpu);
+    return -1;
+  }
+  for (int lane = 0; lane < lanes; ++lane) {
+    memory_write(APEX_lockstep_data_memory(ls, lane), 0, DATA_WORDS,
+                 data + lane * DATA_WORDS);
+  }
+  APEX_lockstep_run(ls, CHECK_CYCLES);
+
+  char cycles[16];
+  snprintf(cycles, sizeof(cycles), "%d", CHECK_CYCLES);
+  int failed = 0;
+  for (int lane = 0; lane < lanes && failed >= 0; ++lane) {
+    APEX_CPU *serial = make_cpu(filename, no_forwarding, mul_latency);
+    if (!serial) {
+      failed = -1;
+      break;
+    }
+    memory_write(&serial->data_memory, 0, DATA_WORDS, data + lane * DATA_WORDS);
+    APEX_cpu_run(serial, "simulate", cycles);
+
+    APEX_Lockstep_Lane state;
+    APEX_lockstep_get_lane(ls, lane, &state);
+    if (APEX_lockstep_get_cpu(ls, lane, cpu) != 0) {
+      failed = -1;
+    } else if (state.finished != serial->finished ||
+               state.clock != serial->clock ||
+               state.instructions != serial->ins_retired ||
+               !same_state(cpu, serial)) {
+      if (failed++ < 3) {
+        fprintf(stderr, "FAIL %s lane %d%s mul latency %d: clock %d, serial "
+                "%d\n", filename, lane, no_forwarding ? " no forwarding," : "",
+                mul_latency, state.clock, serial->clock);
+      }
+    }
+    APEX_cpu_stop(serial);
+  }
+  APEX_lockstep_destroy(ls);
+  APEX_cpu_stop(cpu);
+  return failed;
+}
+
+int main(int argc, char const *argv[]) {
+  int lanes = DEFAULT_LANES;
+  int num_files = 0;
+  const char **files = calloc(argc, sizeof(*files));
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--lanes=", 8) == 0) {
+      lanes = atoi(argv[i] + 8);
+    } else if (strncmp(argv[i], "--", 2) == 0) {
+      num_files = 0;
+      break;
+    } else {
+      files[num_files++] = argv[i];
+    }
+  }
+  if (num_files == 0 || lanes <= 0) {
+    fprintf(stderr, "APEX_Help : Usage %s [--lanes=N] <input_file>...\n",
+            argv[0]);
+    exit(1);
+  }
+
+  int *data = malloc(sizeof(int) * lanes * DATA_WORDS);
+  if (!data) {
+    fprintf(stderr, "APEX_Error : Out of memory\n");
+    exit(1);
+  }
+  make_data(data, lanes);
+
+  int failed = 0;
+  for (int f = 0; f < num_files; ++f) {
+    for (int no_forwarding = 0; no_forwarding < 2; ++no_forwarding) {
+      for (size_t l = 0; l < NUM_MUL_LATENCIES; ++l) {
+        int differ = check_lanes(files[f], lanes, data, no_forwarding,
+                                 mul_latencies[l]);
+        if (differ < 0) {
+          fprintf(stderr, "APEX_Error : Unable to run %s\n", files[f]);
+          exit(1);
+        }
+        failed += differ;
+      }
+    }
+  }
+  free(data);
+  free(files);
+  printf("lockstep: %d programs on %d lanes, %d lanes differ\n", num_files,
+         lanes, failed);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,53 @@
+#!/bin/sh
+# Checks the lockstep mode. Lanes started on data of their own must come
+# to the state of a serial pipeline run on the same data (apex_lockstep),
+# and apex_sim's lockstep mode must leave the state of lane 0 exactly as
+# simulate would. Run from the project directory.
+set -u
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+failed=0
+
+# lockstep_lanes.asm loops and branches on its data; lockstep_forwarding.asm
+# has decode wait for a result it cannot forward yet
+tests/apex_lockstep tests/golden/*.asm tests/lockstep_lanes.asm \
+  tests/lockstep_forwarding.asm > "$dir/out" 2>&1 ||
+  { cat "$dir/out"; failed=1; }
+
+# check <program> <apex_sim options...>
+check() {
+  program=$1
+  shift
+  ./apex_sim "$program" simulate 3000 "$@" > "$dir/serial" 2>&1
+  ./apex_sim "$program" lockstep 3000 --lanes=5 "$@" > "$dir/lanes" 2>&1
+  if ! sed '1,/^ 4 /d' "$dir/lanes" | cmp -s - "$dir/serial"; then
+    echo "FAIL $program $*: lockstep differs from simulate"
+    failed=1
+  fi
+}
+
+for program in tests/golden/*.asm; do
+  check "$program"
+  check "$program" --no-forwarding
+  check "$program" --mul-latency=4
+done
+
+# Lanes on data of their own: the registers of every lane must be those
+# of the functional lanes mode, with cycle counts of their own
+printf '3 5 0 1\n0 2 1 0\n# comment\n7 -3 0 0\n1 1 4 2\n' > "$dir/data"
+./apex_sim tests/lockstep_lanes.asm lockstep 0 --lane-data="$dir/data" |
+  sed -n '/^ [0-9]* complete/p' | cut -d" " -f2,3,5,7- > "$dir/lockstep"
+./apex_sim tests/lockstep_lanes.asm lanes 0 --lane-data="$dir/data" |
+  sed -n '/^ [0-9]* complete/p' | cut -d" " -f2-4,6- > "$dir/lanes"
+if [ "$(wc -l < "$dir/lockstep")" -ne 4 ] || ! cmp -s "$dir/lockstep" "$dir/lanes"; then
+  echo "FAIL lockstep lanes differ from the lanes mode"
+  failed=1
+fi
+if [ "$(./apex_sim tests/lockstep_lanes.asm lockstep 0 --lane-data="$dir/data" |
+        sed -n '/^ [0-9]* complete/p' | cut -d' ' -f4 | sort -u | wc -l)" -lt 2 ]; then
+  echo "FAIL lockstep lanes on different data ran the same cycles"
+  failed=1
+fi
+
+[ $failed -eq 0 ] && echo "lockstep_check: ok"
+exit $failed
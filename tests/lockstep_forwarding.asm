@@ -0,0 +1,26 @@
+MOVC,R12,#1
+MOVC,R13,#4000
+MOVC,R1,#4
+MOVC,R2,#0
+MOVC,R3,#-2
+MOVC,R4,#19
+MOVC,R5,#14
+MOVC,R6,#6
+MOVC,R7,#5
+MOVC,R8,#1
+MOVC,R11,#2
+BNZ,#12
+EX-OR,R8,R8,R4
+SUB,R8,R8,R3
+LOAD,R3,R0,#75
+BNZ,#4
+ADD,R1,R3,R5
+LOAD,R4,R0,#79
+LOAD,R7,R0,#50
+SUB,R11,R11,R12
+BNZ,#-36
+STORE,R1,R0,#15
+STORE,R3,R0,#81
+STORE,R2,R0,#46
+STORE,R4,R0,#5
+HALT,
@@ -0,0 +1,28 @@
+MOVC,R0,#0
+MOVC,R10,#4000
+LOAD,R1,R0,#0
+MOVC,R2,#7
+AND,R1,R1,R2
+MOVC,R3,#1
+MOVC,R4,#0
+LOAD,R5,R0,#1
+ADD,R1,R1,R3
+MUL,R6,R5,R1
+ADD,R4,R4,R6
+LOAD,R7,R4,#2
+STORE,R4,R1,#20
+SUB,R1,R1,R3
+BNZ,#-20
+LOAD,R8,R0,#2
+ADD,R8,R8,R0
+BZ,#8
+MOVC,R9,#5
+STORE,R9,R0,#30
+LOAD,R11,R0,#3
+ADD,R11,R11,R0
+BNZ,#12
+JUMP,R10,#100
+MOVC,R12,#9
+MOVC,R13,#3
+STORE,R13,R0,#31
+HALT,
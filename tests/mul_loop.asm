@@ -0,0 +1,10 @@
+MOVC,R1,#3
+MOVC,R2,#1
+MOVC,R3,#1
+MOVC,R4,#2
+MUL,R3,R3,R4
+ADD,R5,R3,R2
+SUB,R1,R1,R2
+BNZ,#-12
+STORE,R3,R0,#4
+HALT,
@@ -0,0 +1,197 @@
+/*
+ *  stress.c
+ *  Stress test of running many simulations in one process. Every program
+ *  given is run in a set of configurations (functionality, forwarding,
+ *  MUL latency), first one at a time, then as many instances at once as
+ *  asked for, spread over a pool of threads. Each instance writes its
+ *  output to a stream of its own; its output, clock, instructions,
+ *  registers and data memory must match those of the serial run of its
+ *  configuration, or the exit status is 1.
+ *  Usage: apex_stress [--instances=N] [--threads=N] <input_file>...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cpu.h"
+#include "../thread_pool.h"
+
+/* Default number of instances run at once */
+#define DEFAULT_INSTANCES 512
+
+/* Threads per host core by default, more than one so that instances
+ * interleave even on a single core */
+#define THREADS_PER_CORE 4
+
+/* Cycles, or instructions, each run is limited to, so that programs
+ * that deadlock without forwarding still stop */
+#define STRESS_CYCLES "400"
+
+static const char *functionalities[] = {"display", "simulate", "functional",
+                                        "translate"};
+#define NUM_FUNCTIONALITIES (sizeof(functionalities) / sizeof(*functionalities))
+
+/* MUL latencies tried; 0 keeps the default */
+static const int mul_latencies[] = {0, 4};
+#define NUM_MUL_LATENCIES (sizeof(mul_latencies) / sizeof(*mul_latencies))
+
+/* Configuration of a run, and what it came to */
+typedef struct Stress_Run {
+  const char *filename;
+  const char *functionality;
+  int no_forwarding;
+  int mul_latency;
+
+  int status;               // 0 once run, -1 if it could not be
+  int finished;
+  int clock;
+  uint64_t instructions;
+  int regs[32];
+  uint64_t memory_hash;
+  char *output;             // Everything the run printed, malloc'd
+  size_t output_size;
+} Stress_Run;
+
+/* Serial runs, one per configuration, and the instances to check */
+typedef struct Stress_Job {
+  const Stress_Run *serial;
+  int num_serial;
+  Stress_Run *instances;
+} Stress_Job;
+
+/**
+ * Runs one configuration on a CPU of its own, with its output going to
+ * a memory stream
+ * @param run
+ */
+static void run_one(Stress_Run *run) {
+  run->status = -1;
+  FILE *out = open_memstream(&run->output, &run->output_size);
+  if (!out) {
+    return;
+  }
+  APEX_CPU *cpu = APEX_cpu_init(run->filename);
+  if (cpu) {
+    cpu->config.out = out;
+    cpu->config.data_forwarding = !run->no_forwarding;
+    if (run->mul_latency) {
+      cpu->config.mul_latency = run->mul_latency;
+    }
+    if (APEX_cpu_run(cpu, run->functionality, STRESS_CYCLES) == 0) {
+      run->status = 0;
+      run->finished = cpu->finished;
+      run->clock = cpu->clock;
+      run->instructions = cpu->ins_retired;
+      memcpy(run->regs, cpu->regs, sizeof(run->regs));
+      run->memory_hash = memory_hash(&cpu->data_memory);
+    }
+    APEX_cpu_stop(cpu);
+  }
+  fclose(out);
+}
+
+static void run_instance(void *arg, int index) {
+  Stress_Job *job = arg;
+  Stress_Run *instance = &job->instances[index];
+  *instance = job->serial[index % job->num_serial];
+  run_one(instance);
+}
+
+/**
+ * Whether an instance came to the same as the serial run of its
+ * configuration
+ */
+static int same_run(const Stress_Run *a, const Stress_Run *b) {
+  return a->status == 0 && b->status == 0 && a->finished == b->finished &&
+         a->clock == b->clock && a->instructions == b->instructions &&
+         memcmp(a->regs, b->regs, sizeof(a->regs)) == 0 &&
+         a->memory_hash == b->memory_hash &&
+         a->output_size == b->output_size &&
+         memcmp(a->output, b->output, a->output_size) == 0;
+}
+
+int main(int argc, char const *argv[]) {
+  int instances = DEFAULT_INSTANCES;
+  int threads = 0;
+  int num_files = 0;
+  const char **files = calloc(argc, sizeof(*files));
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--instances=", 12) == 0) {
+      instances = atoi(argv[i] + 12);
+    } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+      threads = atoi(argv[i] + 10);
+    } else if (strncmp(argv[i], "--", 2) == 0) {
+      num_files = 0;
+      break;
+    } else {
+      files[num_files++] = argv[i];
+    }
+  }
+  if (num_files == 0 || instances <= 0) {
+    fprintf(stderr, "APEX_Help : Usage %s [--instances=N] [--threads=N] "
+            "<input_file>...\n", argv[0]);
+    exit(1);
+  }
+
+  int num_serial = num_files * NUM_FUNCTIONALITIES * 2 * NUM_MUL_LATENCIES;
+  Stress_Run *serial = calloc(num_serial, sizeof(*serial));
+  Stress_Run *runs = calloc(instances, sizeof(*runs));
+  if (!serial || !runs) {
+    fprintf(stderr, "APEX_Error : Out of memory\n");
+    exit(1);
+  }
+
+  int n = 0;
+  for (int f = 0; f < num_files; ++f) {
+    for (size_t m = 0; m < NUM_FUNCTIONALITIES; ++m) {
+      for (int no_forwarding = 0; no_forwarding < 2; ++no_forwarding) {
+        for (size_t l = 0; l < NUM_MUL_LATENCIES; ++l) {
+          Stress_Run *run = &serial[n++];
+          run->filename = files[f];
+          run->functionality = functionalities[m];
+          run->no_forwarding = no_forwarding;
+          run->mul_latency = mul_latencies[l];
+          run_one(run);
+          if (run->status != 0) {
+            fprintf(stderr, "APEX_Error : Unable to run %s\n", files[f]);
+            exit(1);
+          }
+        }
+      }
+    }
+  }
+
+  Thread_Pool *pool = thread_pool_create(threads > 0 ? threads
+                                                     : THREADS_PER_CORE *
+                                                       thread_pool_default_size());
+  if (!pool) {
+    fprintf(stderr, "APEX_Error : Unable to start threads\n");
+    exit(1);
+  }
+  Stress_Job job = {serial, num_serial, runs};
+  thread_pool_run(pool, run_instance, &job, instances);
+  threads = thread_pool_size(pool);
+  thread_pool_destroy(pool);
+
+  int failed = 0;
+  for (int i = 0; i < instances; ++i) {
+    const Stress_Run *run = &runs[i];
+    if (!same_run(run, &serial[i % num_serial])) {
+      if (failed++ < 10) {
+        fprintf(stderr, "FAIL instance %d: %s %s%s mul latency %d differs "
+                "from its serial run\n", i, run->filename, run->functionality,
+                run->no_forwarding ? " no forwarding," : "", run->mul_latency);
+      }
+    }
+    free(run->output);
+  }
+  for (int i = 0; i < num_serial; ++i) {
+    free(serial[i].output);
+  }
+  printf("stress: %d instances of %d configurations on %d threads, %d "
+         "differ\n", instances, num_serial, threads, failed);
+  free(serial);
+  free(runs);
+  free(files);
+  return failed ? 1 : 0;
+}
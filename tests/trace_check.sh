@@ -0,0 +1,48 @@
+#!/bin/sh
+# Checks that apex_trace renders a trace as display printed the run, and
+# rejects traces with a corrupt record instead of printing it. Run from
+# the project directory.
+set -u
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+failed=0
+program=tests/golden/mul_load_loop.asm
+
+./apex_sim $program display 3000 > "$dir/display.out"
+./apex_sim $program simulate 3000 --trace="$dir/good.trace" > /dev/null ||
+  { echo "FAIL writing a trace"; exit 1; }
+./apex_trace "$dir/good.trace" > "$dir/trace.out"
+if ! cmp -s "$dir/display.out" "$dir/trace.out"; then
+  echo "FAIL rendered trace differs from display"
+  failed=1
+fi
+
+# Records follow the 24 byte header, 68 bytes each: clock, kind, the
+# stage bits, then the stages from 8 on, 12 bytes each with opcode_id,
+# rd, rs1 and rs2 at 8. The first record shows fetch (stage 0). The end
+# record is followed by 476 bytes, data_memory_words 72 bytes in, 404
+# bytes from the end of the file.
+size=$(wc -c < "$dir/good.trace")
+for corrupt in "28 9 kind" "40 200 opcode" "41 200 rd" "42 40 rs1" \
+               "43 16 rs2" "$((size - 403)) 1 data_memory_words"; do
+  set -- $corrupt
+  cp "$dir/good.trace" "$dir/bad.trace"
+  printf "$(printf '\\%03o' "$2")" |
+    dd of="$dir/bad.trace" bs=1 seek="$1" conv=notrunc 2>/dev/null
+  ./apex_trace "$dir/bad.trace" > /dev/null 2> "$dir/err"
+  status=$?
+  if [ $status -ne 1 ] || ! grep -q "Bad record" "$dir/err"; then
+    echo "FAIL trace with $3 byte $2 not rejected (exit status $status)"
+    failed=1
+  fi
+done
+
+# A truncated trace ends early rather than printing its partial end
+head -c $((size - 100)) "$dir/good.trace" > "$dir/short.trace"
+if ./apex_trace "$dir/short.trace" > /dev/null 2>&1; then
+  echo "FAIL truncated trace not rejected"
+  failed=1
+fi
+
+[ $failed -eq 0 ] && echo "trace_check: ok"
+exit $failed
@@ -0,0 +1,168 @@
+/*
+ *  thread_pool.c
+ *  Contains a fixed-size pool of worker threads. The thread calling
+ *  thread_pool_run() works on the tasks too, so a pool of N threads
+ *  starts N - 1 workers.
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+
+struct Thread_Pool {
+  pthread_mutex_t lock;
+  pthread_cond_t work_ready;   // Signalled when a new batch is posted
+  pthread_cond_t work_done;    // Signalled when the last task finishes
+
+  Thread_Task task;
+  void *arg;
+  int count;          // Number of tasks in the current batch
+  int next;           // Next task index to hand out
+  int remaining;      // Tasks not yet finished
+  int generation;     // Bumped for every batch posted
+  int shutdown;
+
+  int num_threads;
+  pthread_t *workers;
+};
+
+/**
+ * Runs tasks of the current batch until none are left to hand out
+ * @param pool
+ */
+static void run_tasks(Thread_Pool *pool) {
+  while (pool->next < pool->count) {
+    int index = pool->next++;
+    Thread_Task task = pool->task;
+    void *arg = pool->arg;
+
+    pthread_mutex_unlock(&pool->lock);
+    task(arg, index);
+    pthread_mutex_lock(&pool->lock);
+
+    if (--pool->remaining == 0) {
+      pthread_cond_broadcast(&pool->work_done);
+    }
+  }
+}
+
+static void *worker_main(void *data) {
+  Thread_Pool *pool = data;
+  int seen_generation = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  while (1) {
+    while (!pool->shutdown && pool->generation == seen_generation) {
+      pthread_cond_wait(&pool->work_ready, &pool->lock);
+    }
+    if (pool->shutdown) {
+      break;
+    }
+    seen_generation = pool->generation;
+    run_tasks(pool);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+/**
+ * Creates a pool running on num_threads threads, the caller included
+ * @param num_threads
+ * @return
+ */
+Thread_Pool *thread_pool_create(int num_threads) {
+  if (num_threads < 1) {
+    num_threads = 1;
+  }
+
+  Thread_Pool *pool = calloc(1, sizeof(*pool));
+  if (!pool) {
+    return NULL;
+  }
+  pool->workers = calloc(num_threads, sizeof(*pool->workers));
+  if (!pool->workers) {
+    free(pool);
+    return NULL;
+  }
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work_ready, NULL);
+  pthread_cond_init(&pool->work_done, NULL);
+
+  pool->num_threads = 1;
+  for (int i = 1; i < num_threads; ++i) {
+    if (pthread_create(&pool->workers[i], NULL, worker_main, pool) != 0) {
+      break;
+    }
+    pool->num_threads++;
+  }
+  return pool;
+}
+
+/**
+ * Calls task(arg, i) for every i in [0, count) and waits for all of them
+ * @param pool
+ * @param task
+ * @param arg
+ * @param count
+ */
+void thread_pool_run(Thread_Pool *pool, Thread_Task task, void *arg, int count) {
+  if (count <= 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->task = task;
+  pool->arg = arg;
+  pool->count = count;
+  pool->next = 0;
+  pool->remaining = count;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->work_ready);
+
+  run_tasks(pool);
+  while (pool->remaining > 0) {
+    pthread_cond_wait(&pool->work_done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+int thread_pool_size(const Thread_Pool *pool) {
+  return pool->num_threads;
+}
+
+/**
+ * Stops the workers and frees the pool
+ * @param pool
+ */
+void thread_pool_destroy(Thread_Pool *pool) {
+  if (!pool) {
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&pool->work_ready);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int i = 1; i < pool->num_threads; ++i) {
+    pthread_join(pool->workers[i], NULL);
+  }
+
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->work_ready);
+  pthread_cond_destroy(&pool->work_done);
+  free(pool->workers);
+  free(pool);
+}
+
+/**
+ * Number of threads to use when the caller does not say: one per
+ * online CPU
+ * @return
+ */
+int thread_pool_default_size(void) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  return cpus > 0 ? (int) cpus : 1;
+}
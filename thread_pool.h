@@ -0,0 +1,24 @@
+#ifndef _APEX_THREAD_POOL_H_
+#define _APEX_THREAD_POOL_H_
+/**
+ *  thread_pool.h
+ *  Contains a small fixed-size pool of worker threads used to run
+ *  independent tasks in parallel
+ */
+
+/* Task body, called once for every index of a thread_pool_run() */
+typedef void (*Thread_Task)(void *arg, int index);
+
+typedef struct Thread_Pool Thread_Pool;
+
+Thread_Pool *thread_pool_create(int num_threads);
+
+void thread_pool_run(Thread_Pool *pool, Thread_Task task, void *arg, int count);
+
+int thread_pool_size(const Thread_Pool *pool);
+
+void thread_pool_destroy(Thread_Pool *pool);
+
+int thread_pool_default_size(void);
+
+#endif
@@ -0,0 +1,297 @@
+/*
+ *  trace.c
+ *  Contains the trace writer. The simulator fills records in a ring
+ *  buffer shared with one writer thread, which drains it to the trace
+ *  file in large writes. There is one producer and one consumer, so
+ *  the ring needs no lock: each side only moves its own index.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+/* Records in the ring, a power of 2 */
+#define TRACE_RING_RECORDS (1 << 14)
+
+/* Most records handed to one write() */
+#define TRACE_WRITE_RECORDS (1 << 12)
+
+/* Time the writer sleeps on an empty ring */
+#define TRACE_IDLE_NS 200000
+
+struct Trace_Writer {
+  int fd;
+  APEX_Trace_Record *ring;
+  _Atomic uint64_t head;      // Next record the simulator fills
+  _Atomic uint64_t tail;      // Next record the writer writes out
+  _Atomic int closing;        // Set once the simulator has committed its last record
+  int failed;                 // Set by the writer on a failed write
+  pthread_t thread;
+};
+
+/**
+ * Writes all of a buffer
+ * @param fd
+ * @param data
+ * @param size
+ * @return 0 on success, -1 on error
+ */
+static int write_all(int fd, const void *data, size_t size) {
+  const char *bytes = data;
+  while (size > 0) {
+    ssize_t written = write(fd, bytes, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    bytes += written;
+    size -= written;
+  }
+  return 0;
+}
+
+/**
+ * Writer thread: writes out committed records until the simulator is
+ * done and the ring is empty
+ * @param arg
+ * @return
+ */
+static void *drain_ring(void *arg) {
+  Trace_Writer *writer = arg;
+  uint64_t tail = atomic_load_explicit(&writer->tail, memory_order_relaxed);
+  while (1) {
+    int closing = atomic_load_explicit(&writer->closing, memory_order_acquire);
+    uint64_t head = atomic_load_explicit(&writer->head, memory_order_acquire);
+    if (head == tail) {
+      if (closing) {
+        break;
+      }
+      struct timespec idle = {0, TRACE_IDLE_NS};
+      nanosleep(&idle, NULL);
+      continue;
+    }
+
+    /** Up to the end of the ring, the rest goes in the next write */
+    uint64_t index = tail & (TRACE_RING_RECORDS - 1);
+    uint64_t count = head - tail;
+    if (count > TRACE_RING_RECORDS - index) {
+      count = TRACE_RING_RECORDS - index;
+    }
+    if (count > TRACE_WRITE_RECORDS) {
+      count = TRACE_WRITE_RECORDS;
+    }
+    if (!writer->failed &&
+        write_all(writer->fd, &writer->ring[index],
+                  count * sizeof(APEX_Trace_Record)) != 0) {
+      writer->failed = 1;
+    }
+    tail += count;
+    atomic_store_explicit(&writer->tail, tail, memory_order_release);
+  }
+  return NULL;
+}
+
+/**
+ * Creates a trace file and starts its writer thread
+ * @param filename
+ * @return NULL on error
+ */
+Trace_Writer *trace_writer_open(const char *filename) {
+  Trace_Writer *writer = calloc(1, sizeof(*writer));
+  if (!writer) {
+    return NULL;
+  }
+  writer->ring = malloc(TRACE_RING_RECORDS * sizeof(APEX_Trace_Record));
+  writer->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (!writer->ring || writer->fd < 0) {
+    goto fail;
+  }
+
+  APEX_Trace_Header header;
+  memset(&header, 0, sizeof(header));
+  strncpy(header.magic, APEX_TRACE_MAGIC, sizeof(header.magic));
+  header.version = APEX_TRACE_VERSION;
+  header.byte_order = APEX_TRACE_BYTE_ORDER;
+  header.record_size = sizeof(APEX_Trace_Record);
+  header.end_size = sizeof(APEX_Trace_End);
+  if (write_all(writer->fd, &header, sizeof(header)) != 0) {
+    goto fail;
+  }
+
+  atomic_init(&writer->head, 0);
+  atomic_init(&writer->tail, 0);
+  atomic_init(&writer->closing, 0);
+  if (pthread_create(&writer->thread, NULL, drain_ring, writer) != 0) {
+    goto fail;
+  }
+  return writer;
+
+fail:
+  if (writer->fd >= 0) {
+    close(writer->fd);
+  }
+  free(writer->ring);
+  free(writer);
+  return NULL;
+}
+
+/**
+ * Record to fill next. Waits for the writer while the ring is full.
+ * @param writer
+ * @return
+ */
+APEX_Trace_Record *trace_writer_next(Trace_Writer *writer) {
+  uint64_t head = atomic_load_explicit(&writer->head, memory_order_relaxed);
+  while (head - atomic_load_explicit(&writer->tail, memory_order_acquire) ==
+         TRACE_RING_RECORDS) {
+    sched_yield();
+  }
+  return &writer->ring[head & (TRACE_RING_RECORDS - 1)];
+}
+
+/**
+ * Hands the record returned by trace_writer_next to the writer thread
+ * @param writer
+ */
+void trace_writer_commit(Trace_Writer *writer) {
+  uint64_t head = atomic_load_explicit(&writer->head, memory_order_relaxed);
+  atomic_store_explicit(&writer->head, head + 1, memory_order_release);
+}
+
+/**
+ * Fills in what display prints once the run stops
+ * @param end
+ * @param cpu
+ */
+void trace_fill_end(APEX_Trace_End *end, const APEX_CPU *cpu) {
+  memset(end, 0, sizeof(*end));
+  end->finished = cpu->finished;
+  end->pending_regs = cpu->pending_regs;
+  memcpy(end->regs, cpu->regs, sizeof(end->regs));
+  end->data_memory_words = cpu->data_memory.size < 100 ? cpu->data_memory.size
+                                                       : 100;
+  memory_read(&cpu->data_memory, 0, end->data_memory_words, end->data_memory);
+}
+
+/**
+ * Writes out the remaining records and the end of the run, then closes
+ * the trace
+ * @param writer
+ * @param cpu the CPU as the run left it
+ * @return 0 on success, -1 if any write failed
+ */
+int trace_writer_close(Trace_Writer *writer, const APEX_CPU *cpu) {
+  atomic_store_explicit(&writer->closing, 1, memory_order_release);
+  pthread_join(writer->thread, NULL);
+
+  APEX_Trace_Record record;
+  memset(&record, 0, sizeof(record));
+  record.clock = cpu->clock;
+  record.kind = TRACE_END;
+  APEX_Trace_End end;
+  trace_fill_end(&end, cpu);
+  int failed = writer->failed ||
+               write_all(writer->fd, &record, sizeof(record)) != 0 ||
+               write_all(writer->fd, &end, sizeof(end)) != 0;
+  if (close(writer->fd) != 0) {
+    failed = 1;
+  }
+  free(writer->ring);
+  free(writer);
+  return failed ? -1 : 0;
+}
+
+/**
+ * Tells whether a register slot is one a latch can hold: an architectural
+ * register, REG_FLUSHED or REG_NONE
+ * @param reg
+ * @return
+ */
+static int valid_reg(uint8_t reg) {
+  return reg < NUM_ARCH_REGS || reg == REG_FLUSHED || reg == REG_NONE;
+}
+
+/**
+ * Checks a record read from a trace, which may be corrupt, before it is
+ * printed: its kind, and the opcode and registers of its shown stages,
+ * which index the opcode names
+ * @param record
+ * @return 1 if it is valid
+ */
+int valid_trace_record(const APEX_Trace_Record *record) {
+  if (record->kind != TRACE_CYCLE && record->kind != TRACE_END) {
+    return 0;
+  }
+  for (int id = 0; id < NUM_STAGES; ++id) {
+    const APEX_Trace_Stage *traced = &record->stage[id];
+    if ((record->shown & (1u << id)) &&
+        (traced->opcode_id >= NUM_OPCODES || !valid_reg(traced->rd) ||
+         !valid_reg(traced->rs1) || !valid_reg(traced->rs2))) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * Checks the end of a run read from a trace before it is printed
+ * @param end
+ * @return 1 if it prints no more than the 100 words of data memory it has
+ */
+int valid_trace_end(const APEX_Trace_End *end) {
+  return end->data_memory_words >= 0 && end->data_memory_words <= 100;
+}
+
+/**
+ * Prints a cycle record exactly as display printed the cycle. The record
+ * must be valid, see valid_trace_record.
+ * @param out
+ * @param record
+ */
+void print_trace_record(FILE *out, const APEX_Trace_Record *record) {
+  fprintf(out, "--------------------------------\n");
+  fprintf(out, "Clock Cycle #: %d\n", record->clock);
+  fprintf(out, "--------------------------------\n");
+
+  /** In the order the stages run */
+  static const int order[NUM_STAGES] = {WB, MEM, EX, DRF, F};
+  for (int i = 0; i < NUM_STAGES; ++i) {
+    int id = order[i];
+    if (!(record->shown & (1u << id))) {
+      continue;
+    }
+    const APEX_Trace_Stage *traced = &record->stage[id];
+    CPU_Stage stage;
+    memset(&stage, 0, sizeof(stage));
+    stage.pc = traced->pc;
+    stage.imm = traced->imm;
+    stage.opcode_id = traced->opcode_id;
+    stage.rd = traced->rd;
+    stage.rs1 = traced->rs1;
+    stage.rs2 = traced->rs2;
+    print_stage(out, id, &stage);
+  }
+}
+
+/**
+ * Prints the end of a run exactly as display printed it. It must be
+ * valid, see valid_trace_end.
+ * @param out
+ * @param end
+ */
+void print_trace_end(FILE *out, const APEX_Trace_End *end) {
+  if (end->finished) {
+    fprintf(out, "(apex) >> Simulation Complete\n");
+  }
+  print_state(out, end->regs, end->pending_regs, end->data_memory,
+              end->data_memory_words);
+}
@@ -0,0 +1,80 @@
+#ifndef _APEX_TRACE_H_
+#define _APEX_TRACE_H_
+/**
+ *  trace.h
+ *  Contains the binary pipeline trace: one compact record per cycle of
+ *  what the display functionality would print, written to disk by a
+ *  background thread and rendered back into the display text offline
+ */
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cpu.h"
+
+#define APEX_TRACE_MAGIC "APEXTRC"
+#define APEX_TRACE_VERSION 1
+#define APEX_TRACE_BYTE_ORDER 0x01020304u
+
+/* Header at the start of a trace */
+typedef struct APEX_Trace_Header {
+    char magic[8];               // APEX_TRACE_MAGIC, NUL padded
+    uint32_t version;            // APEX_TRACE_VERSION
+    uint32_t byte_order;         // APEX_TRACE_BYTE_ORDER as written by the host
+    uint32_t record_size;        // sizeof(APEX_Trace_Record)
+    uint32_t end_size;           // sizeof(APEX_Trace_End)
+} APEX_Trace_Header;
+
+/* Kinds of record */
+#define TRACE_CYCLE 1
+#define TRACE_END 2    // Last record, followed by an APEX_Trace_End
+
+/* Latch of one stage as display printed it */
+typedef struct APEX_Trace_Stage {
+    int32_t pc;
+    int32_t imm;
+    uint8_t opcode_id;
+    uint8_t rd;
+    uint8_t rs1;
+    uint8_t rs2;
+} APEX_Trace_Stage;
+
+/* One clock cycle. The stage bits are 1 << F, 1 << DRF and so on */
+typedef struct APEX_Trace_Record {
+    int32_t clock;       // Cycle number as display prints it, from 1
+    uint8_t kind;        // TRACE_CYCLE or TRACE_END
+    uint8_t shown;       // Stages display printed in this cycle
+    uint8_t stalled;     // Stages stalled at the end of the cycle
+    uint8_t flushed;     // Stages flushing the ones behind them in the next cycle
+    APEX_Trace_Stage stage[NUM_STAGES];   // Only valid for the shown stages
+} APEX_Trace_Record;
+
+/* What display prints once the run stops */
+typedef struct APEX_Trace_End {
+    int32_t finished;            // 1 if the run completed the program
+    uint32_t pending_regs;
+    int32_t regs[16];
+    int32_t data_memory_words;   // Words of data_memory printed, at most 100
+    int32_t data_memory[100];
+} APEX_Trace_End;
+
+typedef struct Trace_Writer Trace_Writer;
+
+Trace_Writer *trace_writer_open(const char *filename);
+
+APEX_Trace_Record *trace_writer_next(Trace_Writer *writer);
+
+void trace_writer_commit(Trace_Writer *writer);
+
+int trace_writer_close(Trace_Writer *writer, const APEX_CPU *cpu);
+
+void trace_fill_end(APEX_Trace_End *end, const APEX_CPU *cpu);
+
+int valid_trace_record(const APEX_Trace_Record *record);
+
+int valid_trace_end(const APEX_Trace_End *end);
+
+void print_trace_record(FILE *out, const APEX_Trace_Record *record);
+
+void print_trace_end(FILE *out, const APEX_Trace_End *end);
+
+#endif